@@ -2,6 +2,7 @@
 #include <cstring>
 #include "app.hpp"
 #include "error.hpp"
+#include "config.h"
 
 using namespace px;
 
@@ -78,7 +79,7 @@ void App::init(bool fullscreen)
     if (window) glfwDestroyWindow(window);
 
     glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
-#ifndef NO_MSAA
+#ifdef USE_MSAA
     glfwWindowHint(GLFW_SAMPLES, 16);
 #endif
 
@@ -92,7 +93,7 @@ void App::init(bool fullscreen)
     glewExperimental = GL_TRUE;
     if (glewInit() != GLEW_OK) error("Failed to initialize GLEW.");
     glEnable(GL_DEPTH_TEST);
-#ifndef NO_MSAA
+#ifdef USE_MSAA
     glEnable(GL_MULTISAMPLE);
 #endif
     glDepthFunc(GL_LESS);
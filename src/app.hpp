@@ -34,8 +34,12 @@ public:
         P = GLFW_KEY_P,
         O = GLFW_KEY_O,
         N = GLFW_KEY_N,
+        Z = GLFW_KEY_Z,
+        G = GLFW_KEY_G,
         Up = GLFW_KEY_UP,
         Down = GLFW_KEY_DOWN,
+        Left = GLFW_KEY_LEFT,
+        Right = GLFW_KEY_RIGHT,
         Shift = GLFW_KEY_LEFT_SHIFT,
         Space = GLFW_KEY_SPACE,
         Escape = GLFW_KEY_ESCAPE
@@ -2,10 +2,11 @@
 
 /* #undef INIT_LIGHT_NUM */
 
-#define LIGHTING_BATCH_SIZE 200
+/* #undef LIGHTING_BATCH_SIZE */
 #define MAX_LIGHT_SOURCES 100000
 
 #define LIGHTS_OBJ_NUMBER 100
 #define SPHERES_OBJ_NUMBER 25
 
 /* #undef USE_MSAA */
+#define MSAA_SAMPLES 4
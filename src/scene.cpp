@@ -21,8 +21,9 @@ void Scene::init()
 
     glGenBuffers(1, &camera_param_ubo);
     glBindBuffer(GL_UNIFORM_BUFFER, camera_param_ubo);
-    glBufferData(GL_UNIFORM_BUFFER, sizeof(glm::mat4)*2+sizeof(glm::vec3), nullptr, GL_DYNAMIC_DRAW);
-    glBindBufferRange(GL_UNIFORM_BUFFER, 0, camera_param_ubo, 0, sizeof(glm::mat4)*2+sizeof(glm::vec3));
+    // std140 layout, the inverse view-projection matrix is aligned to 16 bytes after camera position
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(glm::mat4)*3+sizeof(glm::vec4), nullptr, GL_DYNAMIC_DRAW);
+    glBindBufferRange(GL_UNIFORM_BUFFER, 0, camera_param_ubo, 0, sizeof(glm::mat4)*3+sizeof(glm::vec4));
     glBindBuffer(GL_UNIFORM_BUFFER, 0);
 }
 
@@ -35,6 +36,8 @@ void Scene::update(float dt)
                     glm::value_ptr(camera().projection()));
     glBufferSubData(GL_UNIFORM_BUFFER, sizeof(glm::mat4)*2, sizeof(glm::vec3),
                     glm::value_ptr(camera().position()));
+    glBufferSubData(GL_UNIFORM_BUFFER, sizeof(glm::mat4)*2+sizeof(glm::vec4), sizeof(glm::mat4),
+                    glm::value_ptr(glm::inverse(camera().projection() * camera().view())));
     glBindBuffer(GL_UNIFORM_BUFFER, 0);
 
 }
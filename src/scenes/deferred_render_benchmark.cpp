@@ -3,12 +3,16 @@
 #include "config.h"
 #include "util/random.hpp"
 #include "util/shape_generator.hpp"
+#include "util/screen_bounds.hpp"
 
 #include <iostream>
 #include <chrono>
 #include <cstring>
+#include <cstddef>
 #include <algorithm>
+#include <limits>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
 
 #ifndef MAX_LIGHT_SOURCES
 #define MAX_LIGHT_SOURCES 0
@@ -16,25 +20,52 @@
 #ifndef INIT_LIGHT_NUM
 #define INIT_LIGHT_NUM 0
 #endif
+#ifndef MSAA_SAMPLES
+#define MSAA_SAMPLES 4
+#endif
 
 using namespace px;
 
+const int scene::DeferredRenderBenchmark::N_RENDER_MODES = 12;
+const int scene::DeferredRenderBenchmark::GBUFFER_BENCHMARK_FRAMES = 120;
+
 scene::DeferredRenderBenchmark::DeferredRenderBenchmark()
     : scene::ControllableCamera(),
-      deferred_rendering_flag(true),
+      render_mode(RenderMode::Deferred),
       show_light_sources(false),
       display_spheres(true),
       pause(false),
-      show_only(-1)
+      depth_prepass(false),
+      gpu_driven(false),
+      show_only(-1),
+      light_tree_threshold(.25f),
+      visibility_sphere_first_index(0),
+      cluster_build_time(0.f),
+      sphere_cull_time(0.f),
+      light_cull_time(0.f),
+      batch_coverage(0.f),
+      lighting_batch_size(shader::DeferredLighting::MAX_LIGHTS_PER_BATCH),
+      n_lighting_batches(0),
+      light_tree_time(0.f),
+      gbuffer_frame(0),
+      gbuffer_queries{0},
+      gbuffer_query_layout{-1, -1},
+      gbuffer_query_index(0),
+      geometry_queries{{0}},
+      geometry_query_index(0),
+      geometry_query_count(0),
+      geometry_pass_time(0.f),
+      geometry_fragments(0.f)
 {}
 
 scene::DeferredRenderBenchmark::~DeferredRenderBenchmark()
-{}
+{
+    glDeleteQueries(2, gbuffer_queries);
+    glDeleteQueries(4, geometry_queries[0]);
+}
 
 void scene::DeferredRenderBenchmark::init()
 {
-    max_lights_deferred = std::min(INIT_LIGHT_NUM, shader::DeferredLighting::MAX_LIGHTS_PER_BATCH);
-
     // init camera controller mode
     scene::ControllableCamera::init();
     // add some background
@@ -72,6 +103,8 @@ void scene::DeferredRenderBenchmark::init()
                 -scene_height*.5f, light_gap_y, scene_height*.5f,
                 light_avg_height, light_ball_radius);
     lights.moveRadius(light_movement);
+    light_bvh.build(lights.position().data(), lights.radius().data(), static_cast<int>(lights.size()));
+    max_lights_deferred = std::min(INIT_LIGHT_NUM, static_cast<int>(lights.size()));
     spheres.init(-scene_width*.5f, object_gap_x, scene_width*.5f,
                  -scene_height*.5f, object_gap_y, scene_height*.5f,
                  light_avg_height, light_ball_radius*7.5f);
@@ -83,9 +116,76 @@ void scene::DeferredRenderBenchmark::init()
     deferred_pass_shader.init();
     deferred_lighting_shader.init();
     forward_shader.init();
+    tiled_lighting_shader.init();
+    clustered_lighting_shader.init();
+    light_volume_shader.init();
+    light_tree_shader.init();
+    stochastic_lighting_shader.init();
+    amortized_lighting_shader.init();
+    upsampled_lighting_shader.init();
+    reference_pass_shader.init();
+    reference_pass_shader.layout(shader::DeferredLightingPass::REFERENCE_LAYOUT);
+    reference_lighting_shader.init();
+    image_compare_shader.init();
+    glDeleteQueries(2, gbuffer_queries);
+    glGenQueries(2, gbuffer_queries);
+    gbuffer_query_layout[0] = -1;
+    gbuffer_query_layout[1] = -1;
+    glDeleteQueries(4, geometry_queries[0]);
+    glGenQueries(4, geometry_queries[0]);
+    geometry_query_count = 0;
+    gbuffer_stats.assign(shader::DeferredLightingPass::N_LAYOUTS, GBufferStats{0.0, 0.0, 0, 0});
+    visibility_pass_shader.init();
+    visibility_resolve_shader.init();
+    msaa_pass_shader.init();
+    msaa_pass_shader.samples(MSAA_SAMPLES);
+    msaa_lighting_shader.init();
+    sphere_culling_shader.init();
+    sphere_animation_shader.init();
+    {
+        // the sphere mesh is inscribed in the sphere,
+        // enlarge it a little such that it encloses the unit sphere
+        constexpr auto n_grid = 12;
+        auto c = std::cos(static_cast<float>(M_PI) / (2*n_grid));
+        auto volume = generator::sphere(n_grid, 1.f / (c*c));
+        light_volume_shader.setVertices(volume.first.data(), volume.first.size()/3,
+                                        volume.second.data(), volume.second.size());
+    }
+    {
+        // meshes and materials for the visibility buffer resolve,
+        // object 0 is the floor and object i+1 the sphere i
+        std::vector<shader::VisibilityResolve::Vertex> vertices;
+        std::vector<unsigned int> indices;
+        shader::VisibilityResolve::Object object;
+        object.model = floor.model();
+        object.first_index = 0;
+        object.base_vertex = 0;
+        object.material = 0;
+        object.pad = 0;
+        floor.mesh(vertices, indices);
+        visibility_objects.assign(1, object);
+        object.first_index = static_cast<unsigned int>(indices.size());
+        object.base_vertex = static_cast<unsigned int>(vertices.size());
+        object.material = 1;
+        visibility_sphere_first_index = object.first_index;
+        spheres.mesh(vertices, indices);
+        visibility_objects.resize(1 + spheres.size(), object);
+        visibility_resolve_shader.meshes(vertices, indices);
+        floor.material(visibility_resolve_shader, 0);
+        spheres.material(visibility_resolve_shader, 1);
+    }
 
     deferred_pass_shader.activate(true);
     deferred_pass_shader.set("global_ambient", glm::vec3(.5f, .5f, .5f));
+    reference_pass_shader.activate(true);
+    reference_pass_shader.set("global_ambient", glm::vec3(.5f, .5f, .5f));
+    reference_pass_shader.activate(false);
+    msaa_pass_shader.activate(true);
+    msaa_pass_shader.set("global_ambient", glm::vec3(.5f, .5f, .5f));
+    msaa_pass_shader.activate(false);
+    visibility_resolve_shader.activate(true);
+    visibility_resolve_shader.set("global_ambient", glm::vec3(.5f, .5f, .5f));
+    visibility_resolve_shader.activate(false);
     forward_shader.activate(true);
     forward_shader.set("global_ambient", glm::vec3(.5f, .5f, .5f));
     forward_shader.activate(false);
@@ -96,6 +196,16 @@ void scene::DeferredRenderBenchmark::resize(unsigned int width, unsigned int hei
     ControllableCamera::resize(width, height);
     deferred_pass_shader.setBufferSize(width, height);
     deferred_lighting_shader.setBufferSize(width, height);
+    tiled_lighting_shader.setBufferSize(width, height);
+    stochastic_lighting_shader.setBufferSize(width, height);
+    amortized_lighting_shader.setBufferSize(width, height);
+    upsampled_lighting_shader.setBufferSize(width, height);
+    reference_pass_shader.setBufferSize(width, height);
+    reference_lighting_shader.setBufferSize(width, height);
+    visibility_pass_shader.setBufferSize(width, height);
+    visibility_resolve_shader.setBufferSize(width, height);
+    msaa_pass_shader.setBufferSize(width, height);
+    msaa_lighting_shader.setBufferSize(width, height);
 }
 
 void scene::DeferredRenderBenchmark::update(float dt)
@@ -108,44 +218,116 @@ void scene::DeferredRenderBenchmark::update(float dt)
         pause = !pause;
     }
     if (app->keyTriggered(App::Key::M))
-        deferred_rendering_flag = !deferred_rendering_flag;
+    {
+        render_mode = static_cast<RenderMode>((static_cast<int>(render_mode) + 1) % N_RENDER_MODES);
+        if (render_mode == RenderMode::GBufferBenchmark)
+        {
+            gbuffer_frame = 0;
+            gbuffer_stats.assign(shader::DeferredLightingPass::N_LAYOUTS, GBufferStats{0.0, 0.0, 0, 0});
+            gbuffer_query_layout[0] = -1;
+            gbuffer_query_layout[1] = -1;
+        }
+    }
     if (app->keyTriggered(App::Key::O))
         display_spheres = !display_spheres;
     if (app->keyTriggered(App::Key::L))
         show_light_sources = !show_light_sources;
+    if (app->keyTriggered(App::Key::Z))
+        depth_prepass = !depth_prepass;
+    if (app->keyTriggered(App::Key::G))
+        gpu_driven = !gpu_driven;
     if (app->keyTriggered(App::Key::F))
         app->setFullscreen(!app->fullscreen());
     if (app->keyTriggered(App::Key::B))
         resetCamera();
-    if (app->keyTriggered(App::Key::N) && deferred_rendering_flag)
+    if (app->keyTriggered(App::Key::N) && render_mode != RenderMode::Forward)
     {
         if (show_only < -1) show_only = -1;
         show_only += 1;
         if (show_only > 5) show_only = -1;
     }
-    if (app->keyHold(App::Key::Up) &&
-            ((deferred_rendering_flag && max_lights_deferred < static_cast<int>(lights.size())) ||
-             (!deferred_rendering_flag && max_lights_deferred <= shader::ForwardPhong::MAX_LIGHTS)))
+    if (app->keyHold(App::Key::Up) && max_lights_deferred < static_cast<int>(lights.size()))
         ++max_lights_deferred;
     else if (app->keyHold(App::Key::Down) && max_lights_deferred > 0)
+        --max_lights_deferred;
+    if (render_mode == RenderMode::UpsampledDeferred)
     {
-        if (deferred_rendering_flag)
-            --max_lights_deferred;
-        else
-            max_lights_deferred = std::min(shader::ForwardPhong::MAX_LIGHTS, max_lights_deferred) - 1;
+        if (app->keyTriggered(App::Key::Right))
+            upsampled_lighting_shader.downsample(upsampled_lighting_shader.downsample() + 1);
+        else if (app->keyTriggered(App::Key::Left))
+            upsampled_lighting_shader.downsample(upsampled_lighting_shader.downsample() - 1);
     }
+    else if (render_mode == RenderMode::Deferred || render_mode == RenderMode::AmortizedDeferred)
+    {
+        // doubled from 16 up to 4096 lights per batch, after which 0 for a single pass
+        if (app->keyTriggered(App::Key::Right) && lighting_batch_size != 0)
+            lighting_batch_size = lighting_batch_size < 4096 ? lighting_batch_size * 2 : 0;
+        else if (app->keyTriggered(App::Key::Left) && lighting_batch_size != 16)
+            lighting_batch_size = lighting_batch_size == 0 ? 4096 : std::max(16, lighting_batch_size / 2);
+    }
+    else if (app->keyHold(App::Key::Right) && light_tree_threshold < 2.f)
+        light_tree_threshold = std::min(2.f, light_tree_threshold + .01f);
+    else if (app->keyHold(App::Key::Left) && light_tree_threshold > 0.f)
+        light_tree_threshold = std::max(0.f, light_tree_threshold - .01f);
 
     if (pause) return;
 
     scene::ControllableCamera::update(dt);
-    if (display_spheres) spheres.update(dt);
+    if (display_spheres && spheresOnGPU())
+        spheres.animate(sphere_animation_shader, dt);
+    else if (display_spheres)
+        spheres.update(dt);
     lights.update(dt);
+    light_bvh.refit(lights.position().data(), lights.radius().data());
+}
+
+bool scene::DeferredRenderBenchmark::spheresOnGPU() const
+{
+    // forward, visibility buffer and the reference G-buffer still draw the
+    // spheres kept by the CPU cull
+    return gpu_driven && render_mode != RenderMode::Forward &&
+           render_mode != RenderMode::VisibilityBuffer && render_mode != RenderMode::GBufferBenchmark;
 }
 
 void scene::DeferredRenderBenchmark::render()
 {
-    if (deferred_rendering_flag)
+    if (display_spheres && !spheresOnGPU())
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        sphere_culler.frustum(camera().view(), camera().projection());
+        spheres.cull(sphere_culler, camera().position(),
+                     camera().projection()[1][1] * .5f * App::instance()->framebufferHeight());
+        sphere_cull_time = std::chrono::duration<float, std::milli>(
+                std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    // other lighting shaders only support the default G-buffer layout
+    if (render_mode != RenderMode::GBufferBenchmark &&
+        deferred_pass_shader.layoutIndex() != shader::DeferredLightingPass::DEFAULT_LAYOUT)
+        deferred_pass_shader.layout(shader::DeferredLightingPass::DEFAULT_LAYOUT);
+
+    if (render_mode == RenderMode::Deferred)
         deferredRender();
+    else if (render_mode == RenderMode::TiledDeferred)
+        tiledDeferredRender();
+    else if (render_mode == RenderMode::ClusteredDeferred)
+        clusteredDeferredRender();
+    else if (render_mode == RenderMode::LightVolumeDeferred)
+        lightVolumeDeferredRender();
+    else if (render_mode == RenderMode::LightTreeDeferred)
+        lightTreeDeferredRender();
+    else if (render_mode == RenderMode::StochasticDeferred)
+        stochasticDeferredRender();
+    else if (render_mode == RenderMode::AmortizedDeferred)
+        amortizedDeferredRender();
+    else if (render_mode == RenderMode::UpsampledDeferred)
+        upsampledDeferredRender();
+    else if (render_mode == RenderMode::GBufferBenchmark)
+        gBufferBenchmarkRender();
+    else if (render_mode == RenderMode::VisibilityBuffer)
+        visibilityBufferRender();
+    else if (render_mode == RenderMode::MsaaDeferred)
+        msaaDeferredRender();
     else
         forwardRender();
     renderGUI();
@@ -159,41 +341,37 @@ void scene::DeferredRenderBenchmark::resetCamera()
     camera().yaw(90.f);
 }
 
-#define __LIGHT_SET_HELPER(shader)  \
-shader.set("lights[" + std::to_string(counter) + "].position", p[i]);         \
-shader.set("lights[" + std::to_string(counter) + "].ambient",  l[i]*.0f);     \
-shader.set("lights[" + std::to_string(counter) + "].diffuse",  l[i]*1.2f);    \
-shader.set("lights[" + std::to_string(counter) + "].specular", l[i]);         \
-shader.set("lights[" + std::to_string(counter) + "].coef",     a[i]);
-
 void scene::DeferredRenderBenchmark::deferredRender()
 {
-    deferred_pass_shader.activate(true);
-    if (display_spheres) spheres.render(&deferred_pass_shader);
-    floor.render(&deferred_pass_shader);
-    deferred_pass_shader.activate(false);
+    geometryPass(deferred_pass_shader);
+
+    auto n_lights = std::min(max_lights_deferred, static_cast<int>(lights.size()));
+    lights.bind();
+
+    // only lights whose effective sphere touches the view frustum are shaded
+    auto start = std::chrono::high_resolution_clock::now();
+    light_culler.frustum(camera().view(), camera().projection());
+    light_culler.cull(light_bvh, n_lights);
+    lights.bindVisible(light_culler.visible());
+    n_lights = static_cast<int>(light_culler.visible().size());
+    light_cull_time = std::chrono::duration<float, std::milli>(
+            std::chrono::high_resolution_clock::now() - start).count();
 
     deferred_lighting_shader.activate(true);
     deferred_lighting_shader.set("show_only", show_only);
-    auto counter = 0;
-    if (max_lights_deferred > 0 && shader::DeferredLighting::MAX_LIGHTS_PER_BATCH > 0)
-    {
-        const auto &p = lights.position();
-        const auto &l = lights.color();
-        const auto &a = lights.attenuation();
-        for (int i = 0, tot = static_cast<int>(lights.size());
-             i < tot && i < max_lights_deferred; ++i)
-        {
-            __LIGHT_SET_HELPER(deferred_lighting_shader)
-            ++counter;
-            if (counter == shader::DeferredLighting::MAX_LIGHTS_PER_BATCH && i + 1 < max_lights_deferred)
-            {
-                deferred_lighting_shader.renderCache(counter, deferred_pass_shader);
-                counter = 0;
-            }
-        }
+    auto batch_size = lighting_batch_size > 0 ? lighting_batch_size : n_lights;
+    if (n_lights > batch_size)
+    {
+        renderLightingBatches(light_culler.visible(), batch_size);
+        // composite the accumulated lighting onto the screen
+        deferred_lighting_shader.render(n_lights, 0, deferred_pass_shader);
+    }
+    else
+    {
+        batch_coverage = n_lights > 0 ? 1.f : 0.f;
+        n_lighting_batches = n_lights > 0 ? 1 : 0;
+        deferred_lighting_shader.render(0, n_lights, deferred_pass_shader);
     }
-    deferred_lighting_shader.render(counter, deferred_pass_shader);
     deferred_lighting_shader.activate(false);
 
     deferred_pass_shader.extractDepthBuffer();
@@ -201,24 +379,98 @@ void scene::DeferredRenderBenchmark::deferredRender()
     skybox.render();
 }
 
-void scene::DeferredRenderBenchmark::forwardRender()
+void scene::DeferredRenderBenchmark::geometryPass(shader::DeferredLightingPass &pass)
 {
-    forward_shader.activate(true);
-    auto counter = 0;
-    if (max_lights_deferred > 0 && shader::ForwardPhong::MAX_LIGHTS > 0)
-    {
-        auto tot = std::min(max_lights_deferred, shader::ForwardPhong::MAX_LIGHTS);
-        const auto &p = lights.position();
-        const auto &l = lights.color();
-        const auto &a = lights.attenuation();
-        for (decltype(tot) i = 0; i < tot; ++i)
-        {
-            __LIGHT_SET_HELPER(forward_shader)
+    auto const &queries = geometry_queries[geometry_query_index];
+    glBeginQuery(GL_TIME_ELAPSED, queries[0]);
+    if (gpu_driven && display_spheres)
+        spheres.cull(sphere_culling_shader, pass.bufferHeight());
+    if (depth_prepass)
+    {
+        pass.activatePrepass(true);
+        renderSpheres(pass.prepass());
+        floor.render(pass.prepass());
+        pass.activatePrepass(false);
+    }
+    // fragments that pass the depth test run the full G-buffer shader
+    glBeginQuery(GL_SAMPLES_PASSED, queries[1]);
+    pass.activate(true);
+    renderSpheres(&pass);
+    floor.render(&pass);
+    pass.activate(false);
+    glEndQuery(GL_SAMPLES_PASSED);
+    glEndQuery(GL_TIME_ELAPSED);
+    readGeometryQueries(pass.bufferWidth(), pass.bufferHeight());
+}
 
-            ++counter;
+void scene::DeferredRenderBenchmark::renderSpheres(Shader *shader)
+{
+    if (!display_spheres)
+        return;
+    if (gpu_driven)
+        spheres.renderIndirect(shader, sphere_culling_shader);
+    else
+        spheres.render(shader);
+}
+
+void scene::DeferredRenderBenchmark::readGeometryQueries(int width, int height)
+{
+    geometry_query_index = 1 - geometry_query_index;
+    if (++geometry_query_count < 2)
+        return;
+    auto const &last = geometry_queries[geometry_query_index];
+    GLuint64 elapsed, samples;
+    glGetQueryObjectui64v(last[0], GL_QUERY_RESULT, &elapsed);
+    glGetQueryObjectui64v(last[1], GL_QUERY_RESULT, &samples);
+    geometry_pass_time = static_cast<float>(elapsed * 1e-6);
+    geometry_fragments = static_cast<float>(samples) / (width * height);
+}
+
+void scene::DeferredRenderBenchmark::renderLightingBatches(std::vector<unsigned int> const &visible,
+                                                           int batch_size)
+{
+    // visible lights are in the leaf order of light_bvh,
+    // so each batch is spatially coherent and only lights its screen rectangle
+    auto const &view = camera().view();
+    auto const &proj = camera().projection();
+    auto near_clip = camera().nearClip();
+    auto n_lights = static_cast<int>(visible.size());
+    auto width = deferred_pass_shader.bufferWidth();
+    auto height = deferred_pass_shader.bufferHeight();
+    auto covered = 0.f;
+    n_lighting_batches = 0;
+    for (auto offset = 0; offset < n_lights; offset += batch_size)
+    {
+        auto n = std::min(batch_size, n_lights - offset);
+        glm::vec4 rect(1.f, 1.f, -1.f, -1.f);
+        for (auto i = offset; i < offset + n; ++i)
+        {
+            auto r = sphereNDCRect(view, proj, near_clip,
+                                   lights.position()[visible[i]], lights.radius()[visible[i]]);
+            rect = glm::vec4(std::min(rect.x, r.x), std::min(rect.y, r.y),
+                             std::max(rect.z, r.z), std::max(rect.w, r.w));
         }
+        auto x0 = static_cast<int>(std::floor((rect.x + 1.f) * .5f * width));
+        auto y0 = static_cast<int>(std::floor((rect.y + 1.f) * .5f * height));
+        auto x1 = static_cast<int>(std::ceil((rect.z + 1.f) * .5f * width));
+        auto y1 = static_cast<int>(std::ceil((rect.w + 1.f) * .5f * height));
+        if (x1 <= x0 || y1 <= y0)
+            continue;
+        covered += static_cast<float>(x1 - x0) * (y1 - y0);
+        ++n_lighting_batches;
+        deferred_lighting_shader.renderCache(offset, n, deferred_pass_shader,
+                                             x0, y0, x1 - x0, y1 - y0);
     }
-    forward_shader.set("n_lights", counter);
+    batch_coverage = covered / (static_cast<float>(width) * height);
+}
+
+void scene::DeferredRenderBenchmark::forwardRender()
+{
+    auto n_lights = std::min(max_lights_deferred, static_cast<int>(lights.size()));
+    lights.bind();
+
+    forward_shader.activate(true);
+    forward_shader.set("n_lights", n_lights);
     if (display_spheres) spheres.render(&forward_shader);
     floor.render(&forward_shader);
     forward_shader.activate(false);
@@ -227,8 +479,352 @@ void scene::DeferredRenderBenchmark::forwardRender()
     skybox.render();
 }
 
+void scene::DeferredRenderBenchmark::tiledDeferredRender()
+{
+    geometryPass(deferred_pass_shader);
+
+    auto n_lights = std::min(max_lights_deferred, static_cast<int>(lights.size()));
+    lights.bind();
+
+    tiled_lighting_shader.activate(true);
+    tiled_lighting_shader.set("show_only", show_only);
+    tiled_lighting_shader.render(n_lights, deferred_pass_shader);
+    tiled_lighting_shader.activate(false);
+
+    deferred_pass_shader.extractDepthBuffer();
+    if (show_light_sources) lights.render();
+    skybox.render();
+}
+
+void scene::DeferredRenderBenchmark::clusteredDeferredRender()
+{
+    geometryPass(deferred_pass_shader);
+
+    auto n_lights = std::min(max_lights_deferred, static_cast<int>(lights.size()));
+    lights.bind();
+
+    auto start = std::chrono::high_resolution_clock::now();
+    light_clusters.depthRange(ClusterBuilder::DEFAULT_NEAR, camera().farClip());
+    light_culler.frustum(camera().view(), camera().projection());
+    light_culler.cull(light_bvh, n_lights);
+    light_clusters.build(camera().view(), camera().projection(),
+                         lights.position().data(), lights.radius().data(),
+                         light_culler.visible().data(), static_cast<int>(light_culler.visible().size()));
+    cluster_build_time = std::chrono::duration<float, std::milli>(
+            std::chrono::high_resolution_clock::now() - start).count();
+
+    clustered_lighting_shader.activate(true);
+    clustered_lighting_shader.set("show_only", show_only);
+    clustered_lighting_shader.setClusters(light_clusters);
+    clustered_lighting_shader.render(deferred_pass_shader);
+    clustered_lighting_shader.activate(false);
+
+    deferred_pass_shader.extractDepthBuffer();
+    if (show_light_sources) lights.render();
+    skybox.render();
+}
+
+void scene::DeferredRenderBenchmark::lightVolumeDeferredRender()
+{
+    geometryPass(deferred_pass_shader);
+
+    // ambient, or the chosen framebuffer content
+    deferred_lighting_shader.activate(true);
+    deferred_lighting_shader.set("show_only", show_only);
+    deferred_lighting_shader.render(0, 0, deferred_pass_shader);
+    deferred_lighting_shader.activate(false);
+
+    deferred_pass_shader.extractDepthBuffer();
+    if (show_only < 0 || show_only > 4)
+    {
+        auto n_lights = std::min(max_lights_deferred, static_cast<int>(lights.size()));
+        lights.bind();
+
+        light_volume_shader.activate(true);
+        light_volume_shader.set("show_only", show_only);
+        light_volume_shader.render(n_lights, deferred_pass_shader);
+        light_volume_shader.activate(false);
+    }
+
+    if (show_light_sources) lights.render();
+    skybox.render();
+}
+
+void scene::DeferredRenderBenchmark::lightTreeDeferredRender()
+{
+    geometryPass(deferred_pass_shader);
+
+    auto n_lights = std::min(max_lights_deferred, static_cast<int>(lights.size()));
+    lights.bind();
+
+    auto start = std::chrono::high_resolution_clock::now();
+    light_tree.update(light_bvh, lights.position().data(), lights.radius().data(),
+                      lights.ambient().data(), lights.diffuse().data(),
+                      lights.specular().data(), lights.coef().data(), n_lights);
+    light_tree_time = std::chrono::duration<float, std::milli>(
+            std::chrono::high_resolution_clock::now() - start).count();
+
+    light_tree_shader.activate(true);
+    light_tree_shader.set("show_only", show_only);
+    light_tree_shader.set("n_lights", n_lights);
+    light_tree_shader.set("cut_threshold", light_tree_threshold);
+    light_tree_shader.setTree(light_tree);
+    light_tree_shader.render(deferred_pass_shader);
+    light_tree_shader.activate(false);
+
+    deferred_pass_shader.extractDepthBuffer();
+    if (show_light_sources) lights.render();
+    skybox.render();
+}
+
+void scene::DeferredRenderBenchmark::stochasticDeferredRender()
+{
+    geometryPass(deferred_pass_shader);
+
+    auto n_lights = std::min(max_lights_deferred, static_cast<int>(lights.size()));
+    lights.bind();
+
+    stochastic_lighting_shader.activate(true);
+    stochastic_lighting_shader.set("show_only", show_only);
+    stochastic_lighting_shader.render(n_lights, camera().projection() * camera().view(),
+                                      deferred_pass_shader);
+    stochastic_lighting_shader.activate(false);
+
+    if (show_only == 5)
+    {
+        // exact result of deferred lighting as the reference,
+        // renderCache leaves it in the ambient buffer of the G-buffer
+        light_culler.frustum(camera().view(), camera().projection());
+        light_culler.cull(light_bvh, n_lights);
+        lights.bindVisible(light_culler.visible());
+        deferred_lighting_shader.activate(true);
+        deferred_lighting_shader.set("show_only", -1);
+        deferred_lighting_shader.renderCache(0, static_cast<int>(light_culler.visible().size()),
+                                             deferred_pass_shader);
+        deferred_lighting_shader.activate(false);
+
+        stochastic_lighting_shader.activate(true);
+        stochastic_lighting_shader.compare(deferred_pass_shader);
+        stochastic_lighting_shader.activate(false);
+    }
+
+    deferred_pass_shader.extractDepthBuffer();
+    if (show_light_sources) lights.render();
+    skybox.render();
+}
+
+void scene::DeferredRenderBenchmark::amortizedDeferredRender()
+{
+    geometryPass(deferred_pass_shader);
+
+    auto n_lights = std::min(max_lights_deferred, static_cast<int>(lights.size()));
+    lights.bind();
+
+    // only visible lights of the current subset are shaded,
+    // the others are taken from history
+    auto start = std::chrono::high_resolution_clock::now();
+    light_culler.frustum(camera().view(), camera().projection());
+    light_culler.cull(light_bvh, n_lights);
+    amortized_lights.clear();
+    auto subset = static_cast<unsigned int>(amortized_lighting_shader.subset());
+    for (auto i : light_culler.visible())
+    {
+        if (i % shader::AmortizedLighting::N_SUBSETS == subset)
+            amortized_lights.push_back(i);
+    }
+    lights.bindVisible(amortized_lights);
+    n_lights = static_cast<int>(amortized_lights.size());
+    light_cull_time = std::chrono::duration<float, std::milli>(
+            std::chrono::high_resolution_clock::now() - start).count();
+
+    amortized_lighting_shader.cacheAmbient(deferred_pass_shader);
+    if (n_lights > 0)
+    {
+        deferred_lighting_shader.activate(true);
+        deferred_lighting_shader.set("show_only", -1);
+        renderLightingBatches(amortized_lights, lighting_batch_size > 0 ? lighting_batch_size : n_lights);
+        deferred_lighting_shader.activate(false);
+    }
+    else
+    {
+        batch_coverage = 0.f;
+        n_lighting_batches = 0;
+    }
+
+    amortized_lighting_shader.activate(true);
+    amortized_lighting_shader.set("show_only", show_only);
+    amortized_lighting_shader.render(camera().projection() * camera().view(), deferred_pass_shader);
+    amortized_lighting_shader.activate(false);
+
+    deferred_pass_shader.extractDepthBuffer();
+    if (show_light_sources) lights.render();
+    skybox.render();
+}
+
+void scene::DeferredRenderBenchmark::upsampledDeferredRender()
+{
+    geometryPass(deferred_pass_shader);
+
+    auto n_lights = std::min(max_lights_deferred, static_cast<int>(lights.size()));
+    lights.bind();
+
+    auto start = std::chrono::high_resolution_clock::now();
+    light_culler.frustum(camera().view(), camera().projection());
+    light_culler.cull(light_bvh, n_lights);
+    lights.bindVisible(light_culler.visible());
+    n_lights = static_cast<int>(light_culler.visible().size());
+    light_cull_time = std::chrono::duration<float, std::milli>(
+            std::chrono::high_resolution_clock::now() - start).count();
+
+    upsampled_lighting_shader.activate(true);
+    upsampled_lighting_shader.set("show_only", show_only);
+    upsampled_lighting_shader.render(n_lights, deferred_pass_shader);
+    upsampled_lighting_shader.activate(false);
+
+    deferred_pass_shader.extractDepthBuffer();
+    if (show_light_sources) lights.render();
+    skybox.render();
+}
+
+void scene::DeferredRenderBenchmark::gBufferBenchmarkRender()
+{
+    if (gbuffer_frame >= GBUFFER_BENCHMARK_FRAMES)
+    {
+        auto next = (deferred_pass_shader.layoutIndex() + 1) % shader::DeferredLightingPass::N_LAYOUTS;
+        deferred_pass_shader.layout(next);
+        gbuffer_stats[next] = GBufferStats{0.0, 0.0, 0, 0};
+        gbuffer_frame = 0;
+    }
+    ++gbuffer_frame;
+
+    // the reference is not measured and so skips geometryPass()
+    reference_pass_shader.activate(true);
+    if (display_spheres) spheres.render(&reference_pass_shader);
+    floor.render(&reference_pass_shader);
+    reference_pass_shader.activate(false);
+    geometryPass(deferred_pass_shader);
+
+    auto n_lights = std::min(max_lights_deferred, static_cast<int>(lights.size()));
+    lights.bind();
+    light_culler.frustum(camera().view(), camera().projection());
+    light_culler.cull(light_bvh, n_lights);
+    lights.bindVisible(light_culler.visible());
+    n_lights = static_cast<int>(light_culler.visible().size());
+
+    reference_lighting_shader.activate(true);
+    reference_lighting_shader.set("show_only", -1);
+    reference_lighting_shader.renderCache(0, n_lights, reference_pass_shader);
+    reference_lighting_shader.activate(false);
+
+    deferred_lighting_shader.activate(true);
+    deferred_lighting_shader.set("show_only", -1);
+    glBeginQuery(GL_TIME_ELAPSED, gbuffer_queries[gbuffer_query_index]);
+    deferred_lighting_shader.renderCache(0, n_lights, deferred_pass_shader);
+    glEndQuery(GL_TIME_ELAPSED);
+    gbuffer_query_layout[gbuffer_query_index] = deferred_pass_shader.layoutIndex();
+    deferred_lighting_shader.render(n_lights, 0, deferred_pass_shader);
+    deferred_lighting_shader.activate(false);
+
+    image_compare_shader.compare(deferred_pass_shader, reference_pass_shader);
+    // the query and comparison of the last frame have finished by now, and are
+    // credited to the layout they measured in case the layout just changed
+    gbuffer_query_index = 1 - gbuffer_query_index;
+    auto last = gbuffer_query_layout[gbuffer_query_index];
+    if (last != -1)
+    {
+        GLuint64 elapsed;
+        glGetQueryObjectui64v(gbuffer_queries[gbuffer_query_index], GL_QUERY_RESULT, &elapsed);
+        gbuffer_stats[last].gpu_time += elapsed * 1e-6;
+        ++gbuffer_stats[last].n_timed;
+        gbuffer_stats[last].mse += image_compare_shader.previousMse();
+        ++gbuffer_stats[last].n_frames;
+        gbuffer_query_layout[gbuffer_query_index] = -1;
+    }
+
+    deferred_pass_shader.extractDepthBuffer();
+    if (show_light_sources) lights.render();
+    skybox.render();
+}
+
+void scene::DeferredRenderBenchmark::visibilityBufferRender()
+{
+    // measured the same way as the geometry pass of the G-buffer path
+    auto const &queries = geometry_queries[geometry_query_index];
+    glBeginQuery(GL_TIME_ELAPSED, queries[0]);
+    glBeginQuery(GL_SAMPLES_PASSED, queries[1]);
+    visibility_pass_shader.activate(true);
+    if (display_spheres) spheres.render(&visibility_pass_shader);
+    floor.render(&visibility_pass_shader);
+    visibility_pass_shader.activate(false);
+    glEndQuery(GL_SAMPLES_PASSED);
+    glEndQuery(GL_TIME_ELAPSED);
+    readGeometryQueries(visibility_pass_shader.bufferWidth(), visibility_pass_shader.bufferHeight());
+
+    visibility_objects[0].model = floor.model();
+    // objects beyond the drawn spheres are never referenced
+    auto const &drawn = spheres.drawn();
+    for (std::size_t k = 0, n = drawn.size(); k < n; ++k)
+    {
+        visibility_objects[k+1].model = spheres.model(drawn[k]);
+        visibility_objects[k+1].first_index = visibility_sphere_first_index +
+                                              spheres.levelFirstIndex(spheres.level(drawn[k]));
+    }
+    visibility_resolve_shader.objects(visibility_objects);
+
+    auto n_lights = std::min(max_lights_deferred, static_cast<int>(lights.size()));
+    lights.bind();
+    light_culler.frustum(camera().view(), camera().projection());
+    light_culler.cull(light_bvh, n_lights);
+    lights.bindVisible(light_culler.visible());
+    n_lights = static_cast<int>(light_culler.visible().size());
+
+    visibility_resolve_shader.activate(true);
+    visibility_resolve_shader.set("show_only", show_only);
+    visibility_resolve_shader.render(n_lights, visibility_pass_shader);
+    visibility_resolve_shader.activate(false);
+
+    visibility_pass_shader.extractDepthBuffer();
+    if (show_light_sources) lights.render();
+    skybox.render();
+}
+
+void scene::DeferredRenderBenchmark::msaaDeferredRender()
+{
+    geometryPass(msaa_pass_shader);
+
+    auto n_lights = std::min(max_lights_deferred, static_cast<int>(lights.size()));
+    lights.bind();
+
+    auto start = std::chrono::high_resolution_clock::now();
+    light_culler.frustum(camera().view(), camera().projection());
+    light_culler.cull(light_bvh, n_lights);
+    lights.bindVisible(light_culler.visible());
+    n_lights = static_cast<int>(light_culler.visible().size());
+    light_cull_time = std::chrono::duration<float, std::milli>(
+            std::chrono::high_resolution_clock::now() - start).count();
+
+    msaa_lighting_shader.activate(true);
+    msaa_lighting_shader.set("show_only", show_only);
+    msaa_lighting_shader.render(n_lights, msaa_pass_shader);
+    msaa_lighting_shader.activate(false);
+
+    // resolves depth and stencil from the multisampled buffer
+    msaa_pass_shader.extractDepthBuffer();
+    if (show_light_sources) lights.render();
+    skybox.render();
+}
+
 void scene::DeferredRenderBenchmark::renderGUI()
 {
+    static const char *mode_names[] = {
+            "Deferred Rendering", "Forward Rendering",
+            "Tiled Deferred Rendering", "Clustered Deferred Rendering",
+            "Light Volume Deferred Rendering", "Light Tree Deferred Rendering",
+            "Stochastic Deferred Rendering", "Amortized Deferred Rendering",
+            "Upsampled Deferred Rendering", "G-Buffer Layout Benchmark",
+            "Visibility Buffer Rendering", "MSAA Deferred Rendering"
+    };
+
     constexpr float vertical_gap = 20.f;
     constexpr float scale = .4f;
     const static glm::vec4 color(1.f);
@@ -262,25 +858,188 @@ void scene::DeferredRenderBenchmark::renderGUI()
         text.render("Normal Map",
                     app->framebufferWidth() - 10, h+vertical_gap, scale, color,
                     screen_width, screen_height, shader::Text::Anchor::RightTop);
+    else if (show_only == 5 && render_mode == RenderMode::TiledDeferred)
+        text.render("Lights per Tile",
+                    app->framebufferWidth() - 10, h+vertical_gap, scale, color,
+                    screen_width, screen_height, shader::Text::Anchor::RightTop);
+    else if (show_only == 5 && render_mode == RenderMode::ClusteredDeferred)
+        text.render("Lights per Cluster",
+                    app->framebufferWidth() - 10, h+vertical_gap, scale, color,
+                    screen_width, screen_height, shader::Text::Anchor::RightTop);
+    else if (show_only == 5 && render_mode == RenderMode::LightVolumeDeferred)
+        text.render("Light Volume Overdraw",
+                    app->framebufferWidth() - 10, h+vertical_gap, scale, color,
+                    screen_width, screen_height, shader::Text::Anchor::RightTop);
+    else if (show_only == 5 && render_mode == RenderMode::LightTreeDeferred)
+        text.render("Light Tree Cut Size",
+                    app->framebufferWidth() - 10, h+vertical_gap, scale, color,
+                    screen_width, screen_height, shader::Text::Anchor::RightTop);
+    else if (show_only == 5 && render_mode == RenderMode::StochasticDeferred)
+        text.render("Error vs. Exact Deferred",
+                    app->framebufferWidth() - 10, h+vertical_gap, scale, color,
+                    screen_width, screen_height, shader::Text::Anchor::RightTop);
+    else if (show_only == 5 && render_mode == RenderMode::AmortizedDeferred)
+        text.render("Rejected History",
+                    app->framebufferWidth() - 10, h+vertical_gap, scale, color,
+                    screen_width, screen_height, shader::Text::Anchor::RightTop);
+    else if (show_only == 5 && render_mode == RenderMode::UpsampledDeferred)
+        text.render("Upsampling Edges",
+                    app->framebufferWidth() - 10, h+vertical_gap, scale, color,
+                    screen_width, screen_height, shader::Text::Anchor::RightTop);
+    else if (show_only == 5 && render_mode == RenderMode::VisibilityBuffer)
+        text.render("Triangle IDs",
+                    app->framebufferWidth() - 10, h+vertical_gap, scale, color,
+                    screen_width, screen_height, shader::Text::Anchor::RightTop);
+    else if (show_only == 5 && render_mode == RenderMode::MsaaDeferred)
+        text.render("Per-Sample Lit Edges",
+                    app->framebufferWidth() - 10, h+vertical_gap, scale, color,
+                    screen_width, screen_height, shader::Text::Anchor::RightTop);
 
     // rendering mode, left top corner
-    text.render(std::string("Rendering Mode: ") + (deferred_rendering_flag ?
-                     "Deferred Rendering" : "Forward Rendering"),
+    text.render(std::string("Rendering Mode: ") + mode_names[static_cast<int>(render_mode)],
                 10, h, scale, color,
                 screen_width, screen_height, shader::Text::Anchor::LeftTop);
     // # of lights
     h += vertical_gap;
-    text.render("Number of Lights: " + std::to_string(
-            deferred_rendering_flag ? max_lights_deferred : std::min(shader::ForwardPhong::MAX_LIGHTS, max_lights_deferred)
-            ) +
+    text.render("Number of Lights: " + std::to_string(max_lights_deferred) +
                 "/ " + std::to_string(lights.size()),
                 10, h, scale, color,
                 screen_width, screen_height, shader::Text::Anchor::LeftTop);
     // # of spheres
     h += vertical_gap;
-    text.render("Number of Sphere Objects: " + std::to_string(spheres.size()),
+    text.render(spheresOnGPU() ?
+                "Number of Sphere Objects: " + std::to_string(spheres.size()) +
+                ", animated and culled on the GPU only" :
+                "Number of Sphere Objects: " + std::to_string(spheres.size()) + ", " +
+                std::to_string(spheres.drawn().size()) + " drawn after CPU culling in " +
+                std::to_string(sphere_cull_time) + " ms, " +
+                std::to_string(spheres.levelSize(0)) + "/" + std::to_string(spheres.levelSize(1)) + "/" +
+                std::to_string(spheres.levelSize(2)) + "/" + std::to_string(spheres.levelSize(3)) +
+                " at LOD 48/24/12/6",
                 10, h, scale, color,
                 screen_width, screen_height, shader::Text::Anchor::LeftTop);
+    // cost of the G-buffer pass, fragments per pixel show the overdraw
+    if (render_mode == RenderMode::VisibilityBuffer)
+    {
+        h += vertical_gap;
+        text.render("Geometry Pass: " + std::to_string(geometry_pass_time) + " ms, " +
+                    std::to_string(geometry_fragments) + " fragments per pixel, " +
+                    std::to_string(shader::VisibilityPass::BYTES_PER_PIXEL) + " vs. " +
+                    std::to_string(shader::DeferredLightingPass::bytesPerPixel(deferred_pass_shader.layout())) +
+                    " G-buffer bytes per pixel",
+                    10, h, scale, color,
+                    screen_width, screen_height, shader::Text::Anchor::LeftTop);
+    }
+    else if (render_mode != RenderMode::Forward)
+    {
+        h += vertical_gap;
+        text.render("Geometry Pass: " + std::to_string(geometry_pass_time) + " ms, " +
+                    std::to_string(geometry_fragments) + " fragments per pixel, depth pre-pass " +
+                    (depth_prepass ? "on" : "off"),
+                    10, h, scale, color,
+                    screen_width, screen_height, shader::Text::Anchor::LeftTop);
+        h += vertical_gap;
+        text.render(gpu_driven ?
+                    "GPU-Driven Spheres: " + std::to_string(sphere_culling_shader.visibleCount()) +
+                    " / " + std::to_string(spheres.size()) + " drawn by 1 indirect draw" :
+                    "GPU-Driven Spheres: off",
+                    10, h, scale, color,
+                    screen_width, screen_height, shader::Text::Anchor::LeftTop);
+    }
+    // time cost of CPU light culling
+    if (render_mode == RenderMode::Deferred || render_mode == RenderMode::AmortizedDeferred)
+    {
+        h += vertical_gap;
+        text.render("Light Culling: " + std::to_string(light_cull_time) + " ms, " +
+                    std::to_string(light_culler.visible().size()) + " visible lights",
+                    10, h, scale, color,
+                    screen_width, screen_height, shader::Text::Anchor::LeftTop);
+        // number of batches and the sum of their scissor areas in units of the screen
+        h += vertical_gap;
+        text.render("Lighting Batches: " + std::to_string(n_lighting_batches) + " of " +
+                    (lighting_batch_size > 0 ? "up to " + std::to_string(lighting_batch_size) : std::string("all")) +
+                    " lights, covering " + std::to_string(batch_coverage) + " screens",
+                    10, h, scale, color,
+                    screen_width, screen_height, shader::Text::Anchor::LeftTop);
+    }
+    // time cost of CPU light tree update and the quality knob
+    if (render_mode == RenderMode::LightTreeDeferred)
+    {
+        h += vertical_gap;
+        text.render("Light Tree Update: " + std::to_string(light_tree_time) + " ms, " +
+                    std::to_string(light_tree.nodes().size()) + " nodes, threshold " +
+                    std::to_string(light_tree_threshold),
+                    10, h, scale, color,
+                    screen_width, screen_height, shader::Text::Anchor::LeftTop);
+    }
+    // bandwidth, lighting pass time and error of each G-buffer layout
+    if (render_mode == RenderMode::GBufferBenchmark)
+    {
+        for (auto i = 0; i < shader::DeferredLightingPass::N_LAYOUTS; ++i)
+        {
+            auto const &layout = shader::DeferredLightingPass::LAYOUTS[i];
+            auto const &stats = gbuffer_stats[i];
+            auto line = std::string(i == deferred_pass_shader.layoutIndex() ? "> " : "  ") +
+                        layout.name + ": " +
+                        std::to_string(shader::DeferredLightingPass::bytesPerPixel(layout)) + " B/pixel";
+            if (stats.n_timed > 0)
+                line += ", " + std::to_string(stats.gpu_time / stats.n_timed) + " ms";
+            if (stats.n_frames > 0)
+                line += ", PSNR " +
+                        std::to_string(shader::ImageCompare::psnr(
+                                static_cast<float>(stats.mse / stats.n_frames))) + " dB";
+            h += vertical_gap;
+            text.render(line, 10, h, scale, color,
+                        screen_width, screen_height, shader::Text::Anchor::LeftTop);
+        }
+    }
+    // resolution of lighting
+    if (render_mode == RenderMode::UpsampledDeferred)
+    {
+        h += vertical_gap;
+        text.render("Lighting Resolution: 1/" + std::to_string(upsampled_lighting_shader.downsample()) +
+                    " x 1/" + std::to_string(upsampled_lighting_shader.downsample()),
+                    10, h, scale, color,
+                    screen_width, screen_height, shader::Text::Anchor::LeftTop);
+    }
+    // share of pixels paying for per-sample lighting
+    if (render_mode == RenderMode::MsaaDeferred)
+    {
+        h += vertical_gap;
+        text.render("Per-Sample Lighting: " + std::to_string(msaa_pass_shader.samples()) +
+                    " samples on " + std::to_string(msaa_lighting_shader.edgeFraction()*100.f) +
+                    "% of pixels",
+                    10, h, scale, color,
+                    screen_width, screen_height, shader::Text::Anchor::LeftTop);
+    }
+    // quality of stochastic lighting against the exact deferred lighting
+    if (render_mode == RenderMode::StochasticDeferred && show_only == 5)
+    {
+        h += vertical_gap;
+        text.render("RMSE: " + std::to_string(stochastic_lighting_shader.rmse()) +
+                    ", PSNR: " + std::to_string(stochastic_lighting_shader.psnr()) + " dB",
+                    10, h, scale, color,
+                    screen_width, screen_height, shader::Text::Anchor::LeftTop);
+    }
+    // tiles whose light lists are full, lights beyond the limit are dropped
+    if (render_mode == RenderMode::TiledDeferred)
+    {
+        h += vertical_gap;
+        text.render("Tile Light Lists: " + std::to_string(tiled_lighting_shader.overflowTiles()) +
+                    " / " + std::to_string(tiled_lighting_shader.tileCount()) + " tiles over " +
+                    std::to_string(shader::TiledDeferredLighting::MAX_LIGHTS_PER_TILE) + " lights",
+                    10, h, scale, color,
+                    screen_width, screen_height, shader::Text::Anchor::LeftTop);
+    }
+    // time cost of CPU cluster building
+    if (render_mode == RenderMode::ClusteredDeferred)
+    {
+        h += vertical_gap;
+        text.render("Cluster Building: " + std::to_string(cluster_build_time) + " ms, " +
+                    std::to_string(light_clusters.indices().size()) + " light indices",
+                    10, h, scale, color,
+                    screen_width, screen_height, shader::Text::Anchor::LeftTop);
+    }
 
     // pause or not
     if (pause)
@@ -289,10 +1048,71 @@ void scene::DeferredRenderBenchmark::renderGUI()
                 screen_width, screen_height, shader::Text::Anchor::LeftBottom);
 }
 
+const int scene::DeferredRenderBenchmark::Lights::N_RING_BUFFERS;
+const int scene::DeferredRenderBenchmark::Spheres::N_LODS;
+const unsigned int scene::DeferredRenderBenchmark::Spheres::LOD_GRIDS[N_LODS] = {48, 24, 12, 6};
+const float scene::DeferredRenderBenchmark::Spheres::LOD_HYSTERESIS = .8f;
+
 scene::DeferredRenderBenchmark::Lights::Lights()
-    : shader::Lamp()
+    : shader::Lamp(), ssbo(0), visible_ssbo(0),
+      mapped_(nullptr), stride_(0), ring_index_(0), fences_{nullptr},
+      visible_mapped_(nullptr), visible_stride_(0), visible_index_(0), visible_fences_{nullptr}
 {}
 
+scene::DeferredRenderBenchmark::Lights::~Lights()
+{
+    releaseRing();
+}
+
+void scene::DeferredRenderBenchmark::Lights::releaseRing()
+{
+#define __RELEASE_RING_HELPER(buffer, mapped, fences)               \
+    for (auto &f : fences)                                          \
+    {                                                               \
+        if (f) glDeleteSync(f);                                     \
+        f = nullptr;                                                \
+    }                                                               \
+    if (mapped)                                                     \
+    {                                                               \
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);             \
+        glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);                    \
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);                  \
+        mapped = nullptr;                                           \
+    }                                                               \
+    glDeleteBuffers(1, &buffer);                                    \
+    buffer = 0;
+
+    __RELEASE_RING_HELPER(ssbo, mapped_, fences_)
+    __RELEASE_RING_HELPER(visible_ssbo, visible_mapped_, visible_fences_)
+#undef __RELEASE_RING_HELPER
+}
+
+void scene::DeferredRenderBenchmark::Lights::waitFence(GLsync &fence)
+{
+    if (fence == nullptr)
+        return;
+    GLenum state;
+    do
+    {
+        state = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+    }
+    while (state == GL_TIMEOUT_EXPIRED);
+    glDeleteSync(fence);
+    fence = nullptr;
+}
+
+void scene::DeferredRenderBenchmark::Lights::advanceRing(GLsync *fences, int &index)
+{
+    fences[index] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    index = (index + 1) % N_RING_BUFFERS;
+    waitFence(fences[index]);
+}
+
+shader::DeferredLighting::PointLight *scene::DeferredRenderBenchmark::Lights::region(int index)
+{
+    return reinterpret_cast<shader::DeferredLighting::PointLight*>(mapped_ + index*stride_);
+}
+
 void scene::DeferredRenderBenchmark::Lights::moveRadius(glm::vec3 const &r)
 {
     move_radius_.x = std::abs(r.x);
@@ -342,22 +1162,144 @@ void scene::DeferredRenderBenchmark::Lights::init(float start_x, float grid_size
     shader::Lamp::init();
     shader::Lamp::setVertices(sphere.first.data(), sphere.first.size(),
                               sphere.second.data(), sphere.second.size());
-    shader::Lamp::setInstances(reinterpret_cast<const float*>(position().data()),
+    shader::Lamp::setInstances(nullptr,
                                reinterpret_cast<const float*>(color().data()),
                                size());
+
+    // ring of light storage buffers, persistently mapped so that update() writes
+    // light positions straight into memory visible to the GPU
+    releaseRing();
+    GLint alignment;
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    stride_ = sizeof(shader::DeferredLighting::PointLight)*size();
+    stride_ = (stride_ + alignment - 1) / alignment * alignment;
+    ring_index_ = 0;
+
+    constexpr auto flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glGenBuffers(1, &ssbo);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
+    glBufferStorage(GL_SHADER_STORAGE_BUFFER, stride_*N_RING_BUFFERS, nullptr, flags);
+    mapped_ = static_cast<unsigned char*>(glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0,
+                                                           stride_*N_RING_BUFFERS, flags));
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    if (!mapped_)
+        error("Failed to map light storage buffer");
+
+    auto tot = static_cast<int>(size());
+    for (auto r = 0; r < N_RING_BUFFERS; ++r)
+    {
+        auto storage = region(r);
+#pragma omp parallel for num_threads(6)
+        for (auto i = 0; i < tot; ++i)
+            storage[i].position = position_[i];
+    }
+    refresh();
+
+    // ring of visible light indices, filled by bindVisible()
+    visible_stride_ = sizeof(unsigned int)*size();
+    visible_stride_ = (visible_stride_ + alignment - 1) / alignment * alignment;
+    visible_index_ = 0;
+    glGenBuffers(1, &visible_ssbo);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, visible_ssbo);
+    glBufferStorage(GL_SHADER_STORAGE_BUFFER, visible_stride_*N_RING_BUFFERS, nullptr, flags);
+    visible_mapped_ = static_cast<unsigned char*>(glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0,
+                                                                   visible_stride_*N_RING_BUFFERS, flags));
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    if (!visible_mapped_)
+        error("Failed to map visible light buffer");
+
+    bind();
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 4, visible_ssbo, 0, visible_stride_);
+}
+
+void scene::DeferredRenderBenchmark::Lights::refresh()
+{
+    auto tot = static_cast<int>(size());
+    radius_.resize(tot);
+    radius2_.resize(tot);
+    ambient_.resize(tot);
+    diffuse_.resize(tot);
+    specular_.resize(tot);
+    coef_.resize(tot);
+#pragma omp parallel for num_threads(6)
+    for (auto i = 0; i < tot; ++i)
+    {
+        ambient_[i]  = color_[i]*.0f;
+        diffuse_[i]  = color_[i]*1.2f;
+        specular_[i] = color_[i];
+
+        // effective lighting radius, beyond which the light is too dim to count
+        auto const &a = attenuation_[i];
+        if (a.x == 0.f && a.y == 0.f && a.z == 0.f)
+        {
+            radius_[i] = std::numeric_limits<float>::infinity();
+            coef_[i] = glm::vec3(1.f, 0.f, 0.f);
+        }
+        else
+        {
+            // distance at which 1 / (a.x + a.y*d + a.z*d^2) falls to 5/256 of the
+            // brightest channel, the positive root of the quadratic, or of the
+            // line if there is no quadratic term
+            auto c = a.x - (256.f/5.f)*std::max(std::max(diffuse_[i].x, diffuse_[i].y), diffuse_[i].z);
+            if (a.z != 0.f)
+                radius_[i] = (-a.y + std::sqrt(a.y*a.y - 4.f*a.z*c)) / (2.f*a.z);
+            else if (a.y != 0.f)
+                radius_[i] = -c / a.y;
+            else    // constant attenuation never fades
+                radius_[i] = std::numeric_limits<float>::infinity();
+            radius_[i] = std::max(0.f, radius_[i]);   // also for lights too dim to reach 5/256
+            coef_[i] = a;
+        }
+        radius2_[i] = radius_[i]*radius_[i];
+    }
+
+    // wait until no region is read any more and rewrite them all
+    for (auto &f : fences_)
+        waitFence(f);
+    for (auto r = 0; r < N_RING_BUFFERS; ++r)
+    {
+        auto storage = region(r);
+#pragma omp parallel for num_threads(6)
+        for (auto i = 0; i < tot; ++i)
+        {
+            storage[i].radius   = radius_[i];
+            storage[i].ambient  = ambient_[i];
+            storage[i].diffuse  = diffuse_[i];
+            storage[i].specular = specular_[i];
+            storage[i].coef     = coef_[i];
+            storage[i].radius2  = radius2_[i];
+        }
+    }
+}
+
+void scene::DeferredRenderBenchmark::Lights::bind()
+{
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 1, ssbo, ring_index_*stride_, stride_);
+}
+
+void scene::DeferredRenderBenchmark::Lights::bindVisible(std::vector<unsigned int> const &visible)
+{
+    advanceRing(visible_fences_, visible_index_);
+    auto offset = visible_index_*visible_stride_;
+    std::memcpy(visible_mapped_ + offset, visible.data(),
+                sizeof(unsigned int)*std::min(visible.size(), size()));
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 4, visible_ssbo, offset, visible_stride_);
 }
 
 void scene::DeferredRenderBenchmark::Lights::update(float dt)
 {
     constexpr float eps = 1e-6f;
-    glm::vec3 m;
+
+    // move on to the oldest region,
+    // which is only waited for if the GPU is still reading it
+    advanceRing(fences_, ring_index_);
+    auto storage = region(ring_index_);
+
     auto tot = static_cast<int>(size());
 #pragma omp parallel for num_threads(6)
     for (auto i = 0; i < tot; ++i)
     {
-        m.x = dt*speed_[i].x;
-        m.y = dt*speed_[i].y;
-        m.z = dt*speed_[i].z;
+        glm::vec3 m(dt*speed_[i].x, dt*speed_[i].y, dt*speed_[i].z);
 
                 auto stopped = std::abs(m[0]) < eps && std::abs(m[1]) < eps && std::abs(m[2]) < eps;
 
@@ -384,15 +1326,21 @@ void scene::DeferredRenderBenchmark::Lights::update(float dt)
                          (speed_[i].z > 0 ? moveRadius().z : -moveRadius().z);
         }
         position_[i] += m;
+        storage[i].position = position_[i];
     }
 #undef __DEST_REACHED
 }
 
 void scene::DeferredRenderBenchmark::Lights::render()
 {
-    shader::Lamp::setInstances(reinterpret_cast<const float*>(position().data()),
-                               nullptr,
-                               size());
+    // lamp positions are read from the current region of the light ring
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, ssbo);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(shader::DeferredLighting::PointLight),
+                          reinterpret_cast<void*>(ring_index_*stride_));
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
     shader::Lamp::activate(true);
     shader::Lamp::render(GL_TRIANGLES);
     shader::Lamp::activate(false);
@@ -458,7 +1406,7 @@ void scene::DeferredRenderBenchmark::TextShader::init()
 }
 
 scene::DeferredRenderBenchmark::Floor::Floor()
-    : vao(0), vbo(0), texture{0}, position_(0.f), scale_(1.f)
+    : vao(0), vbo(0), texture{0}, position_(0.f), scale_(1.f), texture_repeat_(1.f)
 {}
 
 scene::DeferredRenderBenchmark::Floor::~Floor()
@@ -475,17 +1423,8 @@ void scene::DeferredRenderBenchmark::Floor::init(float texture_repeat_x, float t
     glDeleteTextures(4, texture);
     texture[0] = 0; texture[1] = 0; texture[2] = 0; texture[3] = 0;
 
-    float vertices[] = {
-            //   vertex                  texture                      norm          tangent
-            // x    y   z                u    v                    x   y   z       x   y   z
-            0.f, 0.f, 1.f,              0.f, texture_repeat_y,   0.f, 1.f, 0.f,   1.f, 0.f, 0.f,
-            0.f, 0.f, 0.f,              0.f, 0.f,                0.f, 1.f, 0.f,   1.f, 0.f, 0.f,
-            1.f, 0.f, 0.f, texture_repeat_x, 0.f,                0.f, 1.f, 0.f,   1.f, 0.f, 0.f,
-
-            0.f, 0.f, 1.f,              0.f, texture_repeat_y,   0.f, 1.f, 0.f,   1.f, 0.f, 0.f,
-            1.f, 0.f, 0.f, texture_repeat_x, 0.f,                0.f, 1.f, 0.f,   1.f, 0.f, 0.f,
-            1.f, 0.f, 1.f, texture_repeat_x, texture_repeat_y,   0.f, 1.f, 0.f,   1.f, 0.f, 0.f,
-    };
+    texture_repeat_ = glm::vec2(texture_repeat_x, texture_repeat_y);
+    auto vertices = vertexData();
 
     glGenVertexArrays(1, &vao);
     glGenBuffers(1, &vbo);
@@ -507,7 +1446,7 @@ void scene::DeferredRenderBenchmark::Floor::init(float texture_repeat_x, float t
 
     glBindVertexArray(vao);
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(float)*vertices.size(), vertices.data(), GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);   // vertex
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(float)*11, nullptr);
     glEnableVertexAttribArray(1);   // uv
@@ -521,17 +1460,59 @@ void scene::DeferredRenderBenchmark::Floor::init(float texture_repeat_x, float t
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
+std::vector<float> scene::DeferredRenderBenchmark::Floor::vertexData() const
+{
+    auto repeat_x = texture_repeat_.x;
+    auto repeat_y = texture_repeat_.y;
+    return {
+            //   vertex                  texture                      norm          tangent
+            // x    y   z                u    v                    x   y   z       x   y   z
+            0.f, 0.f, 1.f,              0.f, repeat_y,   0.f, 1.f, 0.f,   1.f, 0.f, 0.f,
+            0.f, 0.f, 0.f,              0.f, 0.f,        0.f, 1.f, 0.f,   1.f, 0.f, 0.f,
+            1.f, 0.f, 0.f,         repeat_x, 0.f,        0.f, 1.f, 0.f,   1.f, 0.f, 0.f,
+
+            0.f, 0.f, 1.f,              0.f, repeat_y,   0.f, 1.f, 0.f,   1.f, 0.f, 0.f,
+            1.f, 0.f, 0.f,         repeat_x, 0.f,        0.f, 1.f, 0.f,   1.f, 0.f, 0.f,
+            1.f, 0.f, 1.f,         repeat_x, repeat_y,   0.f, 1.f, 0.f,   1.f, 0.f, 0.f,
+    };
+}
+
+void scene::DeferredRenderBenchmark::Floor::mesh(std::vector<shader::VisibilityResolve::Vertex> &vertices,
+                                                 std::vector<unsigned int> &indices) const
+{
+    auto data = vertexData();
+    for (std::size_t i = 0; i < data.size(); i += 11)
+    {
+        indices.push_back(static_cast<unsigned int>(i / 11));
+        vertices.push_back({glm::vec3(data[i], data[i+1], data[i+2]), data[i+3],
+                            glm::vec3(data[i+5], data[i+6], data[i+7]), data[i+4],
+                            glm::vec3(data[i+8], data[i+9], data[i+10]), 0.f});
+    }
+}
+
+void scene::DeferredRenderBenchmark::Floor::material(shader::VisibilityResolve &resolve, int index) const
+{
+    // same to the material set by render()
+    resolve.material(index, texture, glm::vec3(1.f), 32.f, 0.f, 0.5f);
+}
+
+glm::mat4 scene::DeferredRenderBenchmark::Floor::model() const
+{
+    return glm::scale(glm::translate(glm::mat4(1.f), position()), scale());
+}
+
 void scene::DeferredRenderBenchmark::Floor::render(Shader *shader)
 {
+    shader->set("object_id", 0);
     shader->set("use_tangent", 1);
+    shader->set("packed_vertex", 0);
     shader->set("material.ambient", glm::vec3(1.f));
     shader->set("material.shininess", 32.f);
     shader->set("material.parallax_scale", 0.f);
     shader->set("material.displace_scale", 0.f);
     shader->set("material.displace_mid", 0.5f);
 
-    auto model = glm::scale(glm::translate(glm::mat4(1.f), position()), scale());
-    shader->set("model", model);
+    shader->set("model", model());
 
     glBindVertexArray(vao);
     glActiveTexture(GL_TEXTURE0);
@@ -560,13 +1541,16 @@ void scene::DeferredRenderBenchmark::Floor::scale(glm::vec3 const &scal)
 }
 
 scene::DeferredRenderBenchmark::Spheres::Spheres()
-    : vao(0), vbo{0}, texture{0}
+    : vao(0), vbo{0}, speed_buffer(0), texture{0}, lod_first_index_{0}, lod_n_indices_{0}, lod_max_radius_{0},
+      lod_offset_{0}, avg_height_(0.f), radius_(0.f), bounding_radius_(0.f),
+      instances_dirty_(false), gpu_animated_(false)
 {}
 
 scene::DeferredRenderBenchmark::Spheres::~Spheres()
 {
     glDeleteVertexArrays(1, &vao);
-    glDeleteBuffers(5, vbo);
+    glDeleteBuffers(4, vbo);
+    glDeleteBuffers(1, &speed_buffer);
     glDeleteTextures(4, texture);
 }
 
@@ -576,20 +1560,23 @@ void scene::DeferredRenderBenchmark::Spheres::init(float start_x, float grid_siz
 {
     glDeleteVertexArrays(1, &vao);
     vao = 0;
-    glDeleteBuffers(5, vbo);
+    glDeleteBuffers(4, vbo);
     vbo[0] = 0;
     vbo[1] = 0;
     vbo[2] = 0;
     vbo[3] = 0;
-    vbo[4] = 0;
+    glDeleteBuffers(1, &speed_buffer);
+    speed_buffer = 0;
     glDeleteTextures(4, texture);
     texture[0] = 0;
     texture[1] = 0;
     texture[2] = 0;
     texture[3] = 0;
+    gpu_animated_ = false;
 
     glGenVertexArrays(1, &vao);
-    glGenBuffers(5, vbo);
+    glGenBuffers(4, vbo);
+    glGenBuffers(1, &speed_buffer);
     glGenTextures(4, texture);
 
     auto grid_x = static_cast<int>((end_x - start_x) / grid_size_x);
@@ -612,8 +1599,33 @@ void scene::DeferredRenderBenchmark::Spheres::init(float start_x, float grid_siz
         start_x += grid_size_x;
     }
     avg_height_ = height;
+    radius_ = radius;
     speed_.resize(position.size());
     std::memset(speed_.data(), 0, sizeof(float)*speed_.size());
+    // bound of the displacement by the material set in useMaterial()
+    constexpr auto max_displacement = .02f * .5f;
+    bounding_radius_ = radius + max_displacement;
+    x_.resize(position.size());
+    y_.resize(position.size());
+    z_.resize(position.size());
+    r_.assign(position.size(), bounding_radius_);
+    drawn_.resize(position.size());
+    for (std::size_t i = 0, n = position.size(); i < n; ++i)
+    {
+        x_[i] = position[i].x;
+        y_[i] = position[i].y;
+        z_[i] = position[i].z;
+        drawn_[i] = static_cast<unsigned int>(i);
+    }
+    // until the first cull, every sphere is drawn at the finest level
+    lod_.assign(position.size(), 0);
+    std::fill(lod_offset_ + 1, lod_offset_ + N_LODS + 1, position.size());
+    // a grid of n has 2n segments along the equator, whose distance to the
+    // silhouette r(1 - cos(pi/2n)) ~ r pi^2/8n^2 stays within half a pixel
+    // for a projected radius r up to 4n^2/pi^2
+    lod_max_radius_[0] = std::numeric_limits<float>::max();
+    for (auto l = 1; l < N_LODS; ++l)
+        lod_max_radius_[l] = 4.f * LOD_GRIDS[l] * LOD_GRIDS[l] / static_cast<float>(M_PI * M_PI);
 
     int w, h, ch;
     auto ptr = stbi_load(ASSET_PATH "/texture/fire_d.png", &w, &h, &ch, 3);
@@ -631,34 +1643,144 @@ void scene::DeferredRenderBenchmark::Spheres::init(float start_x, float grid_siz
 
     std::vector<float> vertices, uv, norm, tangent;
     std::vector<unsigned short> vertex_indices;
-    std::tie(vertices, vertex_indices, uv, norm, tangent) = generator::sphereWithNormUVTangle(48, radius);
+    lodMeshes(vertices, vertex_indices, uv, norm, tangent, lod_first_index_, lod_n_indices_);
+    auto packed = packVertices(vertices, uv, norm, tangent);
     glBindVertexArray(vao);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbo[4]);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbo[1]);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned short)*vertex_indices.size(), vertex_indices.data(), GL_STATIC_DRAW);
     glBindBuffer(GL_ARRAY_BUFFER, vbo[0]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(float)*vertices.size(), vertices.data(), GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(PackedVertex)*packed.size(), packed.data(), GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);   // vertex
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[1]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(float)*uv.size(), uv.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex),
+                          (void *)offsetof(PackedVertex, position));
     glEnableVertexAttribArray(1);   // uv
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[2]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(float)*norm.size(), norm.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(1, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex),
+                          (void *)offsetof(PackedVertex, uv));
     glEnableVertexAttribArray(2);   // norm
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[3]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(float)*tangent.size(), tangent.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(2, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex),
+                          (void *)offsetof(PackedVertex, normal));
     glEnableVertexAttribArray(3);   // tangent
-    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+    glVertexAttribPointer(3, 2, GL_BYTE, GL_TRUE, sizeof(PackedVertex),
+                          (void *)offsetof(PackedVertex, tangent));
+    glBindBuffer(GL_ARRAY_BUFFER, vbo[3]);
+    glEnableVertexAttribArray(4);   // instance position
+    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+    glVertexAttribDivisor(4, 1);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3)*position.size(), position.data(), GL_STREAM_DRAW);
 
     glBindVertexArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
-    n_indices_ = vertex_indices.size();
+    uploadInstances();
+}
+
+void scene::DeferredRenderBenchmark::Spheres::lodMeshes(std::vector<float> &vertices,
+                                                        std::vector<unsigned short> &indices,
+                                                        std::vector<float> &uv,
+                                                        std::vector<float> &norm,
+                                                        std::vector<float> &tangent,
+                                                        unsigned int *first_index,
+                                                        unsigned int *n_indices) const
+{
+    vertices.clear(); indices.clear(); uv.clear(); norm.clear(); tangent.clear();
+    for (auto l = 0; l < N_LODS; ++l)
+    {
+        std::vector<float> v, t, n, tan;
+        std::vector<unsigned short> idx;
+        std::tie(v, idx, t, n, tan) = generator::sphereWithNormUVTangle(LOD_GRIDS[l], radius_);
+        // all levels together have 6124 vertices and still fit unsigned short
+        auto base = static_cast<unsigned short>(vertices.size() / 3);
+        first_index[l] = static_cast<unsigned int>(indices.size());
+        n_indices[l] = static_cast<unsigned int>(idx.size());
+        for (auto i : idx)
+            indices.push_back(static_cast<unsigned short>(base + i));
+        vertices.insert(vertices.end(), v.begin(), v.end());
+        uv.insert(uv.end(), t.begin(), t.end());
+        norm.insert(norm.end(), n.begin(), n.end());
+        tangent.insert(tangent.end(), tan.begin(), tan.end());
+    }
+}
+
+std::vector<scene::DeferredRenderBenchmark::Spheres::PackedVertex>
+scene::DeferredRenderBenchmark::Spheres::packVertices(std::vector<float> const &vertices,
+                                                      std::vector<float> const &uv,
+                                                      std::vector<float> const &norm,
+                                                      std::vector<float> const &tangent)
+{
+    // map a unit vector onto the octahedron and unfold it into [-1, 1]^2,
+    // same to encodeNormal in deferred_lighting_pass.fs before its remapping
+    auto octahedral = [](const float *v) {
+        glm::vec3 n(v[0], v[1], v[2]);
+        auto l = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+        // tangents at the south pole are undefined
+        if (!(l > 0.f))
+            return glm::vec2(1.f, 0.f);
+        n /= l;
+        if (n.z >= 0.f)
+            return glm::vec2(n.x, n.y);
+        return glm::vec2((1.f - std::abs(n.y)) * (n.x >= 0.f ? 1.f : -1.f),
+                         (1.f - std::abs(n.x)) * (n.y >= 0.f ? 1.f : -1.f));
+    };
+    static_assert(sizeof(PackedVertex) == 16, "PackedVertex is expected to be tightly packed");
+    std::vector<PackedVertex> packed(vertices.size() / 3);
+    for (std::size_t i = 0, n = packed.size(); i < n; ++i)
+    {
+        auto &p = packed[i];
+        for (auto k = 0; k < 3; ++k)
+            p.position[k] = glm::packHalf1x16(vertices[3*i+k]);
+        auto t = octahedral(&tangent[3*i]);
+        p.tangent[0] = static_cast<signed char>(glm::packSnorm1x8(t.x));
+        p.tangent[1] = static_cast<signed char>(glm::packSnorm1x8(t.y));
+        p.uv[0] = glm::packUnorm1x16(uv[2*i]);
+        p.uv[1] = glm::packUnorm1x16(uv[2*i+1]);
+        auto e = octahedral(&norm[3*i]);
+        p.normal[0] = static_cast<short>(glm::packSnorm1x16(e.x));
+        p.normal[1] = static_cast<short>(glm::packSnorm1x16(e.y));
+    }
+    return packed;
+}
+
+void scene::DeferredRenderBenchmark::Spheres::uploadInstances()
+{
+    // orphan the buffer, such that frames in flight keep their copy
+    glBindBuffer(GL_ARRAY_BUFFER, vbo[2]);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3)*position.size(), position.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    instances_dirty_ = false;
+}
+
+void scene::DeferredRenderBenchmark::Spheres::downloadInstances()
+{
+    // waits for the GPU, only once after switching away from animate()
+    if (!gpu_animated_)
+        return;
+    glBindBuffer(GL_ARRAY_BUFFER, vbo[2]);
+    glGetBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(glm::vec3)*position.size(), position.data());
+    glBindBuffer(GL_ARRAY_BUFFER, speed_buffer);
+    glGetBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(float)*speed_.size(), speed_.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    for (std::size_t i = 0, n = position.size(); i < n; ++i)
+        y_[i] = position[i].y;
+    gpu_animated_ = false;
+    instances_dirty_ = false;
+}
+
+void scene::DeferredRenderBenchmark::Spheres::animate(shader::SphereAnimation &animation, float dt)
+{
+    if (!gpu_animated_)
+    {
+        if (instances_dirty_)
+            uploadInstances();
+        glBindBuffer(GL_ARRAY_BUFFER, speed_buffer);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(float)*speed_.size(), speed_.data(), GL_DYNAMIC_COPY);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        gpu_animated_ = true;
+    }
+    animation.animate(vbo[2], speed_buffer, static_cast<int>(position.size()), avg_height_, dt);
 }
 
 void scene::DeferredRenderBenchmark::Spheres::update(float dt)
 {
+    downloadInstances();
     constexpr float eps = 1e-4f;
     for (auto i = 0, tot = static_cast<int>(position.size()); i < tot; ++i)
     {
@@ -675,12 +1797,84 @@ void scene::DeferredRenderBenchmark::Spheres::update(float dt)
             speed_[i] = rnd()*.1f - .2f;
         }
         position[i].y += speed_[i]*dt;
+        y_[i] = position[i].y;
     }
+    // uploaded by the next GPU cull, if any
+    instances_dirty_ = true;
 }
 
-void scene::DeferredRenderBenchmark::Spheres::render(Shader *shader)
+void scene::DeferredRenderBenchmark::Spheres::cull(FrustumCuller &culler,
+                                                   glm::vec3 const &eye, float pixels_per_unit)
+{
+    downloadInstances();
+    culler.cull(x_.data(), y_.data(), z_.data(), r_.data(), static_cast<int>(position.size()));
+    auto const &visible = culler.visible();
+
+    std::size_t count[N_LODS] = {0};
+    for (auto i : visible)
+    {
+        auto r = bounding_radius_ * pixels_per_unit / std::max(glm::distance(eye, position[i]), 1e-4f);
+        // refine as soon as the bound is exceeded, coarsen only well below it
+        auto &level = lod_[i];
+        while (level > 0 && r > lod_max_radius_[level])
+            --level;
+        while (level + 1 < N_LODS && r <= LOD_HYSTERESIS * lod_max_radius_[level+1])
+            ++level;
+        ++count[level];
+    }
+    // group drawn spheres by level
+    std::size_t next[N_LODS];
+    for (auto l = 0; l < N_LODS; ++l)
+    {
+        lod_offset_[l+1] = lod_offset_[l] + count[l];
+        next[l] = lod_offset_[l];
+    }
+    drawn_.resize(visible.size());
+    drawn_position_.resize(visible.size());
+    for (auto i : visible)
+    {
+        auto k = next[lod_[i]]++;
+        drawn_[k] = i;
+        drawn_position_[k] = position[i];
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, vbo[3]);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3)*drawn_position_.size(), drawn_position_.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void scene::DeferredRenderBenchmark::Spheres::mesh(std::vector<shader::VisibilityResolve::Vertex> &vertices,
+                                                   std::vector<unsigned int> &indices) const
+{
+    std::vector<float> v, uv, norm, tangent;
+    std::vector<unsigned short> vertex_indices;
+    unsigned int first_index[N_LODS], n_indices[N_LODS];
+    lodMeshes(v, vertex_indices, uv, norm, tangent, first_index, n_indices);
+    indices.insert(indices.end(), vertex_indices.begin(), vertex_indices.end());
+    // positions rounded as in the packed vertex buffer, such that the resolve
+    // pass rebuilds exactly the triangles rasterized by the visibility pass
+    for (auto &x : v)
+        x = glm::unpackHalf1x16(glm::packHalf1x16(x));
+    for (std::size_t i = 0, n = v.size() / 3; i < n; ++i)
+        vertices.push_back({glm::vec3(v[3*i], v[3*i+1], v[3*i+2]), uv[2*i],
+                            glm::vec3(norm[3*i], norm[3*i+1], norm[3*i+2]), uv[2*i+1],
+                            glm::vec3(tangent[3*i], tangent[3*i+1], tangent[3*i+2]), 0.f});
+}
+
+void scene::DeferredRenderBenchmark::Spheres::material(shader::VisibilityResolve &resolve, int index) const
+{
+    // same to the material set by render()
+    resolve.material(index, texture, glm::vec3(1.0f, 0.45f, 0.f), 50.f, 0.02f, 0.5f);
+}
+
+glm::mat4 scene::DeferredRenderBenchmark::Spheres::model(std::size_t index) const
+{
+    return glm::translate(glm::mat4(1.f), position[index]);
+}
+
+void scene::DeferredRenderBenchmark::Spheres::useMaterial(Shader *shader)
 {
     shader->set("use_tangent", 1);
+    shader->set("packed_vertex", 1);
     shader->set("material.ambient", glm::vec3(1.0f, 0.45f, 0.f));
     shader->set("material.shininess", 50.f);
     shader->set("material.parallax_scale", 0.f);
@@ -696,15 +1890,55 @@ void scene::DeferredRenderBenchmark::Spheres::render(Shader *shader)
     glBindTexture(GL_TEXTURE_2D, texture[2]);
     glActiveTexture(GL_TEXTURE3);
     glBindTexture(GL_TEXTURE_2D, texture[3]);
+    // object 0 is the floor in the visibility buffer,
+    // positions come from the instance buffer
+    shader->set("object_id", 1);
+    shader->set("model", glm::mat4(1.f));
+}
 
-
-    for (const auto &p : position)
+void scene::DeferredRenderBenchmark::Spheres::render(Shader *shader)
+{
+    useMaterial(shader);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo[3]);
+    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    for (auto l = 0; l < N_LODS; ++l)
     {
-        auto model = glm::translate(glm::mat4(1.f), p);
-        shader->set("model", model);
-        glDrawElements(GL_TRIANGLES, n_indices_, GL_UNSIGNED_SHORT, nullptr);
+        auto n = levelSize(l);
+        if (n == 0) continue;
+        // gl_InstanceID does not include the base instance
+        shader->set("object_id", static_cast<int>(1 + lod_offset_[l]));
+        glDrawElementsInstancedBaseInstance(GL_TRIANGLES, lod_n_indices_[l], GL_UNSIGNED_SHORT,
+                                            (void *)(sizeof(unsigned short)*lod_first_index_[l]),
+                                            static_cast<GLsizei>(n), static_cast<GLuint>(lod_offset_[l]));
     }
-//    std::cout << n_indices_/3 << std::endl;
+
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void scene::DeferredRenderBenchmark::Spheres::cull(shader::SphereCulling &culling, int viewport_height)
+{
+    if (instances_dirty_)
+        uploadInstances();
+    shader::SphereCulling::DrawCommand levels[N_LODS];
+    for (auto l = 0; l < N_LODS; ++l)
+        levels[l] = shader::SphereCulling::DrawCommand{lod_n_indices_[l], 0, lod_first_index_[l], 0, 0};
+    culling.cull(vbo[2], static_cast<int>(position.size()), bounding_radius_, viewport_height,
+                 levels, lod_max_radius_, N_LODS);
+}
+
+void scene::DeferredRenderBenchmark::Spheres::renderIndirect(Shader *shader, shader::SphereCulling const &culling)
+{
+    // object ids are not preserved by the compaction,
+    // which is fine for the G-buffer and depth pre-pass
+    useMaterial(shader);
+    glBindBuffer(GL_ARRAY_BUFFER, culling.visibleBuffer());
+    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(float)*4, nullptr);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, culling.commandBuffer());
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, nullptr, culling.levelCount(), 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
 
     glBindVertexArray(0);
     glBindTexture(GL_TEXTURE_2D, 0);
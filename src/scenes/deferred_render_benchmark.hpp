@@ -7,8 +7,23 @@
 #include "shaders/text.hpp"
 #include "shaders/skybox.hpp"
 #include "shaders/deferred_lighting.hpp"
+#include "shaders/tiled_deferred_lighting.hpp"
+#include "shaders/clustered_deferred_lighting.hpp"
+#include "shaders/deferred_light_volume.hpp"
+#include "shaders/light_tree_lighting.hpp"
+#include "shaders/stochastic_lighting.hpp"
+#include "shaders/amortized_lighting.hpp"
+#include "shaders/upsampled_lighting.hpp"
+#include "shaders/image_compare.hpp"
+#include "shaders/visibility_buffer.hpp"
+#include "shaders/msaa_deferred_lighting.hpp"
+#include "shaders/sphere_culling.hpp"
+#include "shaders/sphere_animation.hpp"
 #include "shaders/forward_phong.hpp"
 #include "shaders/lamp.hpp"
+#include "util/frustum_culler.hpp"
+#include "util/sphere_bvh.hpp"
+#include "util/light_tree.hpp"
 
 namespace px { namespace scene
 {
@@ -18,12 +33,37 @@ class DeferredRenderBenchmark;
 class px::scene::DeferredRenderBenchmark : public scene::ControllableCamera
 {
 public:
-    bool deferred_rendering_flag;
+    enum class RenderMode : int
+    {
+        Deferred = 0,
+        Forward,
+        TiledDeferred,
+        ClusteredDeferred,
+        LightVolumeDeferred,
+        LightTreeDeferred,
+        StochasticDeferred,
+        AmortizedDeferred,
+        UpsampledDeferred,
+        GBufferBenchmark,
+        VisibilityBuffer,
+        MsaaDeferred
+    };
+    static const int N_RENDER_MODES;
+    // number of frames each G-buffer layout is measured in GBufferBenchmark
+    static const int GBUFFER_BENCHMARK_FRAMES;
+
+    RenderMode render_mode;
     bool show_light_sources;
     bool display_spheres;
     bool pause;
+    // render depth only before the G-buffer pass, see DeferredLightingPass
+    bool depth_prepass;
+    // cull spheres on the GPU and draw them indirectly in the geometry pass
+    bool gpu_driven;
     int show_only;
     int max_lights_deferred;
+    // cut threshold of light tree deferred rendering, 0 for exact shading
+    float light_tree_threshold;
 
     DeferredRenderBenchmark();
     ~DeferredRenderBenchmark() override;
@@ -36,12 +76,48 @@ public:
     void resetCamera();
     void deferredRender();
     void forwardRender();
+    void tiledDeferredRender();
+    void clusteredDeferredRender();
+    void lightVolumeDeferredRender();
+    void lightTreeDeferredRender();
+    void stochasticDeferredRender();
+    void amortizedDeferredRender();
+    void upsampledDeferredRender();
+    // deferred rendering with each G-buffer layout in turn, measuring
+    // the lighting pass time and the error against the reference layout
+    void gBufferBenchmarkRender();
+    void visibilityBufferRender();
+    // deferred rendering of a multisampled G-buffer, lit per sample on edges only
+    void msaaDeferredRender();
     void renderGUI();
 
 protected:
+    // fill the G-buffer of pass with the scene objects, preceded by a
+    // depth pre-pass if depth_prepass, and measure its cost
+    void geometryPass(shader::DeferredLightingPass &pass);
+    // read the geometry queries issued in the last frame and switch the set
+    void readGeometryQueries(int width, int height);
+    // draw spheres into the G-buffer or depth pre-pass,
+    // culled on the GPU if gpu_driven
+    void renderSpheres(Shader *shader);
+    // whether the spheres are animated and culled on the GPU only, which is
+    // when gpu_driven and the current mode draws them by geometryPass alone
+    bool spheresOnGPU() const;
+    // accumulate lighting of the visible lights in the ambient buffer of
+    // deferred_pass_shader, in batches of batch_size spatially coherent lights
+    // each scissored to its screen rectangle, and update batch_coverage
+    void renderLightingBatches(std::vector<unsigned int> const &visible, int batch_size);
+
     class Spheres
     {
     public:
+        // levels of detail, finest first, by the grid size of the sphere mesh
+        static const int N_LODS = 4;
+        static const unsigned int LOD_GRIDS[N_LODS];
+        // a sphere moves to a coarser level only when its projected radius
+        // is below this fraction of the bound of that level
+        static const float LOD_HYSTERESIS;
+
         Spheres();
         ~Spheres();
 
@@ -49,17 +125,99 @@ protected:
                   float start_y, float grid_size_y, float end_y,
                   float h, float radius);
         void update(float dt);
+        // same to update but on the GPU, moving the instance buffer of all
+        // spheres in place; the CPU copy is read back once it is needed again
+        void animate(shader::SphereAnimation &animation, float dt);
+        // draw the spheres kept by the latest CPU cull by one instanced call
+        // per level of detail, sphere drawn()[k] as object k+1
         void render(Shader *shader);
+        // frustum cull the spheres on the CPU and pick their levels of detail
+        // by the projected radius, given the camera position and the pixels
+        // per unit length at unit distance; call once per frame before render
+        void cull(FrustumCuller &culler, glm::vec3 const &eye, float pixels_per_unit);
+        // frustum cull all spheres on the GPU into culling,
+        // on a viewport of the given height in pixels
+        void cull(shader::SphereCulling &culling, int viewport_height);
+        // draw the spheres that survived the last cull() by an indirect draw
+        void renderIndirect(Shader *shader, shader::SphereCulling const &culling);
+        // append the meshes of all levels to the vertex and index lists of resolve,
+        // level l starts at levelFirstIndex(l) from the first appended index
+        void mesh(std::vector<shader::VisibilityResolve::Vertex> &vertices,
+                  std::vector<unsigned int> &indices) const;
+        void material(shader::VisibilityResolve &resolve, int index) const;
+        glm::mat4 model(std::size_t index) const;
         inline std::size_t size() { return position.size(); }
+        // indices of the spheres passing the latest CPU cull, ordered by level
+        inline std::vector<unsigned int> const &drawn() const noexcept { return drawn_; }
+        // level of detail of a sphere picked by the latest CPU cull
+        inline int level(std::size_t index) const { return lod_[index]; }
+        inline unsigned int levelFirstIndex(int level) const noexcept { return lod_first_index_[level]; }
+        // number of drawn spheres at a level of detail
+        inline std::size_t levelSize(int level) const noexcept { return lod_offset_[level+1] - lod_offset_[level]; }
     protected:
         unsigned int vao;
-        unsigned int vbo[5];
+        // interleaved PackedVertex and index buffer, per-instance position
+        // buffer of all spheres and of the spheres passing the CPU cull
+        unsigned int vbo[4];
+        // vertical speed of each sphere used by animate()
+        unsigned int speed_buffer;
         unsigned int texture[4];
         std::vector<glm::vec3> position;
     private:
+        // vertex as stored in the interleaved vertex buffer, 16 instead of 44
+        // bytes as four float streams, decoded by deferred_lighting_pass.vs
+        // and visibility_pass.vs if packed_vertex is set:
+        //   position  3 half floats
+        //   tangent   octahedral encoded, 2 snorm8
+        //   uv        2 unorm16
+        //   normal    octahedral encoded, 2 snorm16
+        struct PackedVertex
+        {
+            unsigned short position[3];
+            signed char tangent[2];
+            unsigned short uv[2];
+            short normal[2];
+        };
+        // quantize the float streams given by lodMeshes into packed vertices
+        static std::vector<PackedVertex> packVertices(std::vector<float> const &vertices,
+                                                      std::vector<float> const &uv,
+                                                      std::vector<float> const &norm,
+                                                      std::vector<float> const &tangent);
+        // copy position into the instance buffer of all spheres
+        void uploadInstances();
+        // copy positions and speeds moved by animate() back to the CPU
+        void downloadInstances();
+        // set material uniforms and bind textures and vao
+        void useMaterial(Shader *shader);
+        // meshes of all levels in order, indices rebased onto the joint vertex list,
+        // the index range of each level is written into first_index and n_indices
+        void lodMeshes(std::vector<float> &vertices, std::vector<unsigned short> &indices,
+                       std::vector<float> &uv, std::vector<float> &norm, std::vector<float> &tangent,
+                       unsigned int *first_index, unsigned int *n_indices) const;
         std::vector<float> speed_;
-        std::size_t n_indices_;
+        unsigned int lod_first_index_[N_LODS];
+        unsigned int lod_n_indices_[N_LODS];
+        // largest projected radius in pixels a level may take
+        float lod_max_radius_[N_LODS];
+        std::vector<int> lod_;
+        // drawn_[lod_offset_[l], lod_offset_[l+1]) are at level l
+        std::size_t lod_offset_[N_LODS+1];
         float avg_height_;
+        float radius_;
+        // radius enclosing the displaced sphere mesh
+        float bounding_radius_;
+        // structure-of-arrays mirror of position and bounding radii for culling
+        std::vector<float> x_;
+        std::vector<float> y_;
+        std::vector<float> z_;
+        std::vector<float> r_;
+        std::vector<unsigned int> drawn_;
+        std::vector<glm::vec3> drawn_position_;
+        // position changed since the last upload to the instance buffer
+        // of all spheres, which only the GPU cull reads
+        bool instances_dirty_;
+        // the instance and speed buffers are newer than position and speed_
+        bool gpu_animated_;
     } spheres;
     class Floor
     {
@@ -68,6 +226,11 @@ protected:
         ~Floor();
         void init(float texture_repeat_x, float texture_repeat_y);
         void render(Shader *shader);
+        // append the floor mesh to the vertex and index lists of resolve
+        void mesh(std::vector<shader::VisibilityResolve::Vertex> &vertices,
+                  std::vector<unsigned int> &indices) const;
+        void material(shader::VisibilityResolve &resolve, int index) const;
+        glm::mat4 model() const;
 
         void position(glm::vec3 const &pos);
         void scale(glm::vec3 const &scal);
@@ -78,33 +241,80 @@ protected:
         unsigned int vbo;
         unsigned int texture[4];
     private:
+        // interleaved vertex, texture coordinates, normal and tangent
+        std::vector<float> vertexData() const;
         glm::vec3 position_;
         glm::vec3 scale_;
+        glm::vec2 texture_repeat_;
     } floor;
     class Lights : public shader::Lamp
     {
     public:
+        // number of light storage buffers in the ring
+        static const int N_RING_BUFFERS = 3;
+
         Lights();
-        ~Lights() override = default;
+        ~Lights() override;
         void init(float start_x, float grid_size_x, float end_x,
                   float start_y, float grid_size_y, float end_y,
                   float h, float radius);
         void update(float dt);
         void render();
+        // bind the light storage buffer written by the latest update()
+        // to binding point 1
+        void bind();
+        // write the indices of visible lights into the next region of the
+        // visible light ring and bind it to binding point 4
+        void bindVisible(std::vector<unsigned int> const &visible);
         inline std::size_t size() { return position_.size(); }
         inline std::vector<glm::vec3> const &position() const noexcept { return position_; }
         inline std::vector<glm::vec3> const &color() const noexcept { return color_; }
         inline std::vector<glm::vec3> const &attenuation() const noexcept { return attenuation_; }
+        // effective lighting radius, beyond which a light is ignored
+        inline std::vector<float> const &radius() const noexcept { return radius_; }
+        inline std::vector<float> const &radius2() const noexcept { return radius2_; }
+        inline std::vector<glm::vec3> const &ambient() const noexcept { return ambient_; }
+        inline std::vector<glm::vec3> const &diffuse() const noexcept { return diffuse_; }
+        inline std::vector<glm::vec3> const &specular() const noexcept { return specular_; }
+        // attenuation coefficients as used by shaders
+        inline std::vector<glm::vec3> const &coef() const noexcept { return coef_; }
         inline glm::vec3 const &moveRadius() const noexcept { return move_radius_; }
         void moveRadius(glm::vec3 const &r);
     protected:
         std::vector<glm::vec3> position_;
         std::vector<glm::vec3> color_;
         std::vector<glm::vec3> attenuation_;
+        // data derived from color_ and attenuation_, see refresh()
+        std::vector<float> radius_;
+        std::vector<float> radius2_;
+        std::vector<glm::vec3> ambient_;
+        std::vector<glm::vec3> diffuse_;
+        std::vector<glm::vec3> specular_;
+        std::vector<glm::vec3> coef_;
         std::vector<glm::vec3> speed_;
         std::vector<glm::vec3> dest_;
         std::vector<glm::vec3> init_position_;
         glm::vec3 move_radius_;
+        unsigned int ssbo;
+        unsigned int visible_ssbo;
+        // recompute derived light data and write it into every region of the
+        // light ring, call after color_ or attenuation_ is changed
+        void refresh();
+    private:
+        void releaseRing();
+        shader::DeferredLighting::PointLight *region(int index);
+        // fence the region in use and move on to the next one,
+        // waiting until the GPU no longer reads it
+        static void advanceRing(GLsync *fences, int &index);
+        static void waitFence(GLsync &fence);
+        unsigned char *mapped_;
+        std::size_t stride_;
+        int ring_index_;
+        GLsync fences_[N_RING_BUFFERS];
+        unsigned char *visible_mapped_;
+        std::size_t visible_stride_;
+        int visible_index_;
+        GLsync visible_fences_[N_RING_BUFFERS];
     } lights;
     class Skybox : public shader::Skybox
     {
@@ -124,6 +334,68 @@ protected:
     shader::DeferredLightingPass deferred_pass_shader;
     shader::DeferredLighting deferred_lighting_shader;
     shader::ForwardPhong forward_shader;
+    shader::TiledDeferredLighting tiled_lighting_shader;
+    shader::ClusteredDeferredLighting clustered_lighting_shader;
+    shader::DeferredLightVolume light_volume_shader;
+    shader::LightTreeLighting light_tree_shader;
+    shader::StochasticLighting stochastic_lighting_shader;
+    shader::AmortizedLighting amortized_lighting_shader;
+    shader::UpsampledLighting upsampled_lighting_shader;
+    shader::DeferredLightingPass reference_pass_shader;
+    shader::DeferredLighting reference_lighting_shader;
+    shader::ImageCompare image_compare_shader;
+    shader::VisibilityPass visibility_pass_shader;
+    shader::VisibilityResolve visibility_resolve_shader;
+    // G-buffer with MSAA_SAMPLES samples per pixel, only used by MsaaDeferred
+    shader::DeferredLightingPass msaa_pass_shader;
+    shader::MsaaDeferredLighting msaa_lighting_shader;
+    shader::SphereCulling sphere_culling_shader;
+    shader::SphereAnimation sphere_animation_shader;
+    // floor followed by spheres, indexed by object ids of the visibility buffer
+    std::vector<shader::VisibilityResolve::Object> visibility_objects;
+    // first index of the sphere meshes in the index list of the resolve
+    unsigned int visibility_sphere_first_index;
+    ClusterBuilder light_clusters;
+    float cluster_build_time;
+    // hierarchy over effective lighting spheres, refit after lights move
+    SphereBVH light_bvh;
+    FrustumCuller light_culler;
+    FrustumCuller sphere_culler;
+    float sphere_cull_time;
+    float light_cull_time;
+    float batch_coverage;
+    // lights per scissored lighting batch of deferred and amortized deferred
+    // rendering, 0 for a single pass, and batches drawn in the latest frame
+    int lighting_batch_size;
+    int n_lighting_batches;
+    // visible lights of the subset shaded by amortized deferred rendering
+    std::vector<unsigned int> amortized_lights;
+    LightTree light_tree;
+    float light_tree_time;
+    // results of the G-buffer layout benchmark for each layout
+    struct GBufferStats
+    {
+        double gpu_time; // sum of lighting pass time in ms
+        double mse;      // sum of mean squared error
+        int n_frames;    // frames whose error is already in mse
+        int n_timed;     // frames whose time is already in gpu_time
+    };
+    std::vector<GBufferStats> gbuffer_stats;
+    int gbuffer_frame;
+    // lighting pass time queries, alternating like geometry_queries and
+    // the error buffers of image_compare_shader, with the layout each was
+    // issued for, -1 if none is pending
+    unsigned int gbuffer_queries[2];
+    int gbuffer_query_layout[2];
+    int gbuffer_query_index;
+    // GPU time and number of fragments written into the G-buffer by
+    // geometryPass(), whose queries alternate between two sets such that
+    // the results of the last frame are read without stalling
+    unsigned int geometry_queries[2][2];
+    int geometry_query_index;
+    int geometry_query_count;
+    float geometry_pass_time;
+    float geometry_fragments; // per screen pixel
 };
 
 #endif // PX_CG_SCENES_DEFERRED_RENDER_HPP
@@ -0,0 +1,130 @@
+#include "amortized_lighting.hpp"
+
+using namespace px;
+
+const char *shader::AmortizedLighting::COMPUTE_SHADER =
+#include "shaders/glsl/amortized_lighting.cs"
+;
+const int shader::AmortizedLighting::GROUP_SIZE = 16;
+const int shader::AmortizedLighting::N_SUBSETS = 4;
+
+shader::AmortizedLighting::AmortizedLighting()
+    : Shader(), fbo(0), output_buffer(0), ambient_cache(0), history{0}, history_positions{0},
+      buffer_width_(0), buffer_height_(0), subset_(0), history_index_(0), has_history_(false)
+{}
+
+shader::AmortizedLighting::~AmortizedLighting()
+{
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteTextures(1, &output_buffer);
+    glDeleteTextures(1, &ambient_cache);
+    glDeleteTextures(2, history);
+    glDeleteTextures(2, history_positions);
+}
+
+void shader::AmortizedLighting::init()
+{
+    glDeleteFramebuffers(1, &fbo); fbo = 0;
+    glDeleteTextures(1, &output_buffer); output_buffer = 0;
+    glDeleteTextures(1, &ambient_cache); ambient_cache = 0;
+    glDeleteTextures(2, history); history[0] = 0; history[1] = 0;
+    glDeleteTextures(2, history_positions); history_positions[0] = 0; history_positions[1] = 0;
+
+    Shader::init(DeferredLightingPass::withGBufferDecode(COMPUTE_SHADER,
+            "\n#define GROUP_SIZE " + std::to_string(GROUP_SIZE) +
+            "\n#define N_SUBSETS " + std::to_string(N_SUBSETS)).c_str());
+
+    glGenFramebuffers(1, &fbo);
+    glGenTextures(1, &output_buffer);
+    glGenTextures(1, &ambient_cache);
+    glGenTextures(2, history);
+    glGenTextures(2, history_positions);
+
+    Shader::activate(true);
+    set("ambient_buffer", 0);
+    set("diffuse_buffer", 1);
+    set("specular_buffer", 2);
+    set("depth_buffer", 3);
+    set("normal_buffer", 4);
+    set("ambient_cache", 5);
+    set("show_only", -1);
+    Shader::activate(false);
+
+    if (buffer_width_ != 0 && buffer_height_ != 0)
+        setBufferSize(buffer_width_, buffer_height_);
+}
+
+void shader::AmortizedLighting::cacheAmbient(DeferredLightingPass &pass_shader)
+{
+    glCopyImageSubData(pass_shader.buffers[0], GL_TEXTURE_2D, 0, 0, 0, 0,
+                       ambient_cache, GL_TEXTURE_2D, 0, 0, 0, 0,
+                       buffer_width_, buffer_height_, 1);
+}
+
+void shader::AmortizedLighting::render(glm::mat4 const &view_projection,
+                                       DeferredLightingPass &pass_shader)
+{
+    pass_shader.activateBuffers();
+    glActiveTexture(GL_TEXTURE5);
+    glBindTexture(GL_TEXTURE_2D, ambient_cache);
+    glBindImageTexture(0, output_buffer, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+    glBindImageTexture(1, history[history_index_], 0, GL_TRUE, 0, GL_READ_ONLY, GL_RGBA16F);
+    glBindImageTexture(2, history[1-history_index_], 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+    glBindImageTexture(3, history_positions[history_index_], 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+    glBindImageTexture(4, history_positions[1-history_index_], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+    set("subset", subset_);
+    set("reuse", has_history_ ? 1 : 0);
+    set("prev_view_projection", prev_view_projection_);
+    glDispatchCompute((buffer_width_ + GROUP_SIZE - 1) / GROUP_SIZE,
+                      (buffer_height_ + GROUP_SIZE - 1) / GROUP_SIZE, 1);
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT);
+
+    prev_view_projection_ = view_projection;
+    has_history_ = true;
+    history_index_ = 1 - history_index_;
+    subset_ = (subset_ + 1) % N_SUBSETS;
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0, 0, buffer_width_, buffer_height_,
+                      0, 0, buffer_width_, buffer_height_,
+                      GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+}
+
+void shader::AmortizedLighting::setBufferSize(int width, int height)
+{
+    buffer_width_ = width;
+    buffer_height_ = height;
+    has_history_ = false;
+
+    if (fbo == 0)
+        return;
+
+#define __TEXTURE_CONFIG_HELPER(target, tex, format, depth)                         \
+    glBindTexture(target, tex);                                                     \
+    if (target == GL_TEXTURE_2D_ARRAY)                                              \
+        glTexImage3D(target, 0, format, width, height, depth, 0, GL_RGBA, GL_FLOAT, nullptr); \
+    else                                                                            \
+        glTexImage2D(target, 0, format, width, height, 0, GL_RGBA, GL_FLOAT, nullptr); \
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_NEAREST);                     \
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    __TEXTURE_CONFIG_HELPER(GL_TEXTURE_2D, output_buffer, GL_RGBA16F, 1)
+    // same format as the ambient buffer of DeferredLightingPass for copying
+    __TEXTURE_CONFIG_HELPER(GL_TEXTURE_2D, ambient_cache, GL_RGBA16F, 1)
+    __TEXTURE_CONFIG_HELPER(GL_TEXTURE_2D_ARRAY, history[0], GL_RGBA16F, N_SUBSETS)
+    __TEXTURE_CONFIG_HELPER(GL_TEXTURE_2D_ARRAY, history[1], GL_RGBA16F, N_SUBSETS)
+    __TEXTURE_CONFIG_HELPER(GL_TEXTURE_2D, history_positions[0], GL_RGBA32F, 1)
+    __TEXTURE_CONFIG_HELPER(GL_TEXTURE_2D, history_positions[1], GL_RGBA32F, 1)
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+#undef __TEXTURE_CONFIG_HELPER
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, output_buffer, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        error("Failed to generate frame buffer for shader::AmortizedLighting");
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
@@ -0,0 +1,62 @@
+#ifndef PX_CG_SHADERS_AMORTIZED_LIGHTING_HPP
+#define PX_CG_SHADERS_AMORTIZED_LIGHTING_HPP
+
+#include "shader.hpp"
+#include "deferred_lighting.hpp"
+
+namespace px { namespace shader
+{
+class AmortizedLighting;
+}}
+
+// Temporal amortization of deferred lighting.
+// Lights are split into N_SUBSETS interleaved subsets, and only one subset is
+// shaded per frame, by DeferredLighting::renderCache. The lighting of every
+// subset is kept in a history buffer, which is reprojected into the current
+// frame and merged with the fresh subset to give the final result.
+// Lighting of moving lights lags behind by up to N_SUBSETS-1 frames.
+class px::shader::AmortizedLighting : public Shader
+{
+public:
+    static const char *COMPUTE_SHADER;
+
+    static const int GROUP_SIZE;
+    static const int N_SUBSETS;
+
+public:
+    AmortizedLighting();
+    ~AmortizedLighting() override;
+
+    void init();
+    // keep the ambient color of the G-buffer in pass_shader,
+    // call before lighting is accumulated onto it
+    void cacheAmbient(DeferredLightingPass &pass_shader);
+    // merge the lighting of the current subset, accumulated in the ambient
+    // buffer of pass_shader, with history, put the result on the screen and
+    // move on to the next subset,
+    // view_projection is the current one used to reproject the next frame
+    void render(glm::mat4 const &view_projection, DeferredLightingPass &pass_shader);
+
+    // set framebuffer size, call after init before use
+    void setBufferSize(int width, int height);
+
+    // index of the light subset to be shaded in the current frame,
+    // light i belongs to subset i % N_SUBSETS
+    inline int subset() const noexcept { return subset_; }
+
+protected:
+    unsigned int fbo;
+    unsigned int output_buffer;
+    unsigned int ambient_cache;
+    unsigned int history[2];
+    unsigned int history_positions[2];
+private:
+    int buffer_width_;
+    int buffer_height_;
+    int subset_;
+    int history_index_;
+    bool has_history_;
+    glm::mat4 prev_view_projection_;
+};
+
+#endif // PX_CG_SHADERS_AMORTIZED_LIGHTING_HPP
@@ -0,0 +1,113 @@
+#include "clustered_deferred_lighting.hpp"
+
+using namespace px;
+
+const char *shader::ClusteredDeferredLighting::VERTEX_SHADER =
+#include "shaders/glsl/deferred_lighting.vs"
+;
+const char *shader::ClusteredDeferredLighting::FRAGMENT_SHADER =
+#include "shaders/glsl/clustered_deferred_lighting.fs"
+;
+
+shader::ClusteredDeferredLighting::ClusteredDeferredLighting()
+    : Shader(), vao(0), vbo(0), ssbo{0},
+      offset_buffer_size_(0), index_buffer_size_(0)
+{}
+
+shader::ClusteredDeferredLighting::~ClusteredDeferredLighting()
+{
+    glDeleteVertexArrays(1, &vao);
+    glDeleteBuffers(1, &vbo);
+    glDeleteBuffers(2, ssbo);
+}
+
+void shader::ClusteredDeferredLighting::init()
+{
+    constexpr static float screen_vertices[] =
+            {   //  x       y     u    v
+                    -1.f,  1.f, 0.f, 1.f,
+                     1.f,  1.f, 1.f, 1.f,
+                    -1.f, -1.f, 0.f, 0.f,
+                     1.f, -1.f, 1.f, 0.f
+            };
+
+    glDeleteVertexArrays(1, &vao); vao = 0;
+    glDeleteBuffers(1, &vbo); vbo = 0;
+    glDeleteBuffers(2, ssbo); ssbo[0] = 0; ssbo[1] = 0;
+    offset_buffer_size_ = 0; index_buffer_size_ = 0;
+
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &vbo);
+    glGenBuffers(2, ssbo);
+
+    Shader::init(VERTEX_SHADER, DeferredLightingPass::withGBufferDecode(FRAGMENT_SHADER).c_str());
+
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(float)*4, nullptr);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(float)*4, (void *)(sizeof(float)*2));
+    glBufferData(GL_ARRAY_BUFFER, sizeof(screen_vertices), screen_vertices, GL_STATIC_DRAW);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    Shader::activate(true);
+    set("ambient_buffer", 0);
+    set("diffuse_buffer", 1);
+    set("specular_buffer", 2);
+    set("depth_buffer", 3);
+    set("normal_buffer", 4);
+    set("show_only", -1);
+    glBindFragDataLocation(programID(), 0, "color");
+    Shader::activate(false);
+}
+
+void shader::ClusteredDeferredLighting::activate(bool enable)
+{
+    if (enable)
+    {
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    }
+    Shader::activate(enable);
+}
+
+void shader::ClusteredDeferredLighting::setClusters(ClusterBuilder const &clusters)
+{
+#define __SSBO_UPLOAD_HELPER(i, binding, data, capacity)                                    \
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo[i]);                                        \
+    if (data.size() > capacity)                                                             \
+    {                                                                                       \
+        capacity = data.size() + data.size() / 2;                                           \
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(unsigned int)*capacity, nullptr,      \
+                     GL_STREAM_DRAW);                                                       \
+    }                                                                                       \
+    if (!data.empty())                                                                      \
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(unsigned int)*data.size(),      \
+                        data.data());                                                       \
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, ssbo[i]);
+
+    __SSBO_UPLOAD_HELPER(0, 2, clusters.offsets(), offset_buffer_size_)
+    __SSBO_UPLOAD_HELPER(1, 3, clusters.indices(), index_buffer_size_)
+    if (index_buffer_size_ == 0)
+    {   // keep a valid buffer bound even if no light is assigned
+        index_buffer_size_ = 1;
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(unsigned int), nullptr, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+#undef __SSBO_UPLOAD_HELPER
+
+    glUniform3i(glGetUniformLocation(programID(), "cluster_grid"),
+                clusters.gridX(), clusters.gridY(), clusters.gridZ());
+    set("cluster_near", clusters.nearDepth());
+    set("cluster_far", clusters.farDepth());
+}
+
+void shader::ClusteredDeferredLighting::render(DeferredLightingPass &pass_shader)
+{
+    glBindVertexArray(vao);
+    pass_shader.activateBuffers();
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    glBindVertexArray(0);
+}
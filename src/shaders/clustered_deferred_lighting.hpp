@@ -0,0 +1,44 @@
+#ifndef PX_CG_SHADERS_CLUSTERED_DEFERRED_LIGHTING_HPP
+#define PX_CG_SHADERS_CLUSTERED_DEFERRED_LIGHTING_HPP
+
+#include "shader.hpp"
+#include "deferred_lighting.hpp"
+#include "util/cluster_builder.hpp"
+
+namespace px { namespace shader
+{
+class ClusteredDeferredLighting;
+}}
+
+// Clustered deferred shading.
+// Per-cluster light lists built by ClusterBuilder are uploaded into the
+// shader storage buffers bound at binding point 2 (offsets) and 3 (indices),
+// and each pixel walks only the list of the cluster it falls in.
+// Lights are read from the shader storage buffer bound at binding point 1.
+class px::shader::ClusteredDeferredLighting : public Shader
+{
+public:
+    static const char *VERTEX_SHADER;
+    static const char *FRAGMENT_SHADER;
+
+public:
+    ClusteredDeferredLighting();
+    ~ClusteredDeferredLighting() override;
+
+    void init();
+    // upload cluster light lists, call before render
+    void setClusters(ClusterBuilder const &clusters);
+    // shade the G-buffer in pass_shader onto the screen
+    void render(DeferredLightingPass &pass_shader);
+
+    void activate(bool enable) override;
+protected:
+    unsigned int vao;
+    unsigned int vbo;
+    unsigned int ssbo[2];
+private:
+    std::size_t offset_buffer_size_;
+    std::size_t index_buffer_size_;
+};
+
+#endif // PX_CG_SHADERS_CLUSTERED_DEFERRED_LIGHTING_HPP
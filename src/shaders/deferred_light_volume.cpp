@@ -0,0 +1,90 @@
+#include "deferred_light_volume.hpp"
+
+using namespace px;
+
+const char *shader::DeferredLightVolume::VERTEX_SHADER =
+#include "shaders/glsl/deferred_light_volume.vs"
+;
+const char *shader::DeferredLightVolume::FRAGMENT_SHADER =
+#include "shaders/glsl/deferred_light_volume.fs"
+;
+
+shader::DeferredLightVolume::DeferredLightVolume()
+    : Shader(), vao(0), vbo{0}, n_indices_(0)
+{}
+
+shader::DeferredLightVolume::~DeferredLightVolume()
+{
+    glDeleteVertexArrays(1, &vao);
+    glDeleteBuffers(2, vbo);
+}
+
+void shader::DeferredLightVolume::init()
+{
+    glDeleteVertexArrays(1, &vao); vao = 0;
+    glDeleteBuffers(2, vbo); vbo[0] = 0; vbo[1] = 0;
+    n_indices_ = 0;
+
+    Shader::init(VERTEX_SHADER, DeferredLightingPass::withGBufferDecode(FRAGMENT_SHADER).c_str());
+
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(2, vbo);
+
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbo[1]);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo[0]);
+    glEnableVertexAttribArray(0); // vertex
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(float)*3, nullptr);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    Shader::activate(true);
+    set("diffuse_buffer", 1);
+    set("specular_buffer", 2);
+    set("depth_buffer", 3);
+    set("normal_buffer", 4);
+    set("show_only", -1);
+    glBindFragDataLocation(programID(), 0, "color");
+    Shader::activate(false);
+}
+
+void shader::DeferredLightVolume::setVertices(const float *data, unsigned int n_vertices,
+                                              const unsigned short *indices, unsigned int n_indices)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, vbo[0]);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(float)*3*n_vertices, data, GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbo[1]);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned short)*n_indices, indices, GL_STATIC_DRAW);
+    glBindVertexArray(0);
+    n_indices_ = n_indices;
+}
+
+void shader::DeferredLightVolume::render(int n_lights, DeferredLightingPass &pass_shader)
+{
+    if (n_lights < 1) return;
+
+    glEnable(GL_STENCIL_TEST);
+    glStencilFunc(GL_EQUAL, 1, 0xFF);
+    glStencilMask(0x00);
+    glEnable(GL_CULL_FACE);
+    glCullFace(GL_FRONT);
+    glDepthFunc(GL_GEQUAL);
+    glDepthMask(GL_FALSE);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+
+    glBindVertexArray(vao);
+    pass_shader.activateBuffers();
+    glDrawElementsInstanced(GL_TRIANGLES, n_indices_, GL_UNSIGNED_SHORT, nullptr, n_lights);
+    glBindVertexArray(0);
+
+    glDisable(GL_BLEND);
+    glDepthMask(GL_TRUE);
+    glDepthFunc(GL_LESS);
+    glCullFace(GL_BACK);
+    glDisable(GL_CULL_FACE);
+    glStencilMask(0xFF);
+    glDisable(GL_STENCIL_TEST);
+}
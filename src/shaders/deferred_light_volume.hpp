@@ -0,0 +1,46 @@
+#ifndef PX_CG_SHADERS_DEFERRED_LIGHT_VOLUME_HPP
+#define PX_CG_SHADERS_DEFERRED_LIGHT_VOLUME_HPP
+
+#include "shader.hpp"
+#include "deferred_lighting.hpp"
+
+namespace px { namespace shader
+{
+class DeferredLightVolume;
+}}
+
+// Deferred lighting by light volumes.
+// Each light is drawn as one instance of a sphere mesh scaled to its effective
+// radius, and only the pixels covered by the volume are shaded and added onto
+// the screen. Only back faces are rasterized, with a GL_GEQUAL depth test
+// against the G-buffer depth, so that the volume works also when the camera
+// is inside it; the stencil written by DeferredLightingPass masks out pixels
+// without geometry. Pixels in front of the volume are rejected per fragment.
+// Lights are read from the shader storage buffer bound at binding point 1 and
+// must have nonzero attenuation coefficients.
+class px::shader::DeferredLightVolume : public Shader
+{
+public:
+    static const char *VERTEX_SHADER;
+    static const char *FRAGMENT_SHADER;
+
+public:
+    DeferredLightVolume();
+    ~DeferredLightVolume() override;
+
+    void init();
+    // vertices of the volume mesh, which should enclose the unit sphere
+    void setVertices(const float *data, unsigned int n_vertices,
+                     const unsigned short *indices, unsigned int n_indices);
+    // add the lighting of the first n_lights lights onto the current framebuffer,
+    // whose depth and stencil buffer should come from pass_shader
+    void render(int n_lights, DeferredLightingPass &pass_shader);
+
+protected:
+    unsigned int vao;
+    unsigned int vbo[2];
+private:
+    unsigned int n_indices_;
+};
+
+#endif // PX_CG_SHADERS_DEFERRED_LIGHT_VOLUME_HPP
@@ -1,4 +1,5 @@
 #include <iostream>
+#include <algorithm>
 #include "deferred_lighting.hpp"
 #include "config.h"
 
@@ -10,6 +11,18 @@ const char *shader::DeferredLightingPass::VERTEX_SHADER =
 const char *shader::DeferredLightingPass::FRAGMENT_SHADER=
 #include "shaders/glsl/deferred_lighting_pass.fs"
 ;
+const char *shader::DeferredLightingPass::PREPASS_FRAGMENT_SHADER =
+#include "shaders/glsl/deferred_depth_prepass.fs"
+;
+const char *shader::DeferredLightingPass::DEPTH_COPY_VERTEX_SHADER =
+#include "shaders/glsl/deferred_depth_copy.vs"
+;
+const char *shader::DeferredLightingPass::DEPTH_COPY_FRAGMENT_SHADER =
+#include "shaders/glsl/deferred_depth_copy.fs"
+;
+const char *shader::DeferredLightingPass::GBUFFER_DECODE =
+#include "shaders/glsl/gbuffer_decode.glsl"
+;
 const char *shader::DeferredLighting::VERTEX_SHADER =
 #include "shaders/glsl/deferred_lighting.vs"
 ;
@@ -21,24 +34,85 @@ const char *shader::DeferredLighting::FRAGMENT_SHADER =
 #endif
 const int shader::DeferredLighting::MAX_LIGHTS_PER_BATCH = LIGHTING_BATCH_SIZE;
 
+// the ambient buffer is the HDR target lighting accumulates into, kept in
+// half floats, as an 11/11/10-bit float buffer loses additive batches and the
+// difference against the ambient cache of AmortizedLighting
+const shader::DeferredLightingPass::Layout shader::DeferredLightingPass::LAYOUTS[] =
+        {   // name, ambient, diffuse, specular, normal, position, depth, octahedral normal
+                {"Compact", GL_RGBA16F, GL_RGBA8, GL_RGBA8,
+                        GL_RG16, 0, GL_DEPTH24_STENCIL8, true},
+                {"RGB16F Reference", GL_RGB16F, GL_RGB16F, GL_RGBA16F,
+                        GL_RGB16F, GL_RGB16F, GL_DEPTH24_STENCIL8, false},
+                {"Compact, 8-bit Normal", GL_RGBA16F, GL_RGBA8, GL_RGBA8,
+                        GL_RG8, 0, GL_DEPTH24_STENCIL8, true},
+                {"Compact, Float Depth", GL_RGBA16F, GL_RGBA8, GL_RGBA8,
+                        GL_RG16, 0, GL_DEPTH32F_STENCIL8, true},
+                {"Compact, Stored Position", GL_RGBA16F, GL_RGBA8, GL_RGBA8,
+                        GL_RG16, GL_RGBA32F, GL_DEPTH24_STENCIL8, true},
+                {"Half Float, Octahedral Normal", GL_RGB16F, GL_RGBA16F, GL_RGBA16F,
+                        GL_RG16F, 0, GL_DEPTH24_STENCIL8, true}
+        };
+const int shader::DeferredLightingPass::N_LAYOUTS =
+        static_cast<int>(sizeof(LAYOUTS) / sizeof(LAYOUTS[0]));
+const int shader::DeferredLightingPass::DEFAULT_LAYOUT = 0;
+const int shader::DeferredLightingPass::REFERENCE_LAYOUT = 1;
+
+std::size_t shader::DeferredLightingPass::bytesPerPixel(Layout const &layout)
+{
+    auto size = [](GLenum format) -> std::size_t
+    {
+        switch (format)
+        {
+            case GL_RG8:
+                return 2;
+            case GL_RGB16F:
+                return 6;
+            case GL_RGBA16F:
+            case GL_DEPTH32F_STENCIL8:
+                return 8;
+            case GL_RGBA32F:
+                return 16;
+            case GL_RGBA8:
+            case GL_RG16:
+            case GL_RG16F:
+            case GL_DEPTH24_STENCIL8:
+                return 4;
+            default:
+                return 0;
+        }
+    };
+    return size(layout.ambient) + size(layout.diffuse) + size(layout.specular) +
+           size(layout.normal) + size(layout.position) + size(layout.depth);
+}
+
+std::string shader::DeferredLightingPass::withGBufferDecode(const char *source, std::string const &defines)
+{
+    std::string tmp(source);
+    tmp.insert(tmp.find_first_of("c")+4, defines + GBUFFER_DECODE);
+    return tmp;
+}
+
 shader::DeferredLightingPass::DeferredLightingPass()
-    : Shader(), fbo(0), rbo(0), buffers{0}
+    : Shader(), fbo(0), depth_buffer(0), buffers{0},
+      buffer_width_(0), buffer_height_(0), layout_(DEFAULT_LAYOUT), samples_(1), depth_copy_vao_(0), depth_ready_(false)
 {}
 
 shader::DeferredLightingPass::~DeferredLightingPass()
 {
     glDeleteFramebuffers(1, &fbo);
-    glDeleteRenderbuffers(1, &rbo);
+    glDeleteTextures(1, &depth_buffer);
     glDeleteTextures(5, buffers);
+    glDeleteVertexArrays(1, &depth_copy_vao_);
 }
 
 void shader::DeferredLightingPass::init()
 {
     glDeleteFramebuffers(1, &fbo); fbo = 0;
-    glDeleteRenderbuffers(1, &rbo); rbo = 0;
+    glDeleteTextures(1, &depth_buffer); depth_buffer = 0;
     glDeleteTextures(5, buffers);
     buffers[0] = 0; buffers[1] = 0; buffers[2] = 0;
     buffers[3] = 0; buffers[4] = 0;
+    glDeleteVertexArrays(1, &depth_copy_vao_); depth_copy_vao_ = 0;
 
     Shader::init(VERTEX_SHADER, FRAGMENT_SHADER);
     Shader::activate(true);
@@ -48,8 +122,19 @@ void shader::DeferredLightingPass::init()
     set("material.displace", 3);
     Shader::activate(false);
 
+    prepass_.init(VERTEX_SHADER, PREPASS_FRAGMENT_SHADER);
+    prepass_.activate(true);
+    prepass_.set("material.displace", 3);
+    prepass_.activate(false);
+
+    depth_copy_.init(DEPTH_COPY_VERTEX_SHADER, DEPTH_COPY_FRAGMENT_SHADER);
+    depth_copy_.activate(true);
+    depth_copy_.set("depth_buffer", 0);
+    depth_copy_.activate(false);
+    glGenVertexArrays(1, &depth_copy_vao_);
+
     glGenFramebuffers(1, &fbo);
-    glGenRenderbuffers(1, &rbo);
+    glGenTextures(1, &depth_buffer);
     glGenTextures(5, buffers);
 
     if (buffer_width_ != 0 && buffer_height_ != 0)
@@ -64,21 +149,44 @@ void shader::DeferredLightingPass::setBufferSize(int width, int height)
     if (fbo == 0)
         return;
 
-#define __TEXTURE_CONFIG_HELPER(i, RGB_or_RGBA)                         \
-    glBindTexture(GL_TEXTURE_2D, buffers[i]);                           \
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_##RGB_or_RGBA##16F,               \
-                 width, height, 0, GL_RGB, GL_FLOAT, 0);                \
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);  \
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    auto const &layout = LAYOUTS[layout_];
+
+#define __TEXTURE_CONFIG_HELPER(tex, internal_format, format, type)             \
+    if (samples_ > 1)                                                           \
+    {                                                                           \
+        glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, tex);                          \
+        glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, samples_,            \
+                                internal_format, width, height, GL_TRUE);       \
+    }                                                                           \
+    else                                                                        \
+    {                                                                           \
+        glBindTexture(GL_TEXTURE_2D, tex);                                      \
+        glTexImage2D(GL_TEXTURE_2D, 0, internal_format,                         \
+                     width, height, 0, format, type, 0);                        \
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);      \
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);      \
+    }
 
 #define __FRAMEBUFFER_TEXTURE_BIND_HELPER(i)    \
     glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0+(i), buffers[i], 0)
 
-    __TEXTURE_CONFIG_HELPER(0, RGB);  // ambient_buffer
-    __TEXTURE_CONFIG_HELPER(1, RGB);  // diffuse_buffer
-    __TEXTURE_CONFIG_HELPER(2, RGBA); // specular_buffer
-    __TEXTURE_CONFIG_HELPER(3, RGB);  // position_buffer
-    __TEXTURE_CONFIG_HELPER(4, RGB);  // normal_buffer
+    __TEXTURE_CONFIG_HELPER(buffers[0], layout.ambient, GL_RGBA, GL_FLOAT);   // ambient_buffer
+    __TEXTURE_CONFIG_HELPER(buffers[1], layout.diffuse, GL_RGBA, GL_FLOAT);   // diffuse_buffer
+    __TEXTURE_CONFIG_HELPER(buffers[2], layout.specular, GL_RGBA, GL_FLOAT);  // specular_buffer
+    __TEXTURE_CONFIG_HELPER(buffers[3], layout.normal, GL_RGBA, GL_FLOAT);    // normal_buffer
+    if (layout.position != 0)
+    {
+        __TEXTURE_CONFIG_HELPER(buffers[4], layout.position, GL_RGBA, GL_FLOAT); // position_buffer
+    }
+    if (layout.depth == GL_DEPTH32F_STENCIL8)
+    {
+        __TEXTURE_CONFIG_HELPER(depth_buffer, layout.depth, GL_DEPTH_STENCIL, GL_FLOAT_32_UNSIGNED_INT_24_8_REV);
+    }
+    else
+    {
+        __TEXTURE_CONFIG_HELPER(depth_buffer, layout.depth, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8);
+    }
+    glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0);
     glBindTexture(GL_TEXTURE_2D, 0);
 
     glBindFramebuffer(GL_FRAMEBUFFER, fbo);
@@ -86,17 +194,18 @@ void shader::DeferredLightingPass::setBufferSize(int width, int height)
     __FRAMEBUFFER_TEXTURE_BIND_HELPER(1);
     __FRAMEBUFFER_TEXTURE_BIND_HELPER(2);
     __FRAMEBUFFER_TEXTURE_BIND_HELPER(3);
-    __FRAMEBUFFER_TEXTURE_BIND_HELPER(4);
+    if (layout.position != 0)
+        __FRAMEBUFFER_TEXTURE_BIND_HELPER(4);
+    else
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT4, 0, 0);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, depth_buffer, 0);
 
-    glBindRenderbuffer(GL_RENDERBUFFER, rbo);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, width, height);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rbo);
     static constexpr GLenum attach[] =
             {
                     GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2,
                     GL_COLOR_ATTACHMENT3, GL_COLOR_ATTACHMENT4
             };
-    glDrawBuffers(5, attach);
+    glDrawBuffers(layout.position != 0 ? 5 : 4, attach);
     if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
         error("Failed to generate frame buffer for shader::DeferredLightingPass");
 
@@ -105,47 +214,150 @@ void shader::DeferredLightingPass::setBufferSize(int width, int height)
 #undef __FRAMEBUFFER_TEXTURE_BIND_HELPER
 }
 
+void shader::DeferredLightingPass::samples(int n)
+{
+    n = std::max(1, n);
+    if (n == samples_)
+        return;
+    samples_ = n;
+    if (fbo == 0)
+        return;
+    // a texture cannot change between single- and multi-sampled targets
+    glDeleteTextures(1, &depth_buffer);
+    glDeleteTextures(5, buffers);
+    glGenTextures(1, &depth_buffer);
+    glGenTextures(5, buffers);
+    if (buffer_width_ != 0 && buffer_height_ != 0)
+        setBufferSize(buffer_width_, buffer_height_);
+}
+
+void shader::DeferredLightingPass::layout(int index)
+{
+    if (index < 0 || index >= N_LAYOUTS)
+        error("Invalid G-buffer layout " + std::to_string(index));
+    if (index == layout_)
+        return;
+    layout_ = index;
+    if (buffer_width_ != 0 && buffer_height_ != 0)
+        setBufferSize(buffer_width_, buffer_height_);
+}
+
 void shader::DeferredLightingPass::activate(bool enable)
 {
     if (enable)
     {
         glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        if (depth_ready_)
+        {
+            // depth and stencil are already filled by the pre-pass,
+            // only the nearest fragment of each pixel passes
+            glClear(GL_COLOR_BUFFER_BIT);
+            glDepthFunc(GL_EQUAL);
+            glDepthMask(GL_FALSE);
+        }
+        else
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+        // mark pixels covered by geometry in the stencil buffer
+        glEnable(GL_STENCIL_TEST);
+        glStencilFunc(GL_ALWAYS, 1, 0xFF);
+        glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
     }
     else
     {
+        if (depth_ready_)
+        {
+            glDepthMask(GL_TRUE);
+            glDepthFunc(GL_LESS);
+            depth_ready_ = false;
+        }
+        glDisable(GL_STENCIL_TEST);
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
     }
     Shader::activate(enable);
+    if (enable)
+        set("octahedral_normal", LAYOUTS[layout_].octahedral_normal ? 1 : 0);
+}
+
+void shader::DeferredLightingPass::activatePrepass(bool enable)
+{
+    if (enable)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glClear(GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glEnable(GL_STENCIL_TEST);
+        glStencilFunc(GL_ALWAYS, 1, 0xFF);
+        glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+    }
+    else
+    {
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glDisable(GL_STENCIL_TEST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        depth_ready_ = true;
+    }
+    prepass_.activate(enable);
 }
 
 void shader::DeferredLightingPass::activateBuffers()
 {
+    auto target = samples_ > 1 ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D;
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, buffers[0]);
+    glBindTexture(target, buffers[0]);
     glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, buffers[1]);
+    glBindTexture(target, buffers[1]);
     glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, buffers[2]);
+    glBindTexture(target, buffers[2]);
     glActiveTexture(GL_TEXTURE3);
-    glBindTexture(GL_TEXTURE_2D, buffers[3]);
+    glBindTexture(target, depth_buffer);
     glActiveTexture(GL_TEXTURE4);
-    glBindTexture(GL_TEXTURE_2D, buffers[4]);
+    glBindTexture(target, buffers[3]);
+    if (LAYOUTS[layout_].position != 0)
+    {
+        glActiveTexture(GL_TEXTURE5);
+        glBindTexture(target, buffers[4]);
+    }
 }
 
 void shader::DeferredLightingPass::extractDepthBuffer()
 {
+    if (LAYOUTS[layout_].depth != GL_DEPTH24_STENCIL8)
+    {
+        // depth_copy_ reads depth_buffer by a sampler2D
+        if (samples_ > 1)
+            error("Failed to copy multisampled depth of format other than D24S8 for shader::DeferredLightingPass");
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glClear(GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glDepthFunc(GL_ALWAYS);
+        glEnable(GL_STENCIL_TEST);
+        glStencilFunc(GL_ALWAYS, 1, 0xFF);
+        glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+        depth_copy_.activate(true);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, depth_buffer);
+        glBindVertexArray(depth_copy_vao_);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindVertexArray(0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        depth_copy_.activate(false);
+        glDisable(GL_STENCIL_TEST);
+        glDepthFunc(GL_LESS);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        return;
+    }
     glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
     glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
     glBlitFramebuffer(0, 0, bufferWidth(), bufferHeight(),
                       0, 0, bufferWidth(), bufferHeight(),
-                      GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+                      GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT, GL_NEAREST);
     glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
 }
 
 
 shader::DeferredLighting::DeferredLighting()
-    : vao(0), vbo(0), fbo(0), output_buffer(0)
+    : vao(0), vbo(0), fbo(0),
+      buffer_width_(0), buffer_height_(0), target_(0)
 {}
 
 shader::DeferredLighting::~DeferredLighting()
@@ -153,7 +365,6 @@ shader::DeferredLighting::~DeferredLighting()
     glDeleteVertexArrays(1, &vao);
     glDeleteBuffers(1, &vbo);
     glDeleteFramebuffers(1, &fbo);
-    glDeleteTextures(1, &output_buffer);
 }
 void shader::DeferredLighting::init()
 {
@@ -168,16 +379,14 @@ void shader::DeferredLighting::init()
     glDeleteVertexArrays(1, &vao); vao = 0;
     glDeleteBuffers(1, &vbo); vbo = 0;
     glDeleteFramebuffers(1, &fbo); fbo = 0;
-    glDeleteTextures(1, &output_buffer); output_buffer = 0;
+    target_ = 0;
 
     glGenVertexArrays(1, &vao);
     glGenBuffers(1, &vbo);
     glGenFramebuffers(1, &fbo);
-    glGenTextures(1, &output_buffer);
 
-    std::string tmp(FRAGMENT_SHADER);
-    tmp.insert(tmp.find_first_of("c")+4, "\n#define MAX_LIGHTS " + std::to_string(std::max(1, MAX_LIGHTS_PER_BATCH)));
-    Shader::init(VERTEX_SHADER, tmp.c_str());
+    Shader::init(VERTEX_SHADER, DeferredLightingPass::withGBufferDecode(
+            FRAGMENT_SHADER, "\n#define GBUFFER_ANY_LAYOUT").c_str());
 
     glBindVertexArray(vao);
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
@@ -194,14 +403,14 @@ void shader::DeferredLighting::init()
     set("ambient_buffer", 0);
     set("diffuse_buffer", 1);
     set("specular_buffer", 2);
-    set("position_buffer", 3);
+    set("depth_buffer", 3);
     set("normal_buffer", 4);
+    set("position_buffer", 5);
     set("show_only", -1);
+    set("light_offset", 0);
+    set("accumulate", 0);
     glBindFragDataLocation(programID(), 0, "color");
     Shader::activate(false);
-
-    if (buffer_width_ != 0 && buffer_height_ != 0)
-        setBufferSize(buffer_width_, buffer_height_);
 }
 
 void shader::DeferredLighting::activate(bool enable)
@@ -213,54 +422,83 @@ void shader::DeferredLighting::activate(bool enable)
     Shader::activate(enable);
 }
 
-void shader::DeferredLighting::renderCache(int n_lights, DeferredLightingPass &pass_shader)
+void shader::DeferredLighting::renderCache(int light_offset, int n_lights, DeferredLightingPass &pass_shader,
+                                           int x, int y, int width, int height)
+{
+    x = std::max(0, x);
+    y = std::max(0, y);
+    width = std::min(width, buffer_width_ - x);
+    height = std::min(height, buffer_height_ - y);
+    if (width < 1 || height < 1)
+        return;
+    if (width == buffer_width_ && height == buffer_height_)
+    {
+        renderCache(light_offset, n_lights, pass_shader);
+        return;
+    }
+
+    // pixels outside the rectangle keep their accumulated lighting
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(x, y, width, height);
+    accumulate(light_offset, n_lights, pass_shader);
+    glDisable(GL_SCISSOR_TEST);
+}
+
+void shader::DeferredLighting::renderCache(int light_offset, int n_lights, DeferredLightingPass &pass_shader)
+{
+    accumulate(light_offset, n_lights, pass_shader);
+}
+
+void shader::DeferredLighting::accumulate(int light_offset, int n_lights, DeferredLightingPass &pass_shader)
 {
+    useLayout(pass_shader);
     glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    if (target_ != pass_shader.buffers[0])
+    {
+        target_ = pass_shader.buffers[0];
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, target_, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            error("Failed to generate frame buffer for shader::DeferredLighting");
+    }
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
 
     glBindVertexArray(vao);
     pass_shader.activateBuffers();
+    // the ambient buffer is the render target and not sampled
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    set("accumulate", 1);
+    set("light_offset", light_offset);
     set("n_lights", n_lights);
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    set("accumulate", 0);
     glBindVertexArray(0);
 
-    // double buffers
-    std::swap(output_buffer, pass_shader.buffers[0]);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT6, GL_TEXTURE_2D, output_buffer, 0);
-    glBindFramebuffer(GL_FRAMEBUFFER, pass_shader.fbo);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pass_shader.buffers[0], 0);
-
+    glDisable(GL_BLEND);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
-void shader::DeferredLighting::render(int n_lights, DeferredLightingPass &pass_shader)
+void shader::DeferredLighting::render(int light_offset, int n_lights, DeferredLightingPass &pass_shader)
 {
+    useLayout(pass_shader);
     glBindVertexArray(vao);
     pass_shader.activateBuffers();
+    set("light_offset", light_offset);
     set("n_lights", n_lights);
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
     glBindVertexArray(0);
 }
 
+void shader::DeferredLighting::useLayout(DeferredLightingPass const &pass_shader)
+{
+    auto const &layout = pass_shader.layout();
+    set("octahedral_normal", layout.octahedral_normal ? 1 : 0);
+    set("stored_position", layout.position != 0 ? 1 : 0);
+}
+
 void shader::DeferredLighting::setBufferSize(int width, int height)
 {
     buffer_width_ = width;
     buffer_height_ = height;
-
-    if (fbo == 0)
-        return;
-
-    glBindTexture(GL_TEXTURE_2D, output_buffer);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, width, height, 0, GL_RGB, GL_FLOAT, nullptr);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
-    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT6, output_buffer, 0);
-    static constexpr GLenum draw_buffer[] = { GL_COLOR_ATTACHMENT6 };
-    glDrawBuffers(1, draw_buffer);
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        error("Failed to generate frame buffer for shader::DeferredLighting");
-
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
@@ -7,14 +7,67 @@ namespace px { namespace shader
 {
 class DeferredLightingPass;
 class DeferredLighting;
+class AmortizedLighting;
+class ImageCompare;
 }}
 
 
+// Geometry pass of deferred shading, which fills the G-buffer
+//   ambient_buffer   ambient color, also used to accumulate lighting,
+//                    hence half floats in every layout
+//   diffuse_buffer   diffuse color
+//   specular_buffer  specular color + shininess / 255
+//   normal_buffer    normal direction, octahedral encoded in 2-channel formats
+//   position_buffer  world-space position, only if stored by the layout
+//   depth_buffer     from which the world-space position is rebuilt
+//                    with the inverse view-projection matrix in SceneCamera
+// activateBuffers() binds them to texture units 0 to 5 in the order of
+// ambient, diffuse, specular, depth, normal and position.
+// Formats are given by a layout in LAYOUTS. DeferredLighting supports all of
+// them, while the other lighting shaders expect the default layout 0.
+// An optional depth-only pre-pass, see activatePrepass(), lets the G-buffer
+// pass shade each pixel only once regardless of overdraw.
+// With samples() > 1 all buffers are multisampled textures, which only
+// MsaaDeferredLighting reads.
 class px::shader::DeferredLightingPass : public Shader
 {
 public:
     static const char *VERTEX_SHADER;
     static const char *FRAGMENT_SHADER;
+    // fragment shader of the depth pre-pass, used with VERTEX_SHADER
+    static const char *PREPASS_FRAGMENT_SHADER;
+    // fullscreen pass copying depth that cannot be blitted onto the screen
+    static const char *DEPTH_COPY_VERTEX_SHADER;
+    static const char *DEPTH_COPY_FRAGMENT_SHADER;
+    // GLSL declarations of SceneCamera, depth_buffer and normal_buffer, and
+    // the functions gBufferPosition and gBufferNormal decoding the G-buffer,
+    // shared by all lighting shaders
+    static const char *GBUFFER_DECODE;
+
+    // internal formats of G-buffer attachments
+    struct Layout
+    {
+        const char *name;
+        GLenum ambient;
+        GLenum diffuse;
+        GLenum specular;
+        GLenum normal;
+        GLenum position; // 0 for rebuilding position from depth
+        GLenum depth;
+        bool octahedral_normal;
+    };
+    static const Layout LAYOUTS[];
+    static const int N_LAYOUTS;
+    // index of the compact layout used by default and of the layout with
+    // every attribute stored in 16-bit floats, taken as the reference
+    static const int DEFAULT_LAYOUT;
+    static const int REFERENCE_LAYOUT;
+
+    // nominal size in bytes of a pixel of the given layout
+    static std::size_t bytesPerPixel(Layout const &layout);
+    // shader source with the given defines and GBUFFER_DECODE inserted after
+    // its #version line, see glsl/gbuffer_decode.glsl for the defines it takes
+    static std::string withGBufferDecode(const char *source, std::string const &defines = "");
 
 public:
     DeferredLightingPass();
@@ -23,23 +76,52 @@ public:
     void init();
     void activate(bool enable) override;
 
+    // render depth and stencil only, with prepass() as the shader of objects;
+    // the next activate(true) then keeps the depth buffer and writes only
+    // fragments whose depth is equal to it
+    void activatePrepass(bool enable);
     void activateBuffers();
     // set framebuffer size, call after init before use
     void setBufferSize(int width, int height);
+    // switch to the layout LAYOUTS[index] and reallocate the buffers
+    void layout(int index);
+    // set the number of samples per pixel, 1 for single-sampled buffers,
+    // and recreate the buffers
+    void samples(int n);
+    // copy depth and stencil buffer onto the screen
+    // stencil is 1 for pixels covered by geometry
+    // D24S8 buffers are blitted, which also resolves multisampled buffers
+    // onto the single-sampled window framebuffer; depth of other formats is
+    // copied by a fullscreen pass instead, since blits fail on differing
+    // formats, which only supports single-sampled buffers
     void extractDepthBuffer();
 
     inline void init(int width, int height) { init(); setBufferSize(width, height); }
     inline int bufferWidth() const noexcept { return buffer_width_; }
     inline int bufferHeight() const noexcept { return buffer_height_; }
+    inline int layoutIndex() const noexcept { return layout_; }
+    inline Layout const &layout() const noexcept { return LAYOUTS[layout_]; }
+    inline int samples() const noexcept { return samples_; }
+    inline Shader *prepass() noexcept { return &prepass_; }
 
     friend DeferredLighting;
+    friend AmortizedLighting;
+    friend ImageCompare;
 protected:
     unsigned int fbo;
-    unsigned int rbo;
+    unsigned int depth_buffer;
     unsigned int buffers[5];
 private:
     int buffer_width_;
     int buffer_height_;
+    int layout_;
+    int samples_;
+    Shader prepass_;
+    Shader depth_copy_;
+    // empty vertex array for the vertex-less fullscreen triangle of depth_copy_
+    unsigned int depth_copy_vao_;
+    // true between the end of the pre-pass and the end of the G-buffer pass
+    bool depth_ready_;
 };
 
 class px::shader::DeferredLighting : public Shader
@@ -48,25 +130,37 @@ public:
     static const char *VERTEX_SHADER;
     static const char *FRAGMENT_SHADER;
 
+    // initial maximum number of lights processed by one lighting pass,
+    // 0 for processing all lights in a single pass
     static const int MAX_LIGHTS_PER_BATCH;
 
+    // point light as stored in the light storage buffer (std430 layout)
+    // colors are premultiplied and the effective lighting radius is precomputed,
+    // coef is (1, 0, 0) for lights without attenuation
     struct PointLight
     {
-        glm::vec3 position;
-        glm::vec3 ambient;
-        glm::vec3 diffuse;
-        glm::vec3 specular;
-        glm::vec3 coef;
+        glm::vec3 position; float radius;
+        glm::vec3 ambient;  float pad1;
+        glm::vec3 diffuse;  float pad2;
+        glm::vec3 specular; float pad3;
+        glm::vec3 coef;     float radius2;
     };
 public:
     DeferredLighting();
     ~DeferredLighting() override;
 
     void init();
-    // render into cache buffers
-    void renderCache(int n_lights, DeferredLightingPass &pass_shader);
+    // add the lighting of the lights [light_offset, light_offset + n_lights)
+    // in the visible light list onto the ambient buffer of pass_shader,
+    // which holds the ambient color written once by the geometry pass,
+    // by additive blending
+    void renderCache(int light_offset, int n_lights, DeferredLightingPass &pass_shader);
+    // accumulate lighting only inside the given rectangle in pixels,
+    // which should enclose the screen-space extent of the lights
+    void renderCache(int light_offset, int n_lights, DeferredLightingPass &pass_shader,
+                     int x, int y, int width, int height);
     // render cache buffer to screen with n_lights more new lights
-    void render(int n_lights, DeferredLightingPass &pass_shader);
+    void render(int light_offset, int n_lights, DeferredLightingPass &pass_shader);
 
     // set framebuffer size, call after init before use
     void setBufferSize(int width, int height);
@@ -76,10 +170,16 @@ protected:
     unsigned int vao;
     unsigned int vbo;
     unsigned int fbo;
-    unsigned int output_buffer;
 private:
+    // follow the G-buffer layout of pass_shader
+    void useLayout(DeferredLightingPass const &pass_shader);
+    // draw the lights into the ambient buffer of pass_shader attached to fbo,
+    // which is only re-attached when another G-buffer is given
+    void accumulate(int light_offset, int n_lights, DeferredLightingPass &pass_shader);
     int buffer_width_;
     int buffer_height_;
+    // ambient buffer currently attached to fbo
+    unsigned int target_;
 };
 
 #endif // PX_CG_SHADERS_DEFERRED_LIGHTING_HPP
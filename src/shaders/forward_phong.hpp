@@ -9,11 +9,11 @@ namespace px { namespace shader
 class ForwardPhong;
 }}
 
+// Forward phong shading.
+// Lights are read from the shader storage buffer bound at binding point 1.
 class px::shader::ForwardPhong : public Shader
 {
 public:
-    static const int MAX_LIGHTS; // this should not be larger than the one defined in the shader
-
     static const char *VERTEX_SHADER;
     static const char *FRAGMENT_SHADER;
 
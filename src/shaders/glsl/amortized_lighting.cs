@@ -0,0 +1,93 @@
+R"=====(
+#version 430 core
+
+// GROUP_SIZE and N_SUBSETS are inserted by shader::AmortizedLighting
+layout (local_size_x = GROUP_SIZE, local_size_y = GROUP_SIZE) in;
+
+// SceneCamera, depth_buffer and normal_buffer are declared by DeferredLightingPass::GBUFFER_DECODE
+
+// G-buffer generated by DeferredLightingPass,
+// whose ambient buffer holds the ambient color plus the lighting of the
+// current light subset accumulated by DeferredLighting::renderCache
+uniform sampler2D ambient_buffer;
+uniform sampler2D diffuse_buffer;
+uniform sampler2D specular_buffer;
+// ambient color before any lighting is accumulated
+uniform sampler2D ambient_cache;
+
+// final result
+layout (rgba16f, binding = 0) uniform writeonly image2D output_buffer;
+// lighting of every light subset, one layer per subset
+layout (rgba16f, binding = 1) uniform readonly image2DArray prev_history;
+layout (rgba16f, binding = 2) uniform writeonly image2DArray history;
+// world-space positions that history belongs to, w is 0 for empty pixels
+layout (rgba32f, binding = 3) uniform readonly image2D prev_positions;
+layout (rgba32f, binding = 4) uniform writeonly image2D positions;
+
+// index of the light subset shaded in this frame
+uniform int subset;
+// false if there is no valid history, e.g. after resizing
+uniform bool reuse;
+uniform mat4 prev_view_projection;
+
+uniform int show_only;
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 size = imageSize(output_buffer);
+    if (pixel.x >= size.x || pixel.y >= size.y)
+        return;
+
+    vec3 ambient = texelFetch(ambient_cache, pixel, 0).rgb;
+    vec3 lighting = texelFetch(ambient_buffer, pixel, 0).rgb - ambient;
+    vec3 position = gBufferPosition(pixel);
+    vec3 normal = gBufferNormal(pixel);
+    bool empty = dot(normal, normal) == 0.f;
+
+    // find where the surface point was in the last frame,
+    // history is rejected if another surface was seen there
+    bool valid = false;
+    ivec2 q = pixel;
+    if (reuse && !empty)
+    {
+        vec4 clip = prev_view_projection * vec4(position, 1.f);
+        if (clip.w > 0.f)
+        {
+            q = ivec2(floor((clip.xy / clip.w * .5f + .5f) * vec2(size)));
+            if (all(greaterThanEqual(q, ivec2(0))) && all(lessThan(q, size)))
+            {
+                vec4 prev = imageLoad(prev_positions, q);
+                valid = prev.w > 0.f &&
+                        distance(prev.xyz, position) < .01f * length(camera_position - position);
+            }
+        }
+    }
+
+    // subsets take lights with interleaved indices and so cover the scene
+    // evenly, the current subset stands in for the rejected ones
+    vec3 c = vec3(0.f, 0.f, 0.f);
+    for (int j = 0; j < N_SUBSETS; ++j)
+    {
+        vec3 l = j == subset || !valid ? lighting : imageLoad(prev_history, ivec3(q, j)).rgb;
+        imageStore(history, ivec3(pixel, j), vec4(l, 1.f));
+        c += l;
+    }
+    imageStore(positions, pixel, vec4(position, empty ? 0.f : 1.f));
+
+    if (show_only == 0)
+        imageStore(output_buffer, pixel, vec4(ambient, 1.f));
+    else if (show_only == 1)
+        imageStore(output_buffer, pixel, vec4(texelFetch(diffuse_buffer, pixel, 0).rgb, 1.f));
+    else if (show_only == 2)
+        imageStore(output_buffer, pixel, vec4(texelFetch(specular_buffer, pixel, 0).rgb, 1.f));
+    else if (show_only == 3)
+        imageStore(output_buffer, pixel, vec4(position, 1.f));
+    else if (show_only == 4)
+        imageStore(output_buffer, pixel, vec4(normal, 1.f));
+    else if (show_only == 5)    // heat map of rejected history
+        imageStore(output_buffer, pixel, vec4(vec3(valid || empty ? 0.f : 1.f), 1.f));
+    else
+        imageStore(output_buffer, pixel, vec4(c + ambient, 1.f));
+}
+)====="
@@ -0,0 +1,138 @@
+R"=====(
+#version 430 core
+
+// texture coordinates of the screen quad
+in vec2 tex_coords;
+
+// output fragment color for each point
+out vec3 color;
+
+// SceneCamera, depth_buffer and normal_buffer are declared by DeferredLightingPass::GBUFFER_DECODE
+
+// ambient color
+uniform sampler2D ambient_buffer;
+// diffuse color
+uniform sampler2D diffuse_buffer;
+// vec4, specular color + shininess
+uniform sampler2D specular_buffer;
+
+// struct of point light, std430 layout
+// position.w is the effective lighting radius and coef.w its square,
+// the other w components are padding
+struct PointLight
+{
+    vec4 position;
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
+    vec4 coef;
+};
+// all light sources in the scene
+layout (std430, binding = 1) buffer PointLights
+{
+    PointLight lights[];
+};
+// offset and number of light indices of each cluster
+layout (std430, binding = 2) buffer ClusterOffsets
+{
+    uvec2 cluster_offsets[];
+};
+// light indices of all clusters
+layout (std430, binding = 3) buffer ClusterLights
+{
+    uint cluster_lights[];
+};
+
+// number of clusters along x, y and z axis
+uniform ivec3 cluster_grid;
+// slice 0 covers [0, cluster_near]
+// the other slices split [cluster_near, cluster_far] exponentially
+uniform float cluster_near;
+uniform float cluster_far;
+
+uniform int show_only;
+
+void main()
+{
+    // pick out attributes for current point being processed from frame buffers
+    vec3 ambient = texture(ambient_buffer, tex_coords).rgb;
+    vec3 diffuse = texture(diffuse_buffer, tex_coords).rgb;
+    vec4 specular_tmp = texture(specular_buffer, tex_coords).rgba;
+    vec3 specular = specular_tmp.rgb;
+    float shininess = specular_tmp.a * 255.f;
+    vec3 position = gBufferPosition(ivec2(gl_FragCoord.xy));
+    vec3 normal = gBufferNormal(ivec2(gl_FragCoord.xy));
+
+    // find out the cluster of current point, same to ClusterBuilder::slice
+    float depth = -(view * vec4(position, 1.f)).z;
+    int k = 0;
+    if (depth >= cluster_far)
+        k = cluster_grid.z - 1;
+    else if (depth >= cluster_near)
+        k = min(cluster_grid.z - 1,
+                1 + int(log(depth / cluster_near) / log(cluster_far / cluster_near) * float(cluster_grid.z - 1)));
+    ivec2 tile = clamp(ivec2(tex_coords * vec2(cluster_grid.xy)), ivec2(0), cluster_grid.xy - 1);
+    uvec2 cluster = cluster_offsets[(k * cluster_grid.y + tile.y) * cluster_grid.x + tile.x];
+
+    if (show_only == 0)
+    {
+        color = ambient;
+        return;
+    }
+    else if (show_only == 1)
+    {
+        color = diffuse;
+        return;
+    }
+    else if (show_only == 2)
+    {
+        color = specular;
+        return;
+    }
+    else if (show_only == 3)
+    {
+        color = position;
+        return;
+    }
+    else if (show_only == 4)
+    {
+        color = normal;
+        return;
+    }
+    else if (show_only == 5)    // heat map of the number of lights per cluster
+    {
+        color = vec3(float(cluster.y) / 256.f);
+        return;
+    }
+
+    // compute lighting using only the lights assigned to the cluster
+    vec3 V = normalize(camera_position - position);
+    vec3 c = vec3(0.f, 0.f, 0.f); // accumulated color
+    for (uint n = 0u; n < cluster.y; ++n)
+    {
+        uint i = cluster_lights[cluster.x + n];
+        vec4 coef = lights[i].coef;
+
+        // light line, from point to light source
+        vec3 L = lights[i].position.xyz - position;
+        // ignore those lights who are too far away
+        float dist2 = dot(L, L);
+        if (dist2 > coef.w) continue;
+        float dist = sqrt(dist2);
+
+        // attenuation coefficient
+        float atten = 1.f / (coef.x + coef.y*dist + coef.z*dist2);
+
+        // phong shading
+        L /= dist; // light line direction
+        vec3 R = reflect(-L, normal); // reflection light direction
+        float d = max(dot(normal, L), 0.f); // diffuse coefficient
+        float s = pow(max(dot(V, R), 0.f), shininess); // specular coefficient
+
+        // accumulate lighting color
+        c += (lights[i].ambient.rgb*diffuse + lights[i].diffuse.rgb*d*diffuse + lights[i].specular.rgb*s*specular) * atten;
+    }
+
+    color = c + ambient;
+}
+)====="
@@ -0,0 +1,17 @@
+R"=====(
+#version 330 core
+
+// copy the G-buffer depth onto the screen for depth formats the window
+// framebuffer cannot be blitted from; pixels without geometry are discarded
+// such that the stencil test in DeferredLightingPass::extractDepthBuffer
+// marks the same pixels as the G-buffer pass
+uniform sampler2D depth_buffer;
+
+void main()
+{
+    float z = texelFetch(depth_buffer, ivec2(gl_FragCoord.xy), 0).r;
+    if (z == 1.f)
+        discard;
+    gl_FragDepth = z;
+}
+)====="
@@ -0,0 +1,10 @@
+R"=====(
+#version 330 core
+
+// a triangle covering the whole screen, drawn without vertex buffers
+void main()
+{
+    vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(p * 2.f - 1.f, 0.f, 1.f);
+}
+)====="
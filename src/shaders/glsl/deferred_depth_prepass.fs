@@ -0,0 +1,45 @@
+R"=====(
+#version 420 core
+
+// depth-only permutation of deferred_lighting_pass.fs
+// it keeps the parallax discard such that the depth buffer matches the
+// fragments the G-buffer pass writes under GL_EQUAL depth testing
+
+struct Material
+{
+    vec3 ambient;
+    sampler2D diffuse;
+    sampler2D normal;
+    sampler2D specular;
+    float shininess;
+    sampler2D displace; // displacement mapping
+    float displace_scale;
+    float parallax_scale; // height scale for parallax mapping, 0 for no parallax mapping
+    float displace_mid; // mid-point value for displacement/parallax mapping
+};
+uniform Material material;
+
+in vec2 tex_coords;
+in vec3 position;
+
+// the global configuration of the scene camera
+layout (std140, binding = 0) uniform SceneCamera
+{
+    mat4 view;
+    mat4 projection;
+    vec3 camera_position;
+};
+
+void main()
+{
+    if (material.parallax_scale != 0.f)
+    {
+        vec3 dv = texture(material.displace, tex_coords).xyz;
+        float df = 0.30*dv.x + 0.59*dv.y + 0.11*dv.z - material.displace_mid;
+        vec3 V = normalize(camera_position - position);
+        vec2 coords = tex_coords - V.xy / V.z * (df * material.parallax_scale);
+        if (coords.x < 0.f || coords.y < 0.f || coords.x > 1.f || coords.y > 1.f)
+            discard;
+    }
+}
+)====="
@@ -0,0 +1,74 @@
+R"=====(
+#version 430 core
+
+// output lighting color, added onto the screen
+out vec3 color;
+
+flat in int light_index;
+
+// SceneCamera, depth_buffer and normal_buffer are declared by DeferredLightingPass::GBUFFER_DECODE
+
+// diffuse color
+uniform sampler2D diffuse_buffer;
+// vec4, specular color + shininess
+uniform sampler2D specular_buffer;
+
+// struct of point light, std430 layout
+// position.w is the effective lighting radius and coef.w its square,
+// the other w components are padding
+struct PointLight
+{
+    vec4 position;
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
+    vec4 coef;
+};
+// all light sources in the scene
+layout (std430, binding = 1) buffer PointLights
+{
+    PointLight lights[];
+};
+
+uniform int show_only;
+
+void main()
+{
+    if (show_only == 5) // overdraw of light volumes
+    {
+        color = vec3(1.f/64.f);
+        return;
+    }
+
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    vec3 position = gBufferPosition(pixel);
+
+    // light line, from point to light source
+    vec3 L = lights[light_index].position.xyz - position;
+
+    // the volume only bounds the light in screen space,
+    // the point may still be in front of the light sphere
+    vec4 coef = lights[light_index].coef;
+    float dist2 = dot(L, L);
+    if (dist2 > coef.w) discard;
+    float dist = sqrt(dist2);
+    vec3 light_diffuse = lights[light_index].diffuse.xyz;
+
+    vec3 diffuse = texelFetch(diffuse_buffer, pixel, 0).rgb;
+    vec4 specular_tmp = texelFetch(specular_buffer, pixel, 0).rgba;
+    vec3 specular = specular_tmp.rgb;
+    float shininess = specular_tmp.a * 255.f;
+    vec3 normal = gBufferNormal(pixel);
+
+    // attenuation coefficient
+    float atten = 1.f / (coef.x + coef.y*dist + coef.z*dist2);
+
+    // phong shading
+    L /= dist; // light line direction
+    vec3 R = reflect(-L, normal); // reflection light direction
+    float d = max(dot(normal, L), 0.f); // diffuse coefficient
+    float s = pow(max(dot(normalize(camera_position - position), R), 0.f), shininess); // specular coefficient
+
+    color = (lights[light_index].ambient.rgb*diffuse + light_diffuse*d*diffuse + lights[light_index].specular.rgb*s*specular) * atten;
+}
+)====="
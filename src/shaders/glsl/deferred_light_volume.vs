@@ -0,0 +1,42 @@
+R"=====(
+#version 430 core
+// vertex of a unit sphere enclosing mesh
+layout (location = 0) in vec3 vertex;
+
+// struct of point light, std430 layout
+// position.w is the effective lighting radius and coef.w its square,
+// the other w components are padding
+struct PointLight
+{
+    vec4 position;
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
+    vec4 coef;
+};
+// all light sources in the scene
+layout (std430, binding = 1) buffer PointLights
+{
+    PointLight lights[];
+};
+
+// the global configuration of the scene camera
+layout (std140, binding = 0) uniform SceneCamera
+{
+    mat4 view;
+    mat4 projection;
+    vec3 camera_position;
+};
+
+// index of the light source this volume belongs to
+flat out int light_index;
+
+void main()
+{
+    light_index = gl_InstanceID;
+
+    // scaled by the effective lighting radius
+    vec4 light = lights[gl_InstanceID].position;
+    gl_Position = projection * view * vec4(vertex * light.w + light.xyz, 1.f);
+}
+)====="
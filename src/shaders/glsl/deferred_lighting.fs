@@ -1,5 +1,5 @@
 R"=====(
-#version 420 core
+#version 430 core
 
 // texture coordinates
 // in deferred lighting
@@ -10,13 +10,7 @@ in vec2 tex_coords;
 // output fragment color for each point
 out vec3 color;
 
-// the global configuration of the scene camera
-layout (std140, binding = 0) uniform SceneCamera
-{
-    mat4 view;
-    mat4 projection;
-    vec3 camera_position;
-};
+// SceneCamera, depth_buffer and normal_buffer are declared by DeferredLightingPass::GBUFFER_DECODE
 
 // ambient color
 uniform sampler2D ambient_buffer;
@@ -24,38 +18,55 @@ uniform sampler2D ambient_buffer;
 uniform sampler2D diffuse_buffer;
 // vec4, specular color + shininess
 uniform sampler2D specular_buffer;
-// 3D position of the current sampling point
-uniform sampler2D position_buffer;
-// normal direction
-uniform sampler2D normal_buffer;
 
-// struct of point light
+// struct of point light, std430 layout
+// position.w is the effective lighting radius and coef.w its square,
+// the other w components are padding
 struct PointLight
 {
-    vec3 position;
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-    vec3 coef;
+    vec4 position;
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
+    vec4 coef;
+};
+// all light sources in the scene
+layout (std430, binding = 1) buffer PointLights
+{
+    PointLight lights[];
 };
-// lighting source cache
-uniform PointLight lights[MAX_LIGHTS];
+// indices of lights that survived CPU frustum culling
+layout (std430, binding = 4) buffer VisibleLights
+{
+    uint visible_lights[];
+};
+// index of the first light of current batch in visible_lights
+uniform int light_offset;
 // actual number of lights in current batch
 uniform int n_lights;
-
+// true when adding the batch onto the ambient buffer by blending,
+// in which case the ambient buffer is the render target and not read
+uniform bool accumulate;
 
 uniform int show_only;
 
 void main()
 {
+    // framebuffer contents are only shown by the final composition
+    if (accumulate && show_only > -1)
+    {
+        color = vec3(0.f, 0.f, 0.f);
+        return;
+    }
+
     // pick out attributes for current point being processed from frame buffers
-    vec3 ambient = texture(ambient_buffer, tex_coords).rgb;
+    vec3 ambient = accumulate ? vec3(0.f, 0.f, 0.f) : texture(ambient_buffer, tex_coords).rgb;
     vec3 diffuse = texture(diffuse_buffer, tex_coords).rgb;
     vec4 specular_tmp = texture(specular_buffer, tex_coords).rgba;
     vec3 specular = specular_tmp.rgb;
-    float shininess = specular_tmp.a;
-    vec3 position = texture(position_buffer, tex_coords).rgb;
-    vec3 normal = texture(normal_buffer, tex_coords).rgb;
+    float shininess = specular_tmp.a * 255.f;
+    vec3 position = gBufferPosition(ivec2(gl_FragCoord.xy));
+    vec3 normal = gBufferNormal(ivec2(gl_FragCoord.xy));
 
     if (show_only == 0)
     {
@@ -84,25 +95,19 @@ void main()
     }
     // compute lighting
     vec3 c = vec3(0.f, 0.f, 0.f); // accumulated color
-    for (int i = 0; i < n_lights; ++i)
+    for (int k = light_offset; k < light_offset + n_lights; ++k)
     {
-        // light line, from point to light source
-        vec3 L = lights[i].position - position;
-        float dist = length(L);
+        uint i = visible_lights[k];
 
-        float atten = 1.f;
-        if (lights[i].coef.x != 0.f || lights[i].coef.y != 0.f || lights[i].coef.z != 0.f)
-        {
-            // effective lighting radius, ignore those lights who are too far away
-            float max_light = max(max(lights[i].diffuse.x, lights[i].diffuse.y), lights[i].diffuse.z);
-            float effective_radius = sqrt(lights[i].coef.y*lights[i].coef.y - 4*lights[i].coef.z*(lights[i].coef.x - (256.0f/5.0f)*max_light));
-            effective_radius -= lights[i].coef.z;
-            effective_radius /= 2.f*lights[i].coef.z;
-            if (dist > effective_radius) continue;
+        // light line, from point to light source
+        vec3 L = lights[i].position.xyz - position;
+        // ignore those lights who are too far away
+        float dist2 = dot(L, L);
+        if (dist2 > lights[i].coef.w) continue;
+        float dist = sqrt(dist2);
 
-            // attenuation coefficient
-            atten /= lights[i].coef.x + lights[i].coef.y*dist + lights[i].coef.z*dist*dist;
-        }
+        // attenuation coefficient
+        float atten = 1.f / (lights[i].coef.x + lights[i].coef.y*dist + lights[i].coef.z*dist2);
 
         // phong shading
         L /= dist; // light line direction
@@ -111,7 +116,7 @@ void main()
         float s = pow(max(dot(normalize(camera_position - position), R), 0.f), shininess); // specular coefficient
 
         // accumulate lighting color
-        c += (lights[i].ambient*diffuse + lights[i].diffuse*d*diffuse + lights[i].specular*s*specular) * atten;
+        c += (lights[i].ambient.xyz*diffuse + lights[i].diffuse.xyz*d*diffuse + lights[i].specular.xyz*s*specular) * atten;
     }
 
     color = c + ambient;
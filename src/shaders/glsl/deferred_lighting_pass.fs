@@ -1,10 +1,6 @@
 R"=====(
 #version 420 core
 
-// This decides how many memory we will apply from GPU
-// It is the maximum number of lights that can be processed by one batch
-#define MAX_LIGHTS 100
-
 // struct of the material of current object
 struct Material
 {
@@ -31,12 +27,18 @@ in vec3 normal;
 in vec3 position;
 in mat3 TBN;
 
-// output buffers
+// output buffers, see DeferredLightingPass::Layout for their formats
+// ambient color, the starting value of lighting accumulation
 layout (location = 0) out vec3 ambient_buffer;
 layout (location = 1) out vec3 diffuse_buffer;
+// specular color + shininess / 255
 layout (location = 2) out vec4 specular_buffer;
-layout (location = 3) out vec3 position_buffer;
-layout (location = 4) out vec3 normal_buffer;
+// normal direction, octahedral encoded into xy if octahedral_normal
+layout (location = 3) out vec4 normal_buffer;
+// only attached if the layout stores position instead of rebuilding it from depth
+layout (location = 4) out vec3 position_buffer;
+
+uniform bool octahedral_normal;
 
 // the global configuration of the scene camera
 layout (std140, binding = 0) uniform SceneCamera
@@ -46,6 +48,14 @@ layout (std140, binding = 0) uniform SceneCamera
     vec3 camera_position;
 };
 
+// map a unit vector onto the octahedron and unfold it into [0, 1]^2
+vec2 encodeNormal(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 e = n.z >= 0.f ? n.xy : (1.f - abs(n.yx)) * vec2(n.x >= 0.f ? 1.f : -1.f, n.y >= 0.f ? 1.f : -1.f);
+    return e * .5f + .5f;
+}
+
 void main()
 {
     // parallax mapping
@@ -73,14 +83,14 @@ void main()
         N = normalize(TBN * N);
     }
     else
-        N = normal;
+        N = normalize(normal);
 
     // same to deferred_lighting
     // but we do lighting computation immediately
     diffuse_buffer = texture(material.diffuse, coords).rgb;
     ambient_buffer = global_ambient * diffuse_buffer * material.ambient;
-    specular_buffer = vec4(texture(material.specular, coords).rgb, material.shininess);
+    specular_buffer = vec4(texture(material.specular, coords).rgb, material.shininess / 255.f);
+    normal_buffer = octahedral_normal ? vec4(encodeNormal(N), 0.f, 0.f) : vec4(N, 0.f);
     position_buffer = position;
-    normal_buffer = N;
 }
 )====="
@@ -23,6 +23,13 @@ layout (location = 1) in vec2 tex_coords_in;
 layout (location = 2) in vec3 norm_in;
 // tangent line direction, for normal mapping case
 layout (location = 3) in vec3 tangent_in;
+// when packed_vertex is true, norm_in.xy and tangent_in.xy hold octahedral
+// encoded directions in [-1, 1]^2, see Spheres::PackedVertex;
+// the other attributes are normalized by the vertex fetch and need no decoding
+uniform bool packed_vertex;
+// per-instance translation applied after model, for instanced drawing;
+// the attribute is disabled for other objects and then reads as zero
+layout (location = 4) in vec3 instance_offset;
 // use tangent or not
 // when use_tangent == 1, normal mapping is used, then normal is picked from material normal texture
 uniform int use_tangent;
@@ -37,6 +44,8 @@ out vec2 tex_coords;
 out vec3 normal;
 out vec3 position; // 3D position of current vertex
 out mat3 TBN; // TBN matrix for normal mapping case
+// the depth pre-pass shares this shader and needs bit-identical depth
+invariant gl_Position;
 
 // the global configuration of the scene camera
 layout (std140, binding = 0) uniform SceneCamera
@@ -46,11 +55,28 @@ layout (std140, binding = 0) uniform SceneCamera
     vec3 camera_position;
 };
 
+// fold an octahedral encoded direction back onto the unit sphere
+vec3 decodeOctahedral(vec2 e)
+{
+    vec3 n = vec3(e, 1.f - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.f);
+    n.xy += vec2(n.x >= 0.f ? -t : t, n.y >= 0.f ? -t : t);
+    return normalize(n);
+}
+
 void main()
 {
     // pass texture coordinates to fragment shader
     tex_coords = tex_coords_in;
 
+    vec3 norm = norm_in;
+    vec3 tangent = tangent_in;
+    if (packed_vertex)
+    {
+        norm = decodeOctahedral(norm_in.xy);
+        tangent = decodeOctahedral(tangent_in.xy);
+    }
+
     // displacement mapping
     // displacement mapping verifies the actual position of the vertex
     vec3 vertex = vertex_in;
@@ -59,28 +85,28 @@ void main()
         vec3 dv = texture(material.displace, tex_coords).xyz;
         float df = 0.30*dv.x + 0.59*dv.y + 0.11*dv.z;
         // verify current vertex position
-        vertex += (df - material.displace_mid) * material.displace_scale * norm_in;
+        vertex += (df - material.displace_mid) * material.displace_scale * norm;
     }
 
     // convert normal line into world coordinate system
     mat3 norm_mat = transpose(inverse(mat3(model)));
     if (use_tangent == 1)     // normal mapping
     {
-        vec3 T = normalize(norm_mat * tangent_in);
-        vec3 N = normalize(norm_mat * norm_in);
+        vec3 T = normalize(norm_mat * tangent);
+        vec3 N = normalize(norm_mat * norm);
         T = normalize(T - dot(T,N)*N);
         vec3 B = cross(N, T);
         TBN = mat3(T, B, N);
     }
     else // pick norm from input data
     {
-        normal = norm_mat * norm_in;
+        normal = norm_mat * norm;
     }
 
     // vertex position in world coordinate system
-    position = vec3(model * vec4(vertex, 1.f));
+    position = vec3(model * vec4(vertex, 1.f)) + instance_offset;
 
     // set 2D position normally such that the framebuffer can contain data as the output screen
-    gl_Position = projection * view * model * vec4(vertex, 1.f);
+    gl_Position = projection * view * vec4(position, 1.f);
 }
 )====="
@@ -0,0 +1,71 @@
+R"=====(
+// decoding of the G-buffer generated by DeferredLightingPass, shared by all
+// lighting shaders and inserted after #version by
+// DeferredLightingPass::withGBufferDecode, together with
+//   GBUFFER_MULTISAMPLE  if the buffers are multisampled, in which case the
+//                        functions take a sample index
+//   GBUFFER_ANY_LAYOUT   if the layout is given by the uniforms octahedral_normal
+//                        and stored_position instead of being the default one
+
+// the global configuration of the scene camera
+layout (std140, binding = 0) uniform SceneCamera
+{
+    mat4 view;
+    mat4 projection;
+    vec3 camera_position;
+    mat4 inv_view_projection; // inverse of projection * view
+};
+
+// depth of the current sampling point, from which its 3D position is rebuilt,
+// and the normal direction, octahedral encoded in the default layout
+#ifdef GBUFFER_MULTISAMPLE
+uniform sampler2DMS depth_buffer;
+uniform sampler2DMS normal_buffer;
+#define GBUFFER_SAMPLE_PARAM , int s
+#define GBUFFER_SAMPLE s
+#define GBUFFER_SIZE textureSize(depth_buffer)
+#else
+uniform sampler2D depth_buffer;
+uniform sampler2D normal_buffer;
+#define GBUFFER_SAMPLE_PARAM
+#define GBUFFER_SAMPLE 0
+#define GBUFFER_SIZE textureSize(depth_buffer, 0)
+#endif
+#ifdef GBUFFER_ANY_LAYOUT
+// 3D position of the current sampling point, only used if stored_position
+uniform sampler2D position_buffer;
+// encoding of the G-buffer, see DeferredLightingPass::Layout
+uniform bool octahedral_normal;
+uniform bool stored_position;
+#endif
+
+// world-space position of a pixel, taken at its center,
+// rebuilt from the depth buffer if not stored
+vec3 gBufferPosition(ivec2 pixel GBUFFER_SAMPLE_PARAM)
+{
+#ifdef GBUFFER_ANY_LAYOUT
+    if (stored_position)
+        return texelFetch(position_buffer, pixel, 0).rgb;
+#endif
+    float z = texelFetch(depth_buffer, pixel, GBUFFER_SAMPLE).r;
+    vec2 ndc = (vec2(pixel) + .5f) / vec2(GBUFFER_SIZE) * 2.f - 1.f;
+    vec4 p = inv_view_projection * vec4(ndc, z * 2.f - 1.f, 1.f);
+    return p.xyz / p.w;
+}
+// normal direction of a pixel, unfolded if octahedral encoded,
+// zero for pixels without any geometry
+vec3 gBufferNormal(ivec2 pixel GBUFFER_SAMPLE_PARAM)
+{
+    if (texelFetch(depth_buffer, pixel, GBUFFER_SAMPLE).r == 1.f)
+        return vec3(0.f, 0.f, 0.f);
+#ifdef GBUFFER_ANY_LAYOUT
+    if (!octahedral_normal)
+        return normalize(texelFetch(normal_buffer, pixel, 0).rgb);
+#endif
+    vec2 e = texelFetch(normal_buffer, pixel, GBUFFER_SAMPLE).rg * 2.f - 1.f;
+    vec3 n = vec3(e, 1.f - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.f);
+    n.xy += vec2(n.x >= 0.f ? -t : t, n.y >= 0.f ? -t : t);
+    return normalize(n);
+}
+)====="
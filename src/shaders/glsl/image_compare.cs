@@ -0,0 +1,42 @@
+R"=====(
+#version 430 core
+
+// GROUP_SIZE is inserted by shader::ImageCompare
+layout (local_size_x = GROUP_SIZE, local_size_y = GROUP_SIZE) in;
+
+// images to be compared, colors are clamped into [0, 1]
+uniform sampler2D image_a;
+uniform sampler2D image_b;
+
+// sum of squared errors of each work group
+layout (std430, binding = 7) buffer ErrorSums
+{
+    float error_sums[];
+};
+
+shared float group_error[GROUP_SIZE*GROUP_SIZE];
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 size = textureSize(image_a, 0);
+
+    float err = 0.f;
+    if (pixel.x < size.x && pixel.y < size.y)
+    {
+        vec3 d = clamp(texelFetch(image_a, pixel, 0).rgb, 0.f, 1.f) -
+                 clamp(texelFetch(image_b, pixel, 0).rgb, 0.f, 1.f);
+        err = dot(d, d);
+    }
+    group_error[gl_LocalInvocationIndex] = err;
+    barrier();
+    for (uint s = uint(GROUP_SIZE*GROUP_SIZE) / 2u; s > 0u; s >>= 1)
+    {
+        if (gl_LocalInvocationIndex < s)
+            group_error[gl_LocalInvocationIndex] += group_error[gl_LocalInvocationIndex + s];
+        barrier();
+    }
+    if (gl_LocalInvocationIndex == 0u)
+        error_sums[gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x] = group_error[0];
+}
+)====="
@@ -0,0 +1,185 @@
+R"=====(
+#version 430 core
+
+// texture coordinates of the screen quad
+in vec2 tex_coords;
+
+// output fragment color for each point
+out vec3 color;
+
+// SceneCamera, depth_buffer and normal_buffer are declared by DeferredLightingPass::GBUFFER_DECODE
+
+// ambient color
+uniform sampler2D ambient_buffer;
+// diffuse color
+uniform sampler2D diffuse_buffer;
+// vec4, specular color + shininess
+uniform sampler2D specular_buffer;
+
+// struct of point light, std430 layout
+// position.w is the effective lighting radius and coef.w its square,
+// the other w components are padding
+struct PointLight
+{
+    vec4 position;
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
+    vec4 coef;
+};
+// all light sources in the scene
+layout (std430, binding = 1) buffer PointLights
+{
+    PointLight lights[];
+};
+// node of the light tree, see LightTree::Node
+struct LightNode
+{
+    vec4 lo;        // bounds of light positions, w: max effective radius
+    vec4 hi;        // w: total weight
+    vec4 position;  // representative position
+    vec4 ambient;   // summed colors
+    vec4 diffuse;
+    vec4 specular;
+    vec4 coef;      // weighted attenuation coefficients
+    ivec4 link;     // left child (-1 for leaves), first, count, number of lights
+};
+layout (std430, binding = 5) buffer LightNodes
+{
+    LightNode nodes[];
+};
+// light indices sorted by leaves
+layout (std430, binding = 6) buffer LightOrder
+{
+    uint light_order[];
+};
+
+// actual number of lights taken into account
+uniform int n_lights;
+// a node whose extent is smaller than cut_threshold times its distance
+// to the shaded point is shaded by its representative, 0 for exact shading
+uniform float cut_threshold;
+
+uniform int show_only;
+
+vec3 V;
+vec3 P;
+vec3 N;
+float shininess;
+vec3 diffuse;
+vec3 specular;
+
+// phong shading of a light of the given colors at light_pos
+vec3 shade(vec3 light_pos, vec3 light_ambient, vec3 light_diffuse, vec3 light_specular,
+           vec3 coef, float dist2)
+{
+    vec3 L = light_pos - P;
+    float dist = sqrt(dist2);
+    float atten = 1.f / (coef.x + coef.y*dist + coef.z*dist2);
+
+    L /= dist; // light line direction
+    vec3 R = reflect(-L, N); // reflection light direction
+    float d = max(dot(N, L), 0.f); // diffuse coefficient
+    float s = pow(max(dot(V, R), 0.f), shininess); // specular coefficient
+
+    return (light_ambient*diffuse + light_diffuse*d*diffuse + light_specular*s*specular) * atten;
+}
+
+void main()
+{
+    // pick out attributes for current point being processed from frame buffers
+    vec3 ambient = texture(ambient_buffer, tex_coords).rgb;
+    diffuse = texture(diffuse_buffer, tex_coords).rgb;
+    vec4 specular_tmp = texture(specular_buffer, tex_coords).rgba;
+    specular = specular_tmp.rgb;
+    shininess = specular_tmp.a * 255.f;
+    P = gBufferPosition(ivec2(gl_FragCoord.xy));
+    N = gBufferNormal(ivec2(gl_FragCoord.xy));
+
+    if (show_only == 0)
+    {
+        color = ambient;
+        return;
+    }
+    else if (show_only == 1)
+    {
+        color = diffuse;
+        return;
+    }
+    else if (show_only == 2)
+    {
+        color = specular;
+        return;
+    }
+    else if (show_only == 3)
+    {
+        color = P;
+        return;
+    }
+    else if (show_only == 4)
+    {
+        color = N;
+        return;
+    }
+
+    V = normalize(camera_position - P);
+    vec3 c = vec3(0.f, 0.f, 0.f); // accumulated color
+    int cut_size = 0;   // number of lights and representatives shaded
+
+    int stack[32];
+    int top = 0;
+    if (n_lights > 0) stack[top++] = 0;
+    while (top > 0)
+    {
+        int k = stack[--top];
+        ivec4 link = nodes[k].link;
+        if (link.w == 0) continue;
+
+        // no light below the node can reach the point
+        vec3 lo = nodes[k].lo.xyz;
+        vec3 hi = nodes[k].hi.xyz;
+        vec3 dv = max(max(lo - P, P - hi), 0.f);
+        float max_radius = nodes[k].lo.w;
+        if (dot(dv, dv) > max_radius*max_radius) continue;
+
+        if (link.x == -1)
+        {
+            // leaf, shade each light
+            for (int j = link.y; j < link.y + link.z; ++j)
+            {
+                uint i = light_order[j];
+                if (i >= uint(n_lights)) continue;
+                vec3 L = lights[i].position.xyz - P;
+                float dist2 = dot(L, L);
+                if (dist2 > lights[i].coef.w) continue;
+                c += shade(lights[i].position.xyz, lights[i].ambient.rgb, lights[i].diffuse.rgb,
+                           lights[i].specular.rgb, lights[i].coef.xyz, dist2);
+                ++cut_size;
+            }
+            continue;
+        }
+
+        vec3 rep = nodes[k].position.xyz - P;
+        float rep_dist2 = dot(rep, rep);
+        vec3 extent = hi - lo;
+        if (dot(extent, extent) < cut_threshold*cut_threshold*rep_dist2)
+        {
+            // the node is small seen from the point, shade its representative
+            if (rep_dist2 <= max_radius*max_radius)
+            {
+                c += shade(nodes[k].position.xyz, nodes[k].ambient.rgb, nodes[k].diffuse.rgb,
+                           nodes[k].specular.rgb, nodes[k].coef.xyz, rep_dist2);
+                ++cut_size;
+            }
+            continue;
+        }
+        stack[top++] = link.x;
+        stack[top++] = link.x + 1;
+    }
+
+    if (show_only == 5) // heat map of the cut size
+        color = vec3(float(cut_size) / 256.f);
+    else
+        color = c + ambient;
+}
+)====="
@@ -0,0 +1,140 @@
+R"=====(
+#version 430 core
+
+in vec2 tex_coords;
+
+out vec3 color;
+
+// SceneCamera, depth_buffer and normal_buffer are declared by DeferredLightingPass::GBUFFER_DECODE
+
+// multisampled G-buffer generated by DeferredLightingPass in the default layout
+uniform sampler2DMS ambient_buffer;
+uniform sampler2DMS diffuse_buffer;
+uniform sampler2DMS specular_buffer;
+// number of samples per pixel
+uniform int samples;
+
+// struct of point light, std430 layout
+// position.w is the effective lighting radius and coef.w its square,
+// the other w components are padding
+struct PointLight
+{
+    vec4 position;
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
+    vec4 coef;
+};
+// all light sources in the scene
+layout (std430, binding = 1) buffer PointLights
+{
+    PointLight lights[];
+};
+// indices of lights that survived CPU frustum culling
+layout (std430, binding = 4) buffer VisibleLights
+{
+    uint visible_lights[];
+};
+// actual number of visible lights
+uniform int n_lights;
+
+// 0: edge detection, 1: per-pixel lighting, 2: per-sample lighting
+uniform int stage;
+
+uniform int show_only;
+
+// true if the samples of a pixel do not lie on one smooth surface
+bool isEdge(ivec2 pixel)
+{
+    bool empty = texelFetch(depth_buffer, pixel, 0).r == 1.f;
+    vec3 normal = empty ? vec3(0.f) : gBufferNormal(pixel, 0);
+    float dist = empty ? 0.f : length(camera_position - gBufferPosition(pixel, 0));
+    for (int s = 1; s < samples; ++s)
+    {
+        bool e = texelFetch(depth_buffer, pixel, s).r == 1.f;
+        if (e != empty)     // partially covered
+            return true;
+        if (e)
+            continue;
+        if (dot(gBufferNormal(pixel, s), normal) < .99f ||
+            abs(length(camera_position - gBufferPosition(pixel, s)) - dist) > .01f * dist)
+            return true;
+    }
+    return false;
+}
+
+// shaded color of a sample, or the attribute selected by show_only
+vec3 shade(ivec2 pixel, int s)
+{
+    vec3 ambient = texelFetch(ambient_buffer, pixel, s).rgb;
+    vec3 diffuse = texelFetch(diffuse_buffer, pixel, s).rgb;
+    vec4 specular_tmp = texelFetch(specular_buffer, pixel, s).rgba;
+    vec3 specular = specular_tmp.rgb;
+    float shininess = specular_tmp.a * 255.f;
+    bool empty = texelFetch(depth_buffer, pixel, s).r == 1.f;
+    vec3 position = gBufferPosition(pixel, s);
+    vec3 normal = empty ? vec3(0.f) : gBufferNormal(pixel, s);
+
+    if (show_only == 0)
+        return ambient;
+    if (show_only == 1)
+        return diffuse;
+    if (show_only == 2)
+        return specular;
+    if (show_only == 3)
+        return position;
+    if (show_only == 4)
+        return normal;
+    if (empty)
+        return ambient;
+
+    // same lighting as deferred_lighting.fs
+    vec3 V = normalize(camera_position - position);
+    vec3 c = vec3(0.f, 0.f, 0.f);
+    for (int k = 0; k < n_lights; ++k)
+    {
+        uint i = visible_lights[k];
+        vec4 coef = lights[i].coef;
+
+        vec3 L = lights[i].position.xyz - position;
+        float dist2 = dot(L, L);
+        if (dist2 > coef.w) continue;
+        float dist = sqrt(dist2);
+
+        float atten = 1.f / (coef.x + coef.y*dist + coef.z*dist2);
+
+        L /= dist;
+        vec3 R = reflect(-L, normal);
+        float d = max(dot(normal, L), 0.f);
+        float sp = pow(max(dot(V, R), 0.f), shininess);
+
+        c += (lights[i].ambient.xyz*diffuse + lights[i].diffuse.xyz*d*diffuse + lights[i].specular.xyz*sp*specular) * atten;
+    }
+    return c + ambient;
+}
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+
+    if (stage == 0)
+    {
+        if (!isEdge(pixel))
+            discard;
+        color = vec3(0.f, 0.f, 0.f);
+        return;
+    }
+
+    if (show_only == 5)    // heat map of pixels lit per sample
+        color = vec3(stage == 2 ? 1.f : 0.f);
+    else if (stage == 1)
+        color = shade(pixel, 0);
+    else
+    {
+        vec3 c = vec3(0.f, 0.f, 0.f);
+        for (int s = 0; s < samples; ++s)
+            c += shade(pixel, s);
+        color = c / float(samples);
+    }
+}
+)====="
@@ -1,5 +1,5 @@
 R"=====(
-#version 420 core
+#version 430 core
 
 // struct of the material of current object
 struct Material
@@ -38,17 +38,24 @@ layout (std140, binding = 0) uniform SceneCamera
     vec3 camera_position;
 };
 
-// struct of point light
+// struct of point light, std430 layout
+// position.w is the effective lighting radius and coef.w its square,
+// the other w components are padding
 struct PointLight
 {
-    vec3 position;
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-    vec3 coef;
+    vec4 position;
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
+    vec4 coef;
 };
-// lighting source cache
-uniform PointLight lights[MAX_LIGHTS];
+// all light sources in the scene
+layout (std430, binding = 1) buffer PointLights
+{
+    PointLight lights[];
+};
+// index of the first light in current batch
+uniform int light_offset;
 // actual number of lights in current batch
 uniform int n_lights;
 
@@ -87,29 +94,17 @@ void main()
     vec3 ambient = global_ambient * diffuse * material.ambient;
     vec3 specular = texture(material.specular, coords).rgb;
     vec3 c = vec3(0.f); // accumulated color
-    for (int i = 0; i < n_lights; ++i)
+    for (int i = light_offset; i < light_offset + n_lights; ++i)
     {
-        if (lights[i].coef.x == 0.f && lights[i].coef.y == 0.f && lights[i].coef.z == 0.f)
-            continue;
-
         // light line, from point to light source
-        vec3 L = lights[i].position - position;
-        float dist = length(L);
+        vec3 L = lights[i].position.xyz - position;
+        // ignore those lights who are too far away
+        float dist2 = dot(L, L);
+        if (dist2 > lights[i].coef.w) continue;
+        float dist = sqrt(dist2);
 
         // attenuation coefficient
-        float atten = 1.f;
-        if (lights[i].coef.x != 0.f || lights[i].coef.y != 0.f || lights[i].coef.z != 0.f)
-        {
-            // effective lighting radius, ignore those lights who are too far away
-            float max_light = max(max(lights[i].diffuse.x, lights[i].diffuse.y), lights[i].diffuse.z);
-            float effective_radius = sqrt(lights[i].coef.y*lights[i].coef.y - 4*lights[i].coef.z*(lights[i].coef.x - (256.0f/5.0f)*max_light));
-            effective_radius -= lights[i].coef.z;
-            effective_radius /= 2.f*lights[i].coef.z;
-            if (dist > effective_radius) continue;
-
-            // attenuation coefficient
-            atten /= lights[i].coef.x + lights[i].coef.y*dist + lights[i].coef.z*dist*dist;
-        }
+        float atten = 1.f / (lights[i].coef.x + lights[i].coef.y*dist + lights[i].coef.z*dist2);
 
         // phong shading
         L /= dist; // light line direction
@@ -118,7 +113,7 @@ void main()
         float s = pow(max(dot(normalize(camera_position - position), R), 0.f), material.shininess); // specular coefficient
 
         // accumulate lighting color
-        c += (lights[i].ambient*diffuse + lights[i].diffuse*d*diffuse + lights[i].specular*s*specular) * atten;
+        c += (lights[i].ambient.xyz*diffuse + lights[i].diffuse.xyz*d*diffuse + lights[i].specular.xyz*s*specular) * atten;
     }
     color = vec4(c + ambient, 1.f);
 }
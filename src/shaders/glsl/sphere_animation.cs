@@ -0,0 +1,56 @@
+R"=====(
+#version 430 core
+
+// GROUP_SIZE is inserted by shader::SphereAnimation
+layout (local_size_x = GROUP_SIZE) in;
+
+// instance positions, tightly packed vec3, moved in place
+layout (std430, binding = 11) buffer Instances
+{
+    float instances[];
+};
+// vertical speed of each instance
+layout (std430, binding = 15) buffer Speeds
+{
+    float speeds[];
+};
+
+uniform int n_instances;
+// instances bounce within half a unit around this height
+uniform float avg_height;
+uniform float dt;
+uniform int frame;
+
+uint rng_state;
+uint pcg()
+{
+    rng_state = rng_state * 747796405u + 2891336453u;
+    uint word = ((rng_state >> ((rng_state >> 28u) + 4u)) ^ rng_state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+float rnd()
+{
+    return float(pcg() >> 8) / 16777216.f;
+}
+
+// same to Spheres::update in deferred_render_benchmark.cpp
+void main()
+{
+    int i = int(gl_GlobalInvocationID.x);
+    if (i >= n_instances)
+        return;
+    rng_state = uint(i) * 9781u + uint(frame) * 6271u;
+    pcg();
+
+    float y = instances[3*i+1];
+    float speed = speeds[i];
+    if (y > avg_height + .5f)
+        speed = - rnd()*.1f - .1f;
+    else if (y < avg_height - .5f)
+        speed = rnd()*.1f + .1f;
+    else if (abs(speed) < 1e-4f)
+        speed = rnd()*.1f - .2f;
+    speeds[i] = speed;
+    instances[3*i+1] = y + speed*dt;
+}
+)====="
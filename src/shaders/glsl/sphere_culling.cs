@@ -0,0 +1,86 @@
+R"=====(
+#version 430 core
+
+// GROUP_SIZE and MAX_LEVELS are inserted by shader::SphereCulling
+layout (local_size_x = GROUP_SIZE) in;
+
+// the global configuration of the scene camera
+layout (std140, binding = 0) uniform SceneCamera
+{
+    mat4 view;
+    mat4 projection;
+    vec3 camera_position;
+    mat4 inv_view_projection; // inverse of projection * view
+};
+
+// instance positions, tightly packed vec3
+layout (std430, binding = 11) readonly buffer Instances
+{
+    float instances[];
+};
+// positions of instances inside the view frustum, w is padding,
+// level l owns the region starting at l * level_stride
+layout (std430, binding = 12) writeonly buffer VisibleInstances
+{
+    vec4 visible_instances[];
+};
+// DrawElementsIndirectCommand of each level, instance_count is reset to 0
+// before dispatch and counts the survivors
+struct DrawCommand
+{
+    uint count;
+    uint instance_count;
+    uint first_index;
+    int base_vertex;
+    uint base_instance;
+};
+layout (std430, binding = 13) buffer DrawCommands
+{
+    DrawCommand commands[];
+};
+
+uniform int n_instances;
+// radius of the bounding sphere of the mesh around each instance position
+uniform float radius;
+uniform float viewport_height;
+// levels of detail, finest first, level l takes instances whose projected
+// radius in pixels is at most max_radius[l]
+uniform int n_levels;
+uniform int level_stride;
+uniform float max_radius[MAX_LEVELS];
+
+void main()
+{
+    int i = int(gl_GlobalInvocationID.x);
+    if (i >= n_instances)
+        return;
+    vec3 c = vec3(instances[3*i], instances[3*i+1], instances[3*i+2]);
+
+    // frustum planes extracted from the view-projection matrix, whose
+    // rows are the columns of the transpose
+    mat4 m = transpose(projection * view);
+    vec4 planes[6] = vec4[6](m[3] + m[0], m[3] - m[0],
+                             m[3] + m[1], m[3] - m[1],
+                             m[3] + m[2], m[3] - m[2]);
+    for (int k = 0; k < 6; ++k)
+    {
+        if (dot(planes[k].xyz, c) + planes[k].w < -radius * length(planes[k].xyz))
+            return;
+    }
+
+    // coarsest level whose error is below its bound at this projected size
+    float r = radius * projection[1][1] * .5f * viewport_height /
+              max(distance(camera_position, c), 1e-4f);
+    int level = 0;
+    for (int l = n_levels - 1; l > 0; --l)
+    {
+        if (r <= max_radius[l])
+        {
+            level = l;
+            break;
+        }
+    }
+    uint slot = atomicAdd(commands[level].instance_count, 1u);
+    visible_instances[level * level_stride + int(slot)] = vec4(c, 1.f);
+}
+)====="
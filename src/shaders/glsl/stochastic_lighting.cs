@@ -0,0 +1,240 @@
+R"=====(
+#version 430 core
+
+// GROUP_SIZE is inserted by shader::StochasticLighting
+layout (local_size_x = GROUP_SIZE, local_size_y = GROUP_SIZE) in;
+
+// SceneCamera, depth_buffer and normal_buffer are declared by DeferredLightingPass::GBUFFER_DECODE
+
+// struct of point light, std430 layout
+// position.w is the effective lighting radius and coef.w its square,
+// the other w components are padding
+struct PointLight
+{
+    vec4 position;
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
+    vec4 coef;
+};
+// all light sources in the scene
+layout (std430, binding = 1) buffer PointLights
+{
+    PointLight lights[];
+};
+// per work group sum of squared error, written by stage 2
+layout (std430, binding = 7) buffer ErrorSums
+{
+    float error_sums[];
+};
+
+// G-buffer generated by DeferredLightingPass
+// in stage 2, ambient_buffer holds the exact lighting result instead
+uniform sampler2D ambient_buffer;
+uniform sampler2D diffuse_buffer;
+uniform sampler2D specular_buffer;
+
+// lighting result
+layout (rgba16f, binding = 0) uniform image2D output_buffer;
+// reservoirs, (light index, sum of weights, number of samples seen, W)
+// history keeps the final reservoirs of the previous frame
+// and candidate keeps those of the current frame before spatial reuse
+layout (rgba32f, binding = 1) uniform image2D history_reservoirs;
+layout (rgba32f, binding = 2) uniform image2D candidate_reservoirs;
+// world position of each pixel in the previous frame
+layout (rgba32f, binding = 3) uniform image2D history_positions;
+
+// 0: candidate sampling and temporal reuse
+// 1: spatial reuse and shading
+// 2: error against the exact result
+uniform int stage;
+// actual number of lights to be sampled from
+uniform int n_lights;
+// number of lights drawn per pixel per frame
+uniform int n_candidates;
+// number of neighbour reservoirs merged in stage 1
+uniform int n_neighbours;
+// whether reservoirs of the previous frame are reused
+uniform bool temporal_reuse;
+uniform mat4 prev_view_projection;
+uniform int frame;
+
+uniform int show_only;
+
+shared float group_error[GROUP_SIZE*GROUP_SIZE];
+
+uint rng_state;
+uint pcg()
+{
+    rng_state = rng_state * 747796405u + 2891336453u;
+    uint word = ((rng_state >> ((rng_state >> 28u) + 4u)) ^ rng_state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+float rnd()
+{
+    return float(pcg() >> 8) / 16777216.f;
+}
+
+// unshadowed contribution of light i at a surface point
+vec3 contribution(uint i, vec3 P, vec3 N, vec3 V, vec3 diffuse, vec3 specular, float shininess)
+{
+    vec3 L = lights[i].position.xyz - P;
+    float dist2 = dot(L, L);
+    if (dist2 > lights[i].coef.w) return vec3(0.f);
+    float dist = sqrt(dist2);
+    vec4 coef = lights[i].coef;
+    float atten = 1.f / (coef.x + coef.y*dist + coef.z*dist2);
+
+    L /= dist;
+    vec3 R = reflect(-L, N);
+    float d = max(dot(N, L), 0.f);
+    float s = pow(max(dot(V, R), 0.f), shininess);
+    return (lights[i].ambient.rgb*diffuse + lights[i].diffuse.rgb*d*diffuse + lights[i].specular.rgb*s*specular) * atten;
+}
+
+// target function of resampling
+float luminance(vec3 c)
+{
+    return dot(c, vec3(.2126f, .7152f, .0722f));
+}
+
+// add a sample of weight w to reservoir r, keep it with probability w / sum
+void update(inout vec4 r, float index, float w, float m)
+{
+    r.y += w;
+    r.z += m;
+    if (w > 0.f && rnd() * r.y <= w)
+        r.x = index;
+}
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 size = imageSize(output_buffer);
+    bool inside = pixel.x < size.x && pixel.y < size.y;
+
+    if (stage == 2)
+    {
+        float err = 0.f;
+        if (inside)
+        {
+            vec3 a = clamp(imageLoad(output_buffer, pixel).rgb, 0.f, 1.f);
+            vec3 b = clamp(texelFetch(ambient_buffer, pixel, 0).rgb, 0.f, 1.f);
+            vec3 d = a - b;
+            err = dot(d, d);
+            if (show_only == 5) // heat map of the error
+                imageStore(output_buffer, pixel, vec4(vec3(sqrt(err)*4.f), 1.f));
+        }
+        group_error[gl_LocalInvocationIndex] = err;
+        barrier();
+        for (uint s = uint(GROUP_SIZE*GROUP_SIZE) / 2u; s > 0u; s >>= 1)
+        {
+            if (gl_LocalInvocationIndex < s)
+                group_error[gl_LocalInvocationIndex] += group_error[gl_LocalInvocationIndex + s];
+            barrier();
+        }
+        if (gl_LocalInvocationIndex == 0u)
+            error_sums[gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x] = group_error[0];
+        return;
+    }
+
+    if (!inside)
+        return;
+
+    rng_state = (uint(pixel.y) * uint(size.x) + uint(pixel.x)) * 9781u + uint(frame) * 6271u + uint(stage) * 26699u;
+
+    vec3 ambient = texelFetch(ambient_buffer, pixel, 0).rgb;
+    vec3 diffuse = texelFetch(diffuse_buffer, pixel, 0).rgb;
+    vec4 specular_tmp = texelFetch(specular_buffer, pixel, 0);
+    vec3 specular = specular_tmp.rgb;
+    float shininess = specular_tmp.a * 255.f;
+    vec3 position = gBufferPosition(pixel);
+    vec3 normal = gBufferNormal(pixel);
+    vec3 V = normalize(camera_position - position);
+    bool empty = dot(normal, normal) == 0.f;
+
+    if (stage == 0)
+    {
+        // resampled importance sampling of n_candidates uniformly drawn lights
+        vec4 r = vec4(0.f);
+        if (!empty && n_lights > 0)
+        {
+            for (int k = 0; k < n_candidates; ++k)
+            {
+                uint i = min(uint(rnd() * float(n_lights)), uint(n_lights - 1));
+                float p = luminance(contribution(i, position, normal, V, diffuse, specular, shininess));
+                update(r, float(i), p * float(n_lights), 1.f);
+            }
+
+            // merge the reservoir of the same surface point in the previous frame
+            vec4 prev = prev_view_projection * vec4(position, 1.f);
+            ivec2 prev_pixel = ivec2((prev.xy / prev.w * .5f + .5f) * vec2(size));
+            if (temporal_reuse && prev.w > 0.f &&
+                all(greaterThanEqual(prev_pixel, ivec2(0))) && all(lessThan(prev_pixel, size)))
+            {
+                vec3 prev_position = imageLoad(history_positions, prev_pixel).xyz;
+                vec4 h = imageLoad(history_reservoirs, prev_pixel);
+                if (h.z > 0.f && uint(h.x) < uint(n_lights) &&
+                    distance(prev_position, position) < .05f * length(camera_position - position))
+                {
+                    h.z = min(h.z, 20.f * float(n_candidates));
+                    float p = luminance(contribution(uint(h.x), position, normal, V, diffuse, specular, shininess));
+                    update(r, h.x, p * h.w * h.z, h.z);
+                }
+            }
+            float p = luminance(contribution(uint(r.x), position, normal, V, diffuse, specular, shininess));
+            r.w = p > 0.f ? r.y / (r.z * p) : 0.f;
+        }
+        imageStore(candidate_reservoirs, pixel, r);
+        return;
+    }
+
+    // stage 1, merge neighbour reservoirs on similar surfaces and shade
+    vec4 r = imageLoad(candidate_reservoirs, pixel);
+    if (!empty && n_lights > 0)
+    {
+        float p = luminance(contribution(uint(r.x), position, normal, V, diffuse, specular, shininess));
+        vec4 s = vec4(r.x, 0.f, 0.f, 0.f);
+        update(s, r.x, p * r.w * r.z, r.z);
+        float depth = length(camera_position - position);
+        for (int k = 0; k < n_neighbours; ++k)
+        {
+            float angle = rnd() * 6.2831853f;
+            float radius = 2.f + rnd() * 14.f;
+            ivec2 q = clamp(pixel + ivec2(vec2(cos(angle), sin(angle)) * radius), ivec2(0), size - 1);
+            vec3 q_position = gBufferPosition(q);
+            vec3 q_normal = gBufferNormal(q);
+            if (dot(q_normal, normal) < .9f ||
+                abs(length(camera_position - q_position) - depth) > .1f * depth)
+                continue;
+            vec4 n = imageLoad(candidate_reservoirs, q);
+            if (n.z == 0.f) continue;
+            p = luminance(contribution(uint(n.x), position, normal, V, diffuse, specular, shininess));
+            update(s, n.x, p * n.w * n.z, n.z);
+        }
+        p = luminance(contribution(uint(s.x), position, normal, V, diffuse, specular, shininess));
+        s.w = p > 0.f ? s.y / (s.z * p) : 0.f;
+        r = s;
+    }
+    imageStore(history_reservoirs, pixel, r);
+    imageStore(history_positions, pixel, vec4(position, 1.f));
+
+    if (show_only == 0)
+        imageStore(output_buffer, pixel, vec4(ambient, 1.f));
+    else if (show_only == 1)
+        imageStore(output_buffer, pixel, vec4(diffuse, 1.f));
+    else if (show_only == 2)
+        imageStore(output_buffer, pixel, vec4(specular, 1.f));
+    else if (show_only == 3)
+        imageStore(output_buffer, pixel, vec4(position, 1.f));
+    else if (show_only == 4)
+        imageStore(output_buffer, pixel, vec4(normal, 1.f));
+    else if (empty || r.w == 0.f)
+        imageStore(output_buffer, pixel, vec4(ambient, 1.f));
+    else
+    {
+        vec3 c = contribution(uint(r.x), position, normal, V, diffuse, specular, shininess) * r.w;
+        imageStore(output_buffer, pixel, vec4(c + ambient, 1.f));
+    }
+}
+)====="
@@ -0,0 +1,182 @@
+R"=====(
+#version 430 core
+
+// one work group shades one screen tile
+// TILE_SIZE and MAX_LIGHTS_PER_TILE are inserted by shader::TiledDeferredLighting
+layout (local_size_x = TILE_SIZE, local_size_y = TILE_SIZE) in;
+
+// SceneCamera, depth_buffer and normal_buffer are declared by DeferredLightingPass::GBUFFER_DECODE
+
+// struct of point light, std430 layout
+// position.w is the effective lighting radius and coef.w its square,
+// the other w components are padding
+struct PointLight
+{
+    vec4 position;
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
+    vec4 coef;
+};
+// all light sources in the scene
+layout (std430, binding = 1) buffer PointLights
+{
+    PointLight lights[];
+};
+// actual number of lights to be processed
+uniform int n_lights;
+// number of tiles that found more than MAX_LIGHTS_PER_TILE lights,
+// whose lights beyond the limit are dropped
+layout (std430, binding = 14) buffer OverflowTiles
+{
+    uint overflow_tiles;
+};
+
+// G-buffer generated by DeferredLightingPass
+uniform sampler2D ambient_buffer;
+uniform sampler2D diffuse_buffer;
+uniform sampler2D specular_buffer;
+
+// lighting result
+layout (rgba16f, binding = 0) uniform writeonly image2D output_buffer;
+
+uniform int show_only;
+
+// view-space depth range of the tile, stored as float bits
+// the bit pattern of a positive float keeps its order as an uint
+shared uint min_depth;
+shared uint max_depth;
+// indices of lights that may affect the tile
+shared uint tile_n_lights;
+shared uint tile_lights[MAX_LIGHTS_PER_TILE];
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 size = imageSize(output_buffer);
+    bool inside = pixel.x < size.x && pixel.y < size.y;
+
+    if (gl_LocalInvocationIndex == 0)
+    {
+        min_depth = 0xFFFFFFFFu;
+        max_depth = 0u;
+        tile_n_lights = 0u;
+    }
+    barrier();
+
+    // pick out attributes for current point being processed from frame buffers
+    vec3 ambient = texelFetch(ambient_buffer, pixel, 0).rgb;
+    vec3 diffuse = texelFetch(diffuse_buffer, pixel, 0).rgb;
+    vec4 specular_tmp = texelFetch(specular_buffer, pixel, 0).rgba;
+    vec3 specular = specular_tmp.rgb;
+    float shininess = specular_tmp.a * 255.f;
+    vec3 position = gBufferPosition(pixel);
+    vec3 normal = gBufferNormal(pixel);
+
+    // pixels without any geometry have a zero normal and take no part in culling
+    bool empty = !inside || dot(normal, normal) == 0.f;
+    if (!empty)
+    {
+        uint depth = floatBitsToUint(max(-(view * vec4(position, 1.f)).z, 0.f));
+        atomicMin(min_depth, depth);
+        atomicMax(max_depth, depth);
+    }
+    barrier();
+
+    float near_z = uintBitsToFloat(min_depth);
+    float far_z = uintBitsToFloat(max_depth);
+    if (min_depth <= max_depth)
+    {
+        // side planes of the tile frustum in view space,
+        // extracted from the rows of the projection matrix
+        vec2 ndc_min = vec2(gl_WorkGroupID.xy * uint(TILE_SIZE)) / vec2(size) * 2.f - 1.f;
+        vec2 ndc_max = vec2(min((gl_WorkGroupID.xy + 1u) * uint(TILE_SIZE), uvec2(size))) / vec2(size) * 2.f - 1.f;
+        vec4 row_x = vec4(projection[0][0], projection[1][0], projection[2][0], projection[3][0]);
+        vec4 row_y = vec4(projection[0][1], projection[1][1], projection[2][1], projection[3][1]);
+        vec4 row_w = vec4(projection[0][3], projection[1][3], projection[2][3], projection[3][3]);
+        vec4 planes[4];
+        planes[0] = row_x - ndc_min.x * row_w;
+        planes[1] = ndc_max.x * row_w - row_x;
+        planes[2] = row_y - ndc_min.y * row_w;
+        planes[3] = ndc_max.y * row_w - row_y;
+        for (int p = 0; p < 4; ++p)
+            planes[p] /= length(planes[p].xyz);
+
+        // each thread tests a strided subset of lights against the tile
+        for (uint i = gl_LocalInvocationIndex; i < uint(n_lights); i += uint(TILE_SIZE*TILE_SIZE))
+        {
+            vec3 c = (view * vec4(lights[i].position.xyz, 1.f)).xyz;
+            float r = lights[i].position.w; // effective lighting radius
+            bool visible = -c.z + r >= near_z && -c.z - r <= far_z;
+            for (int p = 0; p < 4 && visible; ++p)
+                visible = dot(planes[p].xyz, c) + planes[p].w >= -r;
+            if (visible)
+            {
+                uint idx = atomicAdd(tile_n_lights, 1u);
+                if (idx < uint(MAX_LIGHTS_PER_TILE))
+                    tile_lights[idx] = i;
+                else if (idx == uint(MAX_LIGHTS_PER_TILE))   // counted once per tile
+                    atomicAdd(overflow_tiles, 1u);
+            }
+        }
+    }
+    barrier();
+
+    if (!inside)
+        return;
+
+    // only the first MAX_LIGHTS_PER_TILE lights found were kept
+    uint n = min(tile_n_lights, uint(MAX_LIGHTS_PER_TILE));
+    bool overflow = tile_n_lights > uint(MAX_LIGHTS_PER_TILE);
+
+    if (show_only == 0)
+        imageStore(output_buffer, pixel, vec4(ambient, 1.f));
+    else if (show_only == 1)
+        imageStore(output_buffer, pixel, vec4(diffuse, 1.f));
+    else if (show_only == 2)
+        imageStore(output_buffer, pixel, vec4(specular, 1.f));
+    else if (show_only == 3)
+        imageStore(output_buffer, pixel, vec4(position, 1.f));
+    else if (show_only == 4)
+        imageStore(output_buffer, pixel, vec4(normal, 1.f));
+    else if (show_only == 5)    // heat map of the number of lights per tile, red if it overflows
+        imageStore(output_buffer, pixel, overflow ? vec4(1.f, 0.f, 0.f, 1.f) :
+                                                    vec4(vec3(float(n) / float(MAX_LIGHTS_PER_TILE)), 1.f));
+    if (show_only > -1 && show_only < 6)
+        return;
+    if (empty)
+    {
+        imageStore(output_buffer, pixel, vec4(ambient, 1.f));
+        return;
+    }
+
+    // compute lighting using only the lights that survived tile culling
+    vec3 V = normalize(camera_position - position);
+    vec3 c = vec3(0.f, 0.f, 0.f); // accumulated color
+    for (uint k = 0u; k < n; ++k)
+    {
+        uint i = tile_lights[k];
+        vec4 coef = lights[i].coef;
+
+        // light line, from point to light source
+        vec3 L = lights[i].position.xyz - position;
+        float dist2 = dot(L, L);
+        if (dist2 > coef.w) continue;
+        float dist = sqrt(dist2);
+
+        // attenuation coefficient
+        float atten = 1.f / (coef.x + coef.y*dist + coef.z*dist2);
+
+        // phong shading
+        L /= dist; // light line direction
+        vec3 R = reflect(-L, normal); // reflection light direction
+        float d = max(dot(normal, L), 0.f); // diffuse coefficient
+        float s = pow(max(dot(V, R), 0.f), shininess); // specular coefficient
+
+        // accumulate lighting color
+        c += (lights[i].ambient.rgb*diffuse + lights[i].diffuse.rgb*d*diffuse + lights[i].specular.rgb*s*specular) * atten;
+    }
+
+    imageStore(output_buffer, pixel, vec4(c + ambient, 1.f));
+}
+)====="
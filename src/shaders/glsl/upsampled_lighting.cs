@@ -0,0 +1,183 @@
+R"=====(
+#version 430 core
+
+// GROUP_SIZE is inserted by shader::UpsampledLighting
+layout (local_size_x = GROUP_SIZE, local_size_y = GROUP_SIZE) in;
+
+// SceneCamera, depth_buffer and normal_buffer are declared by DeferredLightingPass::GBUFFER_DECODE
+
+// struct of point light, std430 layout
+// position.w is the effective lighting radius and coef.w its square,
+// the other w components are padding
+struct PointLight
+{
+    vec4 position;
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
+    vec4 coef;
+};
+// all light sources in the scene
+layout (std430, binding = 1) buffer PointLights
+{
+    PointLight lights[];
+};
+// indices of lights that survived CPU frustum culling
+layout (std430, binding = 4) buffer VisibleLights
+{
+    uint visible_lights[];
+};
+// actual number of visible lights
+uniform int n_lights;
+
+// full-resolution G-buffer generated by DeferredLightingPass
+uniform sampler2D ambient_buffer;
+uniform sampler2D diffuse_buffer;
+uniform sampler2D specular_buffer;
+
+// full-resolution result
+layout (rgba16f, binding = 0) uniform image2D output_buffer;
+// reduced-resolution lighting without surface colors,
+// to be multiplied by the diffuse and specular color respectively
+layout (rgba16f, binding = 1) uniform image2D diffuse_lighting;
+layout (rgba16f, binding = 2) uniform image2D specular_lighting;
+
+// 0: lighting at reduced resolution, 1: upsampling and composition
+uniform int stage;
+// size ratio of the full-resolution buffers to the lighting buffers
+uniform int downsample;
+
+uniform int show_only;
+
+// full-resolution pixel whose G-buffer data a lighting pixel uses
+ivec2 sourcePixel(ivec2 p, ivec2 size)
+{
+    return min(p * downsample + downsample / 2, size - 1);
+}
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 size = imageSize(output_buffer);
+    ivec2 low_size = imageSize(diffuse_lighting);
+
+    if (stage == 0)
+    {
+        if (pixel.x >= low_size.x || pixel.y >= low_size.y)
+            return;
+
+        ivec2 src = sourcePixel(pixel, size);
+        vec4 specular_tmp = texelFetch(specular_buffer, src, 0).rgba;
+        float shininess = specular_tmp.a * 255.f;
+        vec3 position = gBufferPosition(src);
+        vec3 normal = gBufferNormal(src);
+
+        vec3 d_sum = vec3(0.f, 0.f, 0.f);
+        vec3 s_sum = vec3(0.f, 0.f, 0.f);
+        if (dot(normal, normal) != 0.f)
+        {
+            vec3 V = normalize(camera_position - position);
+            for (int k = 0; k < n_lights; ++k)
+            {
+                uint i = visible_lights[k];
+                vec4 coef = lights[i].coef;
+
+                // light line, from point to light source
+                vec3 L = lights[i].position.xyz - position;
+                float dist2 = dot(L, L);
+                if (dist2 > coef.w) continue;
+                float dist = sqrt(dist2);
+
+                // attenuation coefficient
+                float atten = 1.f / (coef.x + coef.y*dist + coef.z*dist2);
+
+                // phong shading
+                L /= dist; // light line direction
+                vec3 R = reflect(-L, normal); // reflection light direction
+                float d = max(dot(normal, L), 0.f); // diffuse coefficient
+                float s = pow(max(dot(V, R), 0.f), shininess); // specular coefficient
+
+                d_sum += (lights[i].ambient.rgb + lights[i].diffuse.rgb*d) * atten;
+                s_sum += lights[i].specular.rgb*s * atten;
+            }
+        }
+        imageStore(diffuse_lighting, pixel, vec4(d_sum, 1.f));
+        imageStore(specular_lighting, pixel, vec4(s_sum, 1.f));
+        return;
+    }
+
+    // stage 1, joint bilateral upsampling guided by full-resolution geometry
+    if (pixel.x >= size.x || pixel.y >= size.y)
+        return;
+
+    vec3 ambient = texelFetch(ambient_buffer, pixel, 0).rgb;
+    vec3 diffuse = texelFetch(diffuse_buffer, pixel, 0).rgb;
+    vec3 specular = texelFetch(specular_buffer, pixel, 0).rgb;
+    vec3 position = gBufferPosition(pixel);
+    vec3 normal = gBufferNormal(pixel);
+
+    if (show_only == 0)
+        imageStore(output_buffer, pixel, vec4(ambient, 1.f));
+    else if (show_only == 1)
+        imageStore(output_buffer, pixel, vec4(diffuse, 1.f));
+    else if (show_only == 2)
+        imageStore(output_buffer, pixel, vec4(specular, 1.f));
+    else if (show_only == 3)
+        imageStore(output_buffer, pixel, vec4(position, 1.f));
+    else if (show_only == 4)
+        imageStore(output_buffer, pixel, vec4(normal, 1.f));
+    if (show_only > -1 && show_only < 5)
+        return;
+    if (dot(normal, normal) == 0.f)
+    {
+        imageStore(output_buffer, pixel, vec4(show_only == 5 ? vec3(0.f) : ambient, 1.f));
+        return;
+    }
+
+    float depth = length(camera_position - position);
+    vec2 f = (vec2(pixel) + .5f) / float(downsample) - .5f;
+    ivec2 base = ivec2(floor(f));
+    vec2 t = f - vec2(base);
+
+    vec3 d_sum = vec3(0.f, 0.f, 0.f);
+    vec3 s_sum = vec3(0.f, 0.f, 0.f);
+    float w_sum = 0.f;
+    // tap on the most similar surface, used when all taps are rejected
+    ivec2 best = clamp(base, ivec2(0), low_size - 1);
+    float best_w = -1.f;
+    for (int k = 0; k < 4; ++k)
+    {
+        ivec2 o = ivec2(k & 1, k >> 1);
+        ivec2 q = clamp(base + o, ivec2(0), low_size - 1);
+        ivec2 src = sourcePixel(q, size);
+        vec3 q_position = gBufferPosition(src);
+        vec3 q_normal = gBufferNormal(src);
+        float w = pow(max(dot(normal, q_normal), 0.f), 16.f) *
+                  exp(-abs(length(camera_position - q_position) - depth) / (.02f * depth));
+        if (w > best_w)
+        {
+            best_w = w;
+            best = q;
+        }
+        w *= (o.x == 1 ? t.x : 1.f - t.x) * (o.y == 1 ? t.y : 1.f - t.y);
+        d_sum += imageLoad(diffuse_lighting, q).rgb * w;
+        s_sum += imageLoad(specular_lighting, q).rgb * w;
+        w_sum += w;
+    }
+    if (w_sum > 1e-4f)
+    {
+        d_sum /= w_sum;
+        s_sum /= w_sum;
+    }
+    else
+    {
+        d_sum = imageLoad(diffuse_lighting, best).rgb;
+        s_sum = imageLoad(specular_lighting, best).rgb;
+    }
+
+    if (show_only == 5)    // heat map of the weight rejected by the geometry guide
+        imageStore(output_buffer, pixel, vec4(vec3(1.f - min(w_sum, 1.f)), 1.f));
+    else
+        imageStore(output_buffer, pixel, vec4(diffuse*d_sum + specular*s_sum + ambient, 1.f));
+}
+)====="
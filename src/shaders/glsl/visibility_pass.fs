@@ -0,0 +1,17 @@
+R"=====(
+#version 420 core
+
+// TRIANGLE_BITS is inserted by shader::VisibilityPass
+
+// index of the current object in the object list of VisibilityResolve,
+// or of the first instance for instanced drawing
+uniform int object_id;
+flat in int instance;
+
+layout (location = 0) out uint id_buffer;
+
+void main()
+{
+    id_buffer = (uint(object_id + instance) << TRIANGLE_BITS) | uint(gl_PrimitiveID);
+}
+)====="
@@ -0,0 +1,58 @@
+R"=====(
+#version 420 core
+
+// the part of Material in deferred_lighting_pass.vs used for displacement
+struct Material
+{
+    sampler2D displace; // displacement mapping
+    float displace_scale; // displacement amplification coefficient, 0 for no displacement mapping
+    float displace_mid; // mid-point value for displacement mapping
+};
+
+layout (location = 0) in vec3 vertex_in;
+layout (location = 1) in vec2 tex_coords_in;
+layout (location = 2) in vec3 norm_in;
+// octahedral encoded norm_in, see deferred_lighting_pass.vs
+uniform bool packed_vertex;
+// per-instance translation, see deferred_lighting_pass.vs
+layout (location = 4) in vec3 instance_offset;
+
+uniform Material material;
+uniform mat4 model;
+
+// instances take consecutive object ids
+flat out int instance;
+
+// the global configuration of the scene camera
+layout (std140, binding = 0) uniform SceneCamera
+{
+    mat4 view;
+    mat4 projection;
+    vec3 camera_position;
+};
+
+// same to decodeOctahedral in deferred_lighting_pass.vs
+vec3 decodeOctahedral(vec2 e)
+{
+    vec3 n = vec3(e, 1.f - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.f);
+    n.xy += vec2(n.x >= 0.f ? -t : t, n.y >= 0.f ? -t : t);
+    return normalize(n);
+}
+
+void main()
+{
+    // same displacement as deferred_lighting_pass.vs,
+    // which the resolve pass repeats for the vertices of each pixel's triangle
+    vec3 vertex = vertex_in;
+    if (material.displace_scale != 0.f)
+    {
+        vec3 norm = packed_vertex ? decodeOctahedral(norm_in.xy) : norm_in;
+        vec3 dv = texture(material.displace, tex_coords_in).xyz;
+        float df = 0.30*dv.x + 0.59*dv.y + 0.11*dv.z;
+        vertex += (df - material.displace_mid) * material.displace_scale * norm;
+    }
+    instance = gl_InstanceID;
+    gl_Position = projection * view * vec4(vec3(model * vec4(vertex, 1.f)) + instance_offset, 1.f);
+}
+)====="
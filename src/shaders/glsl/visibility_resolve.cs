@@ -0,0 +1,224 @@
+R"=====(
+#version 430 core
+
+// GROUP_SIZE, TRIANGLE_BITS and MAX_MATERIALS are inserted by shader::VisibilityResolve
+layout (local_size_x = GROUP_SIZE, local_size_y = GROUP_SIZE) in;
+
+// the global configuration of the scene camera
+layout (std140, binding = 0) uniform SceneCamera
+{
+    mat4 view;
+    mat4 projection;
+    vec3 camera_position;
+    mat4 inv_view_projection; // inverse of projection * view
+};
+
+// struct of point light, std430 layout
+// position.w is the effective lighting radius and coef.w its square,
+// the other w components are padding
+struct PointLight
+{
+    vec4 position;
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
+    vec4 coef;
+};
+// all light sources in the scene
+layout (std430, binding = 1) buffer PointLights
+{
+    PointLight lights[];
+};
+// indices of lights that survived CPU frustum culling
+layout (std430, binding = 4) buffer VisibleLights
+{
+    uint visible_lights[];
+};
+// actual number of visible lights
+uniform int n_lights;
+
+// vertices of all meshes, texture coordinates are in the w components
+struct Vertex
+{
+    vec4 position_u;
+    vec4 normal_v;
+    vec4 tangent;
+};
+layout (std430, binding = 8) readonly buffer Vertices
+{
+    Vertex vertices[];
+};
+layout (std430, binding = 9) readonly buffer Indices
+{
+    uint indices[];
+};
+// objects indexed by the object ids in the visibility buffer
+struct Object
+{
+    mat4 model;
+    uint first_index;
+    uint base_vertex;
+    uint material;
+    uint pad;
+};
+layout (std430, binding = 10) readonly buffer Objects
+{
+    Object objects[];
+};
+
+// visibility buffer generated by VisibilityPass
+uniform usampler2D id_buffer;
+uniform sampler2D depth_buffer;
+
+// diffuse, normal, specular and displacement maps of each material
+uniform sampler2D material_maps[4*MAX_MATERIALS];
+uniform vec3 material_ambient[MAX_MATERIALS];
+uniform float material_shininess[MAX_MATERIALS];
+uniform float material_displace_scale[MAX_MATERIALS];
+uniform float material_displace_mid[MAX_MATERIALS];
+uniform vec3 global_ambient;
+
+layout (rgba16f, binding = 0) uniform writeonly image2D output_buffer;
+
+uniform int show_only;
+
+// sample a map of a material, the sampler array is only indexed by constants
+// as the material differs among pixels, the cases cover MAX_MATERIALS = 2
+vec4 materialMap(uint material, int map, vec2 uv, vec2 dx, vec2 dy)
+{
+    switch (int(material)*4 + map)
+    {
+        case 0: return textureGrad(material_maps[0], uv, dx, dy);
+        case 1: return textureGrad(material_maps[1], uv, dx, dy);
+        case 2: return textureGrad(material_maps[2], uv, dx, dy);
+        case 3: return textureGrad(material_maps[3], uv, dx, dy);
+        case 4: return textureGrad(material_maps[4], uv, dx, dy);
+        case 5: return textureGrad(material_maps[5], uv, dx, dy);
+        case 6: return textureGrad(material_maps[6], uv, dx, dy);
+        default: return textureGrad(material_maps[7], uv, dx, dy);
+    }
+}
+
+// barycentric coordinates of the intersection of the view ray through the
+// given pixel position with the plane of triangle p, not clamped to it
+vec3 barycentrics(vec2 pixel, vec2 size, vec3 p0, vec3 p1, vec3 p2)
+{
+    vec4 far = inv_view_projection * vec4(pixel / size * 2.f - 1.f, 1.f, 1.f);
+    vec3 dir = far.xyz / far.w - camera_position;
+    vec3 e1 = p1 - p0;
+    vec3 e2 = p2 - p0;
+    vec3 h = cross(dir, e2);
+    float f = 1.f / dot(e1, h);
+    vec3 s = camera_position - p0;
+    float u = f * dot(s, h);
+    float v = f * dot(dir, cross(s, e1));
+    return vec3(1.f - u - v, u, v);
+}
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 size = imageSize(output_buffer);
+    if (pixel.x >= size.x || pixel.y >= size.y)
+        return;
+
+    if (texelFetch(depth_buffer, pixel, 0).r == 1.f)
+    {
+        imageStore(output_buffer, pixel, vec4(0.f, 0.f, 0.f, 1.f));
+        return;
+    }
+    uint id = texelFetch(id_buffer, pixel, 0).r;
+    uint triangle = id & ((1u << TRIANGLE_BITS) - 1u);
+    Object object = objects[id >> TRIANGLE_BITS];
+    uint m = object.material;
+
+    // rebuild the triangle the same way as the vertex shader of VisibilityPass
+    mat3 norm_mat = transpose(inverse(mat3(object.model)));
+    vec3 p[3];
+    vec2 uv[3];
+    vec3 T[3];
+    vec3 B[3];
+    vec3 N[3];
+    for (int k = 0; k < 3; ++k)
+    {
+        Vertex vert = vertices[object.base_vertex + indices[object.first_index + 3u*triangle + uint(k)]];
+        vec3 vertex = vert.position_u.xyz;
+        vec3 norm = vert.normal_v.xyz;
+        uv[k] = vec2(vert.position_u.w, vert.normal_v.w);
+        if (material_displace_scale[m] != 0.f)
+        {
+            vec3 dv = materialMap(m, 3, uv[k], vec2(0.f), vec2(0.f)).xyz;
+            float df = 0.30*dv.x + 0.59*dv.y + 0.11*dv.z;
+            vertex += (df - material_displace_mid[m]) * material_displace_scale[m] * norm;
+        }
+        p[k] = vec3(object.model * vec4(vertex, 1.f));
+        N[k] = normalize(norm_mat * norm);
+        T[k] = normalize(norm_mat * vert.tangent.xyz);
+        T[k] = normalize(T[k] - dot(T[k], N[k])*N[k]);
+        B[k] = cross(N[k], T[k]);
+    }
+
+    // perspective-correct interpolation, and texture gradients from the
+    // neighbouring pixels' rays hitting the plane of the same triangle
+    vec2 f = vec2(pixel) + .5f;
+    vec3 b = barycentrics(f, vec2(size), p[0], p[1], p[2]);
+    vec3 bx = barycentrics(f + vec2(1.f, 0.f), vec2(size), p[0], p[1], p[2]);
+    vec3 by = barycentrics(f + vec2(0.f, 1.f), vec2(size), p[0], p[1], p[2]);
+    vec2 coords = b.x*uv[0] + b.y*uv[1] + b.z*uv[2];
+    vec2 dx = bx.x*uv[0] + bx.y*uv[1] + bx.z*uv[2] - coords;
+    vec2 dy = by.x*uv[0] + by.y*uv[1] + by.z*uv[2] - coords;
+    vec3 position = b.x*p[0] + b.y*p[1] + b.z*p[2];
+    mat3 TBN = mat3(b.x*T[0] + b.y*T[1] + b.z*T[2],
+                    b.x*B[0] + b.y*B[1] + b.z*B[2],
+                    b.x*N[0] + b.y*N[1] + b.z*N[2]);
+
+    // same material evaluation as deferred_lighting_pass.fs with normal mapping
+    vec3 normal = normalize(TBN * normalize(materialMap(m, 1, coords, dx, dy).rgb*2.f - 1.f));
+    vec3 diffuse = materialMap(m, 0, coords, dx, dy).rgb;
+    vec3 specular = materialMap(m, 2, coords, dx, dy).rgb;
+    float shininess = material_shininess[m];
+    vec3 ambient = global_ambient * diffuse * material_ambient[m];
+
+    if (show_only == 0)
+        imageStore(output_buffer, pixel, vec4(ambient, 1.f));
+    else if (show_only == 1)
+        imageStore(output_buffer, pixel, vec4(diffuse, 1.f));
+    else if (show_only == 2)
+        imageStore(output_buffer, pixel, vec4(specular, 1.f));
+    else if (show_only == 3)
+        imageStore(output_buffer, pixel, vec4(position, 1.f));
+    else if (show_only == 4)
+        imageStore(output_buffer, pixel, vec4(normal, 1.f));
+    else if (show_only == 5)    // triangle ids, hashed into colors
+    {
+        uint h = id * 2654435761u;
+        imageStore(output_buffer, pixel, vec4(vec3((h >> 24) & 255u, (h >> 16) & 255u, (h >> 8) & 255u) / 255.f, 1.f));
+    }
+    if (show_only > -1)
+        return;
+
+    // same lighting as deferred_lighting.fs
+    vec3 V = normalize(camera_position - position);
+    vec3 c = vec3(0.f, 0.f, 0.f);
+    for (int k = 0; k < n_lights; ++k)
+    {
+        uint i = visible_lights[k];
+        vec4 coef = lights[i].coef;
+
+        vec3 L = lights[i].position.xyz - position;
+        float dist2 = dot(L, L);
+        if (dist2 > coef.w) continue;
+        float dist = sqrt(dist2);
+
+        float atten = 1.f / (coef.x + coef.y*dist + coef.z*dist2);
+
+        L /= dist;
+        vec3 R = reflect(-L, normal);
+        float d = max(dot(normal, L), 0.f);
+        float s = pow(max(dot(V, R), 0.f), shininess);
+
+        c += (lights[i].ambient.xyz*diffuse + lights[i].diffuse.xyz*d*diffuse + lights[i].specular.xyz*s*specular) * atten;
+    }
+    imageStore(output_buffer, pixel, vec4(c + ambient, 1.f));
+}
+)====="
@@ -0,0 +1,90 @@
+#include "image_compare.hpp"
+
+#include <cmath>
+#include <limits>
+
+using namespace px;
+
+const char *shader::ImageCompare::COMPUTE_SHADER =
+#include "shaders/glsl/image_compare.cs"
+;
+const int shader::ImageCompare::GROUP_SIZE = 16;
+
+shader::ImageCompare::ImageCompare()
+    : Shader(), ssbo{0}, ssbo_size_{0}, n_groups_{0}, n_pixels_{0}, index_(0)
+{}
+
+shader::ImageCompare::~ImageCompare()
+{
+    glDeleteBuffers(2, ssbo);
+}
+
+void shader::ImageCompare::init()
+{
+    glDeleteBuffers(2, ssbo); ssbo[0] = 0; ssbo[1] = 0;
+    ssbo_size_[0] = 0; ssbo_size_[1] = 0;
+    n_groups_[0] = 0; n_groups_[1] = 0;
+    index_ = 0;
+
+    std::string tmp(COMPUTE_SHADER);
+    tmp.insert(tmp.find_first_of("c")+4,
+               "\n#define GROUP_SIZE " + std::to_string(GROUP_SIZE));
+    Shader::init(tmp.c_str());
+
+    glGenBuffers(2, ssbo);
+
+    Shader::activate(true);
+    set("image_a", 0);
+    set("image_b", 1);
+    Shader::activate(false);
+}
+
+void shader::ImageCompare::compare(DeferredLightingPass const &a, DeferredLightingPass const &b)
+{
+    if (a.bufferWidth() != b.bufferWidth() || a.bufferHeight() != b.bufferHeight())
+        error("Failed to compare images of different sizes");
+
+    auto groups_x = (a.bufferWidth() + GROUP_SIZE - 1) / GROUP_SIZE;
+    auto groups_y = (a.bufferHeight() + GROUP_SIZE - 1) / GROUP_SIZE;
+    n_groups_[index_] = static_cast<std::size_t>(groups_x*groups_y);
+    n_pixels_[index_] = static_cast<double>(a.bufferWidth()) * a.bufferHeight();
+    if (n_groups_[index_] > ssbo_size_[index_])
+    {
+        ssbo_size_[index_] = n_groups_[index_];
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo[index_]);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(float)*ssbo_size_[index_], nullptr, GL_STREAM_READ);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    Shader::activate(true);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, a.buffers[0]);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, b.buffers[0]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, ssbo[index_]);
+    glDispatchCompute(groups_x, groups_y, 1);
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    Shader::activate(false);
+
+    index_ = 1 - index_;
+}
+
+float shader::ImageCompare::previousMse()
+{
+    // the other buffer was written a frame ago and has been finished with
+    if (n_groups_[index_] == 0)
+        return 0.f;
+    error_sums_.resize(n_groups_[index_]);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo[index_]);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(float)*error_sums_.size(), error_sums_.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    auto sum = 0.0;
+    for (auto e : error_sums_)
+        sum += e;
+    return static_cast<float>(sum / (3.0 * n_pixels_[index_]));
+}
+
+float shader::ImageCompare::psnr(float mse)
+{
+    return mse > 0.f ? -10.f * std::log10(mse) : std::numeric_limits<float>::infinity();
+}
@@ -0,0 +1,48 @@
+#ifndef PX_CG_SHADERS_IMAGE_COMPARE_HPP
+#define PX_CG_SHADERS_IMAGE_COMPARE_HPP
+
+#include <vector>
+
+#include "shader.hpp"
+#include "deferred_lighting.hpp"
+
+namespace px { namespace shader
+{
+class ImageCompare;
+}}
+
+// Mean squared error between the lighting accumulated in the ambient buffers
+// of two G-buffers of the same size, computed by a compute shader and read
+// back to the CPU one call late. Colors are clamped into [0, 1].
+class px::shader::ImageCompare : public Shader
+{
+public:
+    static const char *COMPUTE_SHADER;
+
+    static const int GROUP_SIZE;
+
+public:
+    ImageCompare();
+    ~ImageCompare() override;
+
+    void init();
+    // compare a and b into one of two error buffers, alternating on each call
+    void compare(DeferredLightingPass const &a, DeferredLightingPass const &b);
+    // mean squared error of the compare() call before the latest one, read
+    // without waiting for the latest dispatch; 0 if there was none
+    float previousMse();
+    // peak signal-to-noise ratio in dB of the given mean squared error
+    static float psnr(float mse);
+
+protected:
+    unsigned int ssbo[2];
+private:
+    std::size_t ssbo_size_[2];
+    // number of work groups and pixels of the comparison in each buffer
+    std::size_t n_groups_[2];
+    double n_pixels_[2];
+    int index_;
+    std::vector<float> error_sums_;
+};
+
+#endif // PX_CG_SHADERS_IMAGE_COMPARE_HPP
@@ -0,0 +1,106 @@
+#include "light_tree_lighting.hpp"
+
+#include <algorithm>
+
+using namespace px;
+
+const char *shader::LightTreeLighting::VERTEX_SHADER =
+#include "shaders/glsl/deferred_lighting.vs"
+;
+const char *shader::LightTreeLighting::FRAGMENT_SHADER =
+#include "shaders/glsl/light_tree_lighting.fs"
+;
+
+shader::LightTreeLighting::LightTreeLighting()
+    : Shader(), vao(0), vbo(0), ssbo{0},
+      node_buffer_size_(0), order_buffer_size_(0)
+{}
+
+shader::LightTreeLighting::~LightTreeLighting()
+{
+    glDeleteVertexArrays(1, &vao);
+    glDeleteBuffers(1, &vbo);
+    glDeleteBuffers(2, ssbo);
+}
+
+void shader::LightTreeLighting::init()
+{
+    constexpr static float screen_vertices[] =
+            {   //  x       y     u    v
+                    -1.f,  1.f, 0.f, 1.f,
+                     1.f,  1.f, 1.f, 1.f,
+                    -1.f, -1.f, 0.f, 0.f,
+                     1.f, -1.f, 1.f, 0.f
+            };
+
+    glDeleteVertexArrays(1, &vao); vao = 0;
+    glDeleteBuffers(1, &vbo); vbo = 0;
+    glDeleteBuffers(2, ssbo); ssbo[0] = 0; ssbo[1] = 0;
+    node_buffer_size_ = 0; order_buffer_size_ = 0;
+
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &vbo);
+    glGenBuffers(2, ssbo);
+
+    Shader::init(VERTEX_SHADER, DeferredLightingPass::withGBufferDecode(FRAGMENT_SHADER).c_str());
+
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(float)*4, nullptr);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(float)*4, (void *)(sizeof(float)*2));
+    glBufferData(GL_ARRAY_BUFFER, sizeof(screen_vertices), screen_vertices, GL_STATIC_DRAW);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    Shader::activate(true);
+    set("ambient_buffer", 0);
+    set("diffuse_buffer", 1);
+    set("specular_buffer", 2);
+    set("depth_buffer", 3);
+    set("normal_buffer", 4);
+    set("show_only", -1);
+    set("cut_threshold", 0.f);
+    glBindFragDataLocation(programID(), 0, "color");
+    Shader::activate(false);
+}
+
+void shader::LightTreeLighting::activate(bool enable)
+{
+    if (enable)
+    {
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    }
+    Shader::activate(enable);
+}
+
+void shader::LightTreeLighting::setTree(LightTree const &tree)
+{
+#define __SSBO_UPLOAD_HELPER(i, binding, data, capacity)                                    \
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo[i]);                                        \
+    if (data.size() > capacity || capacity == 0)                                            \
+    {                                                                                       \
+        capacity = std::max<std::size_t>(1, data.size() + data.size() / 2);                 \
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(data[0])*capacity, nullptr,           \
+                     GL_STREAM_DRAW);                                                       \
+    }                                                                                       \
+    if (!data.empty())                                                                      \
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(data[0])*data.size(),           \
+                        data.data());                                                       \
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, ssbo[i]);
+
+    __SSBO_UPLOAD_HELPER(0, 5, tree.nodes(), node_buffer_size_)
+    __SSBO_UPLOAD_HELPER(1, 6, tree.order(), order_buffer_size_)
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+#undef __SSBO_UPLOAD_HELPER
+}
+
+void shader::LightTreeLighting::render(DeferredLightingPass &pass_shader)
+{
+    glBindVertexArray(vao);
+    pass_shader.activateBuffers();
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    glBindVertexArray(0);
+}
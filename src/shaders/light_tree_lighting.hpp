@@ -0,0 +1,46 @@
+#ifndef PX_CG_SHADERS_LIGHT_TREE_LIGHTING_HPP
+#define PX_CG_SHADERS_LIGHT_TREE_LIGHTING_HPP
+
+#include "shader.hpp"
+#include "deferred_lighting.hpp"
+#include "util/light_tree.hpp"
+
+namespace px { namespace shader
+{
+class LightTreeLighting;
+}}
+
+// Deferred shading through a lightcuts-style light tree.
+// Nodes of LightTree are uploaded into the shader storage buffer bound at
+// binding point 5 and the light order into the one at binding point 6.
+// Each pixel walks the tree, skips nodes out of reach and shades a node
+// by its representative light when the node is small compared with its
+// distance, which is controlled by the cut_threshold uniform.
+// Lights are read from the shader storage buffer bound at binding point 1.
+class px::shader::LightTreeLighting : public Shader
+{
+public:
+    static const char *VERTEX_SHADER;
+    static const char *FRAGMENT_SHADER;
+
+public:
+    LightTreeLighting();
+    ~LightTreeLighting() override;
+
+    void init();
+    // upload the light tree, call before render
+    void setTree(LightTree const &tree);
+    // shade the G-buffer in pass_shader onto the screen
+    void render(DeferredLightingPass &pass_shader);
+
+    void activate(bool enable) override;
+protected:
+    unsigned int vao;
+    unsigned int vbo;
+    unsigned int ssbo[2];
+private:
+    std::size_t node_buffer_size_;
+    std::size_t order_buffer_size_;
+};
+
+#endif // PX_CG_SHADERS_LIGHT_TREE_LIGHTING_HPP
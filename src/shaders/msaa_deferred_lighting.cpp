@@ -0,0 +1,156 @@
+#include "msaa_deferred_lighting.hpp"
+
+using namespace px;
+
+const char *shader::MsaaDeferredLighting::VERTEX_SHADER =
+#include "shaders/glsl/deferred_lighting.vs"
+;
+const char *shader::MsaaDeferredLighting::FRAGMENT_SHADER =
+#include "shaders/glsl/msaa_deferred_lighting.fs"
+;
+
+shader::MsaaDeferredLighting::MsaaDeferredLighting()
+    : Shader(), vao(0), vbo(0), fbo(0), output_buffer(0), stencil_buffer(0), query(0),
+      buffer_width_(0), buffer_height_(0), edge_fraction_(0.f), query_issued_(false)
+{}
+
+shader::MsaaDeferredLighting::~MsaaDeferredLighting()
+{
+    glDeleteVertexArrays(1, &vao);
+    glDeleteBuffers(1, &vbo);
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteTextures(1, &output_buffer);
+    glDeleteRenderbuffers(1, &stencil_buffer);
+    glDeleteQueries(1, &query);
+}
+
+void shader::MsaaDeferredLighting::init()
+{
+    constexpr static float screen_vertices[] =
+            {   //  x       y     u    v
+                    -1.f,  1.f, 0.f, 1.f,
+                     1.f,  1.f, 1.f, 1.f,
+                    -1.f, -1.f, 0.f, 0.f,
+                     1.f, -1.f, 1.f, 0.f
+            };
+
+    glDeleteVertexArrays(1, &vao); vao = 0;
+    glDeleteBuffers(1, &vbo); vbo = 0;
+    glDeleteFramebuffers(1, &fbo); fbo = 0;
+    glDeleteTextures(1, &output_buffer); output_buffer = 0;
+    glDeleteRenderbuffers(1, &stencil_buffer); stencil_buffer = 0;
+    glDeleteQueries(1, &query); query = 0;
+    query_issued_ = false;
+    edge_fraction_ = 0.f;
+
+    Shader::init(VERTEX_SHADER, DeferredLightingPass::withGBufferDecode(FRAGMENT_SHADER, "\n#define GBUFFER_MULTISAMPLE").c_str());
+
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &vbo);
+    glGenFramebuffers(1, &fbo);
+    glGenTextures(1, &output_buffer);
+    glGenRenderbuffers(1, &stencil_buffer);
+    glGenQueries(1, &query);
+
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(float)*4, nullptr);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(float)*4, (void *)(sizeof(float)*2));
+    glBufferData(GL_ARRAY_BUFFER, sizeof(screen_vertices), screen_vertices, GL_STATIC_DRAW);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    Shader::activate(true);
+    set("ambient_buffer", 0);
+    set("diffuse_buffer", 1);
+    set("specular_buffer", 2);
+    set("depth_buffer", 3);
+    set("normal_buffer", 4);
+    set("show_only", -1);
+    glBindFragDataLocation(programID(), 0, "color");
+    Shader::activate(false);
+
+    if (buffer_width_ != 0 && buffer_height_ != 0)
+        setBufferSize(buffer_width_, buffer_height_);
+}
+
+void shader::MsaaDeferredLighting::render(int n_lights, DeferredLightingPass &pass_shader)
+{
+    // the query of the last frame has had a whole frame to finish
+    if (query_issued_)
+    {
+        GLuint64 n_edges;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &n_edges);
+        edge_fraction_ = static_cast<float>(n_edges) / (buffer_width_ * buffer_height_);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glClear(GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_STENCIL_TEST);
+
+    glBindVertexArray(vao);
+    pass_shader.activateBuffers();
+    set("samples", pass_shader.samples());
+    set("n_lights", n_lights);
+
+    // mark edge pixels, non-edge pixels are discarded
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glStencilFunc(GL_ALWAYS, 1, 0xFF);
+    glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+    set("stage", 0);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+    glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+    glStencilFunc(GL_EQUAL, 0, 0xFF);
+    set("stage", 1);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+    glStencilFunc(GL_EQUAL, 1, 0xFF);
+    set("stage", 2);
+    glBeginQuery(GL_SAMPLES_PASSED, query);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    glEndQuery(GL_SAMPLES_PASSED);
+    query_issued_ = true;
+
+    glBindVertexArray(0);
+    glDisable(GL_STENCIL_TEST);
+    glEnable(GL_DEPTH_TEST);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0, 0, buffer_width_, buffer_height_,
+                      0, 0, buffer_width_, buffer_height_,
+                      GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void shader::MsaaDeferredLighting::setBufferSize(int width, int height)
+{
+    buffer_width_ = width;
+    buffer_height_ = height;
+
+    if (fbo == 0)
+        return;
+
+    glBindTexture(GL_TEXTURE_2D, output_buffer);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindRenderbuffer(GL_RENDERBUFFER, stencil_buffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, output_buffer, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, stencil_buffer);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        error("Failed to generate frame buffer for shader::MsaaDeferredLighting");
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
@@ -0,0 +1,56 @@
+#ifndef PX_CG_SHADERS_MSAA_DEFERRED_LIGHTING_HPP
+#define PX_CG_SHADERS_MSAA_DEFERRED_LIGHTING_HPP
+
+#include "shader.hpp"
+#include "deferred_lighting.hpp"
+
+namespace px { namespace shader
+{
+class MsaaDeferredLighting;
+}}
+
+// Deferred lighting of a multisampled G-buffer, see DeferredLightingPass::samples.
+// Three full-screen passes share one fragment shader:
+//   edge detection  marks pixels whose samples differ in depth or normal,
+//                   or are partially covered, by stencil 1
+//   flat pixels     stencil 0, lit once with the data of sample 0
+//   edge pixels     stencil 1, lit for every sample and averaged
+// so that per-sample shading is only paid where antialiasing needs it.
+// Visible lights are read from the light storage buffer at binding point 1
+// through the index buffer at binding point 4.
+class px::shader::MsaaDeferredLighting : public Shader
+{
+public:
+    static const char *VERTEX_SHADER;
+    static const char *FRAGMENT_SHADER;
+
+public:
+    MsaaDeferredLighting();
+    ~MsaaDeferredLighting() override;
+
+    void init();
+    // shade the multisampled G-buffer in pass_shader with the first n_lights
+    // visible lights and put the resolved result on the screen
+    void render(int n_lights, DeferredLightingPass &pass_shader);
+
+    // set framebuffer size, call after init before use
+    void setBufferSize(int width, int height);
+
+    // fraction of pixels lit per sample, measured one frame late
+    inline float edgeFraction() const noexcept { return edge_fraction_; }
+
+protected:
+    unsigned int vao;
+    unsigned int vbo;
+    unsigned int fbo;
+    unsigned int output_buffer;
+    unsigned int stencil_buffer;
+    unsigned int query;
+private:
+    int buffer_width_;
+    int buffer_height_;
+    float edge_fraction_;
+    bool query_issued_;
+};
+
+#endif // PX_CG_SHADERS_MSAA_DEFERRED_LIGHTING_HPP
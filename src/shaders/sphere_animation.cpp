@@ -0,0 +1,38 @@
+#include "sphere_animation.hpp"
+
+using namespace px;
+
+const char *shader::SphereAnimation::COMPUTE_SHADER =
+#include "shaders/glsl/sphere_animation.cs"
+;
+const int shader::SphereAnimation::GROUP_SIZE = 256;
+
+shader::SphereAnimation::SphereAnimation()
+    : Shader(), frame_(0)
+{}
+
+void shader::SphereAnimation::init()
+{
+    frame_ = 0;
+
+    std::string tmp(COMPUTE_SHADER);
+    tmp.insert(tmp.find_first_of("c")+4,
+               "\n#define GROUP_SIZE " + std::to_string(GROUP_SIZE));
+    Shader::init(tmp.c_str());
+}
+
+void shader::SphereAnimation::animate(unsigned int instance_buffer, unsigned int speed_buffer, int n_instances,
+                                      float avg_height, float dt)
+{
+    Shader::activate(true);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 11, instance_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 15, speed_buffer);
+    set("n_instances", n_instances);
+    set("avg_height", avg_height);
+    set("dt", dt);
+    set("frame", frame_++);
+    glDispatchCompute((n_instances + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+    // read by the culling dispatch and possibly read back by the CPU
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    Shader::activate(false);
+}
@@ -0,0 +1,38 @@
+#ifndef PX_CG_SHADERS_SPHERE_ANIMATION_HPP
+#define PX_CG_SHADERS_SPHERE_ANIMATION_HPP
+
+#include "shader.hpp"
+
+namespace px { namespace shader
+{
+class SphereAnimation;
+}}
+
+// Vertical bouncing of mesh instances on the GPU using a compute shader,
+// the same motion as scene::DeferredRenderBenchmark::Spheres::update.
+// Instance positions, tightly packed vec3, are moved in place in a vertex
+// buffer bound as storage buffer at binding point 11, and their speeds are
+// kept in a float buffer at binding point 15, such that GPU-driven rendering
+// never uploads per-instance data.
+class px::shader::SphereAnimation : public Shader
+{
+public:
+    static const char *COMPUTE_SHADER;
+
+    static const int GROUP_SIZE;
+
+public:
+    SphereAnimation();
+
+    void init();
+    // move n_instances instances in instance_buffer with the speeds in
+    // speed_buffer by a time step of dt, bouncing within half a unit
+    // around avg_height
+    void animate(unsigned int instance_buffer, unsigned int speed_buffer, int n_instances,
+                 float avg_height, float dt);
+
+private:
+    int frame_;
+};
+
+#endif // PX_CG_SHADERS_SPHERE_ANIMATION_HPP
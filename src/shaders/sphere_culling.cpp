@@ -0,0 +1,132 @@
+#include "sphere_culling.hpp"
+
+#include <algorithm>
+
+using namespace px;
+
+const char *shader::SphereCulling::COMPUTE_SHADER =
+#include "shaders/glsl/sphere_culling.cs"
+;
+const int shader::SphereCulling::GROUP_SIZE = 256;
+const int shader::SphereCulling::MAX_LEVELS = 4;
+
+shader::SphereCulling::SphereCulling()
+    : Shader(), ssbo{0}, readback{0}, capacity_(0), n_levels_(0), visible_count_(0),
+      readback_fences_{nullptr}, readback_levels_{0}, readback_index_(0)
+{}
+
+shader::SphereCulling::~SphereCulling()
+{
+    glDeleteBuffers(2, ssbo);
+    glDeleteBuffers(2, readback);
+    for (auto f : readback_fences_)
+        if (f) glDeleteSync(f);
+}
+
+void shader::SphereCulling::init()
+{
+    glDeleteBuffers(2, ssbo); ssbo[0] = 0; ssbo[1] = 0;
+    glDeleteBuffers(2, readback); readback[0] = 0; readback[1] = 0;
+    for (auto &f : readback_fences_)
+    {
+        if (f) glDeleteSync(f);
+        f = nullptr;
+    }
+    capacity_ = 0;
+    n_levels_ = 0;
+    visible_count_ = 0;
+    readback_index_ = 0;
+
+    std::string tmp(COMPUTE_SHADER);
+    tmp.insert(tmp.find_first_of("c")+4,
+               "\n#define GROUP_SIZE " + std::to_string(GROUP_SIZE) +
+               "\n#define MAX_LEVELS " + std::to_string(MAX_LEVELS));
+    Shader::init(tmp.c_str());
+
+    glGenBuffers(2, ssbo);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, ssbo[1]);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawCommand)*MAX_LEVELS, nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glGenBuffers(2, readback);
+    for (auto b : readback)
+    {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, b);
+        glBufferData(GL_COPY_WRITE_BUFFER, sizeof(DrawCommand)*MAX_LEVELS, nullptr, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void shader::SphereCulling::cull(unsigned int instance_buffer, int n_instances, float radius,
+                                 int viewport_height,
+                                 DrawCommand const *levels, const float *max_radius, int n_levels)
+{
+    if (n_levels < 1 || n_levels > MAX_LEVELS)
+        error("Invalid number of levels of detail " + std::to_string(n_levels) + " for shader::SphereCulling");
+
+    // every level has room for all instances
+    if (static_cast<std::size_t>(n_instances) > capacity_)
+    {
+        capacity_ = static_cast<std::size_t>(n_instances);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo[0]);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(float)*4*capacity_*MAX_LEVELS, nullptr, GL_DYNAMIC_COPY);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    // the only data going through the CPU, a few commands reset before culling
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, ssbo[1]);
+    n_levels_ = n_levels;
+    commands_.assign(levels, levels + n_levels);
+    for (auto l = 0; l < n_levels; ++l)
+    {
+        commands_[l].instance_count = 0;
+        commands_[l].base_instance = static_cast<unsigned int>(l * capacity_);
+    }
+    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(DrawCommand)*n_levels, commands_.data());
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    Shader::activate(true);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 11, instance_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 12, ssbo[0]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 13, ssbo[1]);
+    set("n_instances", n_instances);
+    set("radius", radius);
+    set("viewport_height", static_cast<float>(viewport_height));
+    set("n_levels", n_levels);
+    set("level_stride", static_cast<int>(capacity_));
+    for (auto l = 0; l < n_levels; ++l)
+        set("max_radius[" + std::to_string(l) + "]", max_radius[l]);
+    glDispatchCompute((n_instances + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    Shader::activate(false);
+
+    // copy the counted commands on the GPU, dropping a copy never read back
+    auto &fence = readback_fences_[readback_index_];
+    if (fence) glDeleteSync(fence);
+    glBindBuffer(GL_COPY_READ_BUFFER, ssbo[1]);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, readback[readback_index_]);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(DrawCommand)*n_levels);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    readback_levels_[readback_index_] = n_levels;
+    readback_index_ = 1 - readback_index_;
+
+    // read the copy of the previous frame only if the GPU has finished it
+    auto &last = readback_fences_[readback_index_];
+    if (last == nullptr)
+        return;
+    auto state = glClientWaitSync(last, 0, 0);
+    if (state == GL_ALREADY_SIGNALED || state == GL_CONDITION_SATISFIED)
+    {
+        // commands_ has been uploaded and is free to take the copy
+        commands_.resize(readback_levels_[readback_index_]);
+        glBindBuffer(GL_COPY_READ_BUFFER, readback[readback_index_]);
+        glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(DrawCommand)*commands_.size(), commands_.data());
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        visible_count_ = 0;
+        for (auto const &c : commands_)
+            visible_count_ += static_cast<int>(c.instance_count);
+        glDeleteSync(last);
+        last = nullptr;
+    }
+}
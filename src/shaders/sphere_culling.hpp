@@ -0,0 +1,75 @@
+#ifndef PX_CG_SHADERS_SPHERE_CULLING_HPP
+#define PX_CG_SHADERS_SPHERE_CULLING_HPP
+
+#include <vector>
+
+#include "shader.hpp"
+
+namespace px { namespace shader
+{
+class SphereCulling;
+}}
+
+// Frustum culling of mesh instances on the GPU using a compute shader.
+// Instance positions are read from a vertex buffer bound as storage buffer
+// at binding point 11. Each survivor picks a level of detail by its
+// projected radius in pixels, and is compacted into the region of that level
+// in visibleBuffer(), one vec4 per instance, and counted in the instance
+// count of the level's indirect draw command in commandBuffer(), bound at
+// binding points 12 and 13, so that the instances are drawn by one
+// glMultiDrawElementsIndirect without the CPU touching any per-instance data.
+class px::shader::SphereCulling : public Shader
+{
+public:
+    static const char *COMPUTE_SHADER;
+
+    static const int GROUP_SIZE;
+    static const int MAX_LEVELS;
+
+    // indirect draw command, as read by glMultiDrawElementsIndirect
+    struct DrawCommand
+    {
+        unsigned int count;
+        unsigned int instance_count;
+        unsigned int first_index;
+        int base_vertex;
+        unsigned int base_instance;
+    };
+
+public:
+    SphereCulling();
+    ~SphereCulling() override;
+
+    void init();
+    // cull n_instances instances with positions in instance_buffer, each
+    // enclosed by a sphere of the given radius, on a viewport of the given
+    // height in pixels; level l of n_levels, finest first, draws the indices
+    // [first_index, first_index + count) of levels[l] and takes instances of
+    // projected radius in pixels up to max_radius[l]
+    void cull(unsigned int instance_buffer, int n_instances, float radius, int viewport_height,
+              DrawCommand const *levels, const float *max_radius, int n_levels);
+
+    inline unsigned int commandBuffer() const noexcept { return ssbo[1]; }
+    inline unsigned int visibleBuffer() const noexcept { return ssbo[0]; }
+    // number of commands in commandBuffer(), one per level of detail
+    inline int levelCount() const noexcept { return n_levels_; }
+    // number of survivors of the latest cull() call the GPU has finished,
+    // usually one frame late, read back without waiting for the GPU
+    inline int visibleCount() const noexcept { return visible_count_; }
+
+protected:
+    unsigned int ssbo[2];
+    // copies of the commands, alternating between frames, each read back
+    // once its fence has been signaled
+    unsigned int readback[2];
+private:
+    std::size_t capacity_;
+    int n_levels_;
+    int visible_count_;
+    std::vector<DrawCommand> commands_;
+    GLsync readback_fences_[2];
+    int readback_levels_[2];
+    int readback_index_;
+};
+
+#endif // PX_CG_SHADERS_SPHERE_CULLING_HPP
@@ -0,0 +1,161 @@
+#include "stochastic_lighting.hpp"
+
+#include <cmath>
+#include <limits>
+
+using namespace px;
+
+const char *shader::StochasticLighting::COMPUTE_SHADER =
+#include "shaders/glsl/stochastic_lighting.cs"
+;
+const int shader::StochasticLighting::GROUP_SIZE = 16;
+const int shader::StochasticLighting::N_CANDIDATES = 16;
+const int shader::StochasticLighting::N_NEIGHBOURS = 4;
+
+shader::StochasticLighting::StochasticLighting()
+    : Shader(), fbo(0), output_buffer(0), reservoirs{0}, history_positions(0), ssbo(0),
+      buffer_width_(0), buffer_height_(0), frame_(0), has_history_(false),
+      rmse_(0.f), psnr_(0.f)
+{}
+
+shader::StochasticLighting::~StochasticLighting()
+{
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteTextures(1, &output_buffer);
+    glDeleteTextures(2, reservoirs);
+    glDeleteTextures(1, &history_positions);
+    glDeleteBuffers(1, &ssbo);
+}
+
+void shader::StochasticLighting::init()
+{
+    glDeleteFramebuffers(1, &fbo); fbo = 0;
+    glDeleteTextures(1, &output_buffer); output_buffer = 0;
+    glDeleteTextures(2, reservoirs); reservoirs[0] = 0; reservoirs[1] = 0;
+    glDeleteTextures(1, &history_positions); history_positions = 0;
+    glDeleteBuffers(1, &ssbo); ssbo = 0;
+
+    Shader::init(DeferredLightingPass::withGBufferDecode(COMPUTE_SHADER,
+            "\n#define GROUP_SIZE " + std::to_string(GROUP_SIZE)).c_str());
+
+    glGenFramebuffers(1, &fbo);
+    glGenTextures(1, &output_buffer);
+    glGenTextures(2, reservoirs);
+    glGenTextures(1, &history_positions);
+    glGenBuffers(1, &ssbo);
+
+    Shader::activate(true);
+    set("ambient_buffer", 0);
+    set("diffuse_buffer", 1);
+    set("specular_buffer", 2);
+    set("depth_buffer", 3);
+    set("normal_buffer", 4);
+    set("show_only", -1);
+    set("n_candidates", N_CANDIDATES);
+    set("n_neighbours", N_NEIGHBOURS);
+    Shader::activate(false);
+
+    if (buffer_width_ != 0 && buffer_height_ != 0)
+        setBufferSize(buffer_width_, buffer_height_);
+}
+
+void shader::StochasticLighting::render(int n_lights, glm::mat4 const &view_projection,
+                                        DeferredLightingPass &pass_shader)
+{
+    auto groups_x = (buffer_width_ + GROUP_SIZE - 1) / GROUP_SIZE;
+    auto groups_y = (buffer_height_ + GROUP_SIZE - 1) / GROUP_SIZE;
+
+    pass_shader.activateBuffers();
+    glBindImageTexture(0, output_buffer, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA16F);
+    glBindImageTexture(1, reservoirs[0], 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+    glBindImageTexture(2, reservoirs[1], 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+    glBindImageTexture(3, history_positions, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+    set("n_lights", n_lights);
+    set("frame", frame_++);
+    set("temporal_reuse", has_history_ ? 1 : 0);
+    set("prev_view_projection", prev_view_projection_);
+
+    set("stage", 0);
+    glDispatchCompute(groups_x, groups_y, 1);
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    set("stage", 1);
+    glDispatchCompute(groups_x, groups_y, 1);
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT);
+
+    prev_view_projection_ = view_projection;
+    has_history_ = true;
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0, 0, buffer_width_, buffer_height_,
+                      0, 0, buffer_width_, buffer_height_,
+                      GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+}
+
+void shader::StochasticLighting::compare(DeferredLightingPass &pass_shader)
+{
+    auto groups_x = (buffer_width_ + GROUP_SIZE - 1) / GROUP_SIZE;
+    auto groups_y = (buffer_height_ + GROUP_SIZE - 1) / GROUP_SIZE;
+
+    pass_shader.activateBuffers();
+    glBindImageTexture(0, output_buffer, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA16F);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, ssbo);
+    set("stage", 2);
+    glDispatchCompute(groups_x, groups_y, 1);
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT);
+
+    // the read back waits for the GPU, only done when the metric is asked for
+    error_sums_.resize(groups_x*groups_y);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(float)*error_sums_.size(), error_sums_.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    auto sum = 0.0;
+    for (auto e : error_sums_)
+        sum += e;
+    auto mse = sum / (3.0 * buffer_width_ * buffer_height_);
+    rmse_ = static_cast<float>(std::sqrt(mse));
+    psnr_ = mse > 0.0 ? static_cast<float>(-10.0 * std::log10(mse)) : std::numeric_limits<float>::infinity();
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0, 0, buffer_width_, buffer_height_,
+                      0, 0, buffer_width_, buffer_height_,
+                      GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+}
+
+void shader::StochasticLighting::setBufferSize(int width, int height)
+{
+    buffer_width_ = width;
+    buffer_height_ = height;
+    has_history_ = false;
+
+    if (fbo == 0)
+        return;
+
+#define __TEXTURE_CONFIG_HELPER(tex, format)                                        \
+    glBindTexture(GL_TEXTURE_2D, tex);                                              \
+    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, GL_RGBA, GL_FLOAT, nullptr); \
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);              \
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    __TEXTURE_CONFIG_HELPER(output_buffer, GL_RGBA16F)
+    __TEXTURE_CONFIG_HELPER(reservoirs[0], GL_RGBA32F)
+    __TEXTURE_CONFIG_HELPER(reservoirs[1], GL_RGBA32F)
+    __TEXTURE_CONFIG_HELPER(history_positions, GL_RGBA32F)
+    glBindTexture(GL_TEXTURE_2D, 0);
+#undef __TEXTURE_CONFIG_HELPER
+
+    auto groups = ((width + GROUP_SIZE - 1) / GROUP_SIZE) * ((height + GROUP_SIZE - 1) / GROUP_SIZE);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(float)*groups, nullptr, GL_STREAM_READ);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, output_buffer, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        error("Failed to generate frame buffer for shader::StochasticLighting");
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
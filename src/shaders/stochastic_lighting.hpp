@@ -0,0 +1,71 @@
+#ifndef PX_CG_SHADERS_STOCHASTIC_LIGHTING_HPP
+#define PX_CG_SHADERS_STOCHASTIC_LIGHTING_HPP
+
+#include <vector>
+
+#include "shader.hpp"
+#include "deferred_lighting.hpp"
+
+namespace px { namespace shader
+{
+class StochasticLighting;
+}}
+
+// Stochastic many-light deferred shading using a compute shader.
+// Every pixel draws N_CANDIDATES lights uniformly and keeps one of them by
+// weighted reservoir sampling, with the luminance of its unshadowed
+// contribution as the target function. The reservoir is then merged with the
+// one of the same surface point in the previous frame and with those of
+// N_NEIGHBOURS nearby pixels on similar surfaces before shading, so the cost
+// per pixel does not depend on the number of lights.
+// Lights are read from the shader storage buffer bound at binding point 1.
+class px::shader::StochasticLighting : public Shader
+{
+public:
+    static const char *COMPUTE_SHADER;
+
+    static const int GROUP_SIZE;
+    static const int N_CANDIDATES;
+    static const int N_NEIGHBOURS;
+
+public:
+    StochasticLighting();
+    ~StochasticLighting() override;
+
+    void init();
+    // shade the G-buffer in pass_shader by sampling the first n_lights lights
+    // and put the result on the screen,
+    // view_projection is the current one used to reproject the next frame
+    void render(int n_lights, glm::mat4 const &view_projection,
+                DeferredLightingPass &pass_shader);
+    // compare the latest result with the exact one, which is expected in the
+    // ambient buffer of pass_shader, e.g. after DeferredLighting::renderCache.
+    // The error heat map is put on the screen if show_only is 5.
+    void compare(DeferredLightingPass &pass_shader);
+
+    // set framebuffer size, call after init before use
+    void setBufferSize(int width, int height);
+
+    // root mean square error and PSNR in dB of the latest compare(),
+    // colors are clamped into [0, 1]
+    inline float rmse() const noexcept { return rmse_; }
+    inline float psnr() const noexcept { return psnr_; }
+
+protected:
+    unsigned int fbo;
+    unsigned int output_buffer;
+    unsigned int reservoirs[2];
+    unsigned int history_positions;
+    unsigned int ssbo;
+private:
+    int buffer_width_;
+    int buffer_height_;
+    int frame_;
+    bool has_history_;
+    glm::mat4 prev_view_projection_;
+    float rmse_;
+    float psnr_;
+    std::vector<float> error_sums_;
+};
+
+#endif // PX_CG_SHADERS_STOCHASTIC_LIGHTING_HPP
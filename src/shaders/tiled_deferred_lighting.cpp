@@ -0,0 +1,109 @@
+#include "tiled_deferred_lighting.hpp"
+
+using namespace px;
+
+const char *shader::TiledDeferredLighting::COMPUTE_SHADER =
+#include "shaders/glsl/tiled_deferred_lighting.cs"
+;
+const int shader::TiledDeferredLighting::TILE_SIZE = 16;
+const int shader::TiledDeferredLighting::MAX_LIGHTS_PER_TILE = 1024;
+
+shader::TiledDeferredLighting::TiledDeferredLighting()
+    : Shader(), fbo(0), output_buffer(0), overflow_ssbo{0}, buffer_width_(0), buffer_height_(0),
+      overflow_index_(0), overflow_tiles_(0)
+{}
+
+shader::TiledDeferredLighting::~TiledDeferredLighting()
+{
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteTextures(1, &output_buffer);
+    glDeleteBuffers(2, overflow_ssbo);
+}
+
+void shader::TiledDeferredLighting::init()
+{
+    glDeleteFramebuffers(1, &fbo); fbo = 0;
+    glDeleteTextures(1, &output_buffer); output_buffer = 0;
+    glDeleteBuffers(2, overflow_ssbo); overflow_ssbo[0] = 0; overflow_ssbo[1] = 0;
+
+    Shader::init(DeferredLightingPass::withGBufferDecode(COMPUTE_SHADER,
+            "\n#define TILE_SIZE " + std::to_string(TILE_SIZE) +
+            "\n#define MAX_LIGHTS_PER_TILE " + std::to_string(MAX_LIGHTS_PER_TILE)).c_str());
+
+    glGenFramebuffers(1, &fbo);
+    glGenTextures(1, &output_buffer);
+    glGenBuffers(2, overflow_ssbo);
+    auto const zero = 0u;
+    for (auto b : overflow_ssbo)
+    {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, b);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(zero), &zero, GL_DYNAMIC_READ);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    overflow_index_ = 0;
+    overflow_tiles_ = 0;
+
+    Shader::activate(true);
+    set("ambient_buffer", 0);
+    set("diffuse_buffer", 1);
+    set("specular_buffer", 2);
+    set("depth_buffer", 3);
+    set("normal_buffer", 4);
+    set("show_only", -1);
+    Shader::activate(false);
+
+    if (buffer_width_ != 0 && buffer_height_ != 0)
+        setBufferSize(buffer_width_, buffer_height_);
+}
+
+void shader::TiledDeferredLighting::render(int n_lights, DeferredLightingPass &pass_shader)
+{
+    pass_shader.activateBuffers();
+    glBindImageTexture(0, output_buffer, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+    set("n_lights", n_lights);
+    auto const zero = 0u;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, overflow_ssbo[overflow_index_]);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(zero), &zero);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 14, overflow_ssbo[overflow_index_]);
+    glDispatchCompute((buffer_width_ + TILE_SIZE - 1) / TILE_SIZE,
+                      (buffer_height_ + TILE_SIZE - 1) / TILE_SIZE, 1);
+    glMemoryBarrier(GL_FRAMEBUFFER_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    // the counter of the previous frame has been finished with, reading it
+    // does not wait for the dispatch above
+    overflow_index_ = 1 - overflow_index_;
+    unsigned int overflow = 0;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, overflow_ssbo[overflow_index_]);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(overflow), &overflow);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    overflow_tiles_ = static_cast<int>(overflow);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0, 0, buffer_width_, buffer_height_,
+                      0, 0, buffer_width_, buffer_height_,
+                      GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+}
+
+void shader::TiledDeferredLighting::setBufferSize(int width, int height)
+{
+    buffer_width_ = width;
+    buffer_height_ = height;
+
+    if (fbo == 0)
+        return;
+
+    glBindTexture(GL_TEXTURE_2D, output_buffer);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, output_buffer, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        error("Failed to generate frame buffer for shader::TiledDeferredLighting");
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
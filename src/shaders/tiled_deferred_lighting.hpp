@@ -0,0 +1,61 @@
+#ifndef PX_CG_SHADERS_TILED_DEFERRED_LIGHTING_HPP
+#define PX_CG_SHADERS_TILED_DEFERRED_LIGHTING_HPP
+
+#include "shader.hpp"
+#include "deferred_lighting.hpp"
+
+namespace px { namespace shader
+{
+class TiledDeferredLighting;
+}}
+
+// Tiled deferred shading using a compute shader.
+// The screen is split into TILE_SIZE x TILE_SIZE tiles. Each work group culls
+// all lights against its tile frustum bounded by the min/max depth of the tile
+// and then shades every pixel of the tile in one dispatch, such that the
+// G-buffer is read only once no matter how many lights are there.
+// Lights are read from the shader storage buffer bound at binding point 1.
+// A tile keeps at most MAX_LIGHTS_PER_TILE lights and drops the rest; such
+// tiles are counted by overflowTiles and shown red in the heat map.
+class px::shader::TiledDeferredLighting : public Shader
+{
+public:
+    static const char *COMPUTE_SHADER;
+
+    static const int TILE_SIZE;
+    static const int MAX_LIGHTS_PER_TILE;
+
+public:
+    TiledDeferredLighting();
+    ~TiledDeferredLighting() override;
+
+    void init();
+    // shade the G-buffer in pass_shader with the first n_lights lights
+    // and put the result on the screen
+    void render(int n_lights, DeferredLightingPass &pass_shader);
+
+    // set framebuffer size, call after init before use
+    void setBufferSize(int width, int height);
+
+    // number of tiles of the previous render() call that found more than
+    // MAX_LIGHTS_PER_TILE lights, read back one frame late
+    inline int overflowTiles() const noexcept { return overflow_tiles_; }
+    inline int tileCount() const noexcept
+    {
+        return ((buffer_width_ + TILE_SIZE - 1) / TILE_SIZE) * ((buffer_height_ + TILE_SIZE - 1) / TILE_SIZE);
+    }
+
+protected:
+    unsigned int fbo;
+    unsigned int output_buffer;
+    // overflow counters, one written by the current frame while
+    // the one of the previous frame is read
+    unsigned int overflow_ssbo[2];
+private:
+    int buffer_width_;
+    int buffer_height_;
+    int overflow_index_;
+    int overflow_tiles_;
+};
+
+#endif // PX_CG_SHADERS_TILED_DEFERRED_LIGHTING_HPP
@@ -0,0 +1,120 @@
+#include "upsampled_lighting.hpp"
+
+#include <algorithm>
+
+using namespace px;
+
+const char *shader::UpsampledLighting::COMPUTE_SHADER =
+#include "shaders/glsl/upsampled_lighting.cs"
+;
+const int shader::UpsampledLighting::GROUP_SIZE = 16;
+const int shader::UpsampledLighting::DEFAULT_DOWNSAMPLE = 2;
+const int shader::UpsampledLighting::MAX_DOWNSAMPLE = 4;
+
+shader::UpsampledLighting::UpsampledLighting()
+    : Shader(), fbo(0), output_buffer(0), lighting_buffers{0},
+      buffer_width_(0), buffer_height_(0), downsample_(DEFAULT_DOWNSAMPLE)
+{}
+
+shader::UpsampledLighting::~UpsampledLighting()
+{
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteTextures(1, &output_buffer);
+    glDeleteTextures(2, lighting_buffers);
+}
+
+void shader::UpsampledLighting::init()
+{
+    glDeleteFramebuffers(1, &fbo); fbo = 0;
+    glDeleteTextures(1, &output_buffer); output_buffer = 0;
+    glDeleteTextures(2, lighting_buffers); lighting_buffers[0] = 0; lighting_buffers[1] = 0;
+
+    Shader::init(DeferredLightingPass::withGBufferDecode(COMPUTE_SHADER,
+            "\n#define GROUP_SIZE " + std::to_string(GROUP_SIZE)).c_str());
+
+    glGenFramebuffers(1, &fbo);
+    glGenTextures(1, &output_buffer);
+    glGenTextures(2, lighting_buffers);
+
+    Shader::activate(true);
+    set("ambient_buffer", 0);
+    set("diffuse_buffer", 1);
+    set("specular_buffer", 2);
+    set("depth_buffer", 3);
+    set("normal_buffer", 4);
+    set("show_only", -1);
+    Shader::activate(false);
+
+    if (buffer_width_ != 0 && buffer_height_ != 0)
+        setBufferSize(buffer_width_, buffer_height_);
+}
+
+void shader::UpsampledLighting::render(int n_lights, DeferredLightingPass &pass_shader)
+{
+    auto low_width = (buffer_width_ + downsample_ - 1) / downsample_;
+    auto low_height = (buffer_height_ + downsample_ - 1) / downsample_;
+
+    pass_shader.activateBuffers();
+    glBindImageTexture(0, output_buffer, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA16F);
+    glBindImageTexture(1, lighting_buffers[0], 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA16F);
+    glBindImageTexture(2, lighting_buffers[1], 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA16F);
+    set("n_lights", n_lights);
+    set("downsample", downsample_);
+
+    set("stage", 0);
+    glDispatchCompute((low_width + GROUP_SIZE - 1) / GROUP_SIZE,
+                      (low_height + GROUP_SIZE - 1) / GROUP_SIZE, 1);
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    set("stage", 1);
+    glDispatchCompute((buffer_width_ + GROUP_SIZE - 1) / GROUP_SIZE,
+                      (buffer_height_ + GROUP_SIZE - 1) / GROUP_SIZE, 1);
+    glMemoryBarrier(GL_FRAMEBUFFER_BARRIER_BIT);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0, 0, buffer_width_, buffer_height_,
+                      0, 0, buffer_width_, buffer_height_,
+                      GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+}
+
+void shader::UpsampledLighting::downsample(int factor)
+{
+    factor = std::min(MAX_DOWNSAMPLE, std::max(1, factor));
+    if (factor == downsample_)
+        return;
+    downsample_ = factor;
+    if (buffer_width_ != 0 && buffer_height_ != 0)
+        setBufferSize(buffer_width_, buffer_height_);
+}
+
+void shader::UpsampledLighting::setBufferSize(int width, int height)
+{
+    buffer_width_ = width;
+    buffer_height_ = height;
+
+    if (fbo == 0)
+        return;
+
+    auto low_width = (width + downsample_ - 1) / downsample_;
+    auto low_height = (height + downsample_ - 1) / downsample_;
+
+#define __TEXTURE_CONFIG_HELPER(tex, w, h)                                          \
+    glBindTexture(GL_TEXTURE_2D, tex);                                              \
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, w, h, 0, GL_RGBA, GL_FLOAT, nullptr); \
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);              \
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    __TEXTURE_CONFIG_HELPER(output_buffer, width, height)
+    __TEXTURE_CONFIG_HELPER(lighting_buffers[0], low_width, low_height) // diffuse_lighting
+    __TEXTURE_CONFIG_HELPER(lighting_buffers[1], low_width, low_height) // specular_lighting
+    glBindTexture(GL_TEXTURE_2D, 0);
+#undef __TEXTURE_CONFIG_HELPER
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, output_buffer, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        error("Failed to generate frame buffer for shader::UpsampledLighting");
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
@@ -0,0 +1,55 @@
+#ifndef PX_CG_SHADERS_UPSAMPLED_LIGHTING_HPP
+#define PX_CG_SHADERS_UPSAMPLED_LIGHTING_HPP
+
+#include "shader.hpp"
+#include "deferred_lighting.hpp"
+
+namespace px { namespace shader
+{
+class UpsampledLighting;
+}}
+
+// Deferred lighting at a reduced resolution using a compute shader.
+// Diffuse and specular lighting, without surface colors, is computed for one
+// out of downsample() x downsample() pixels, and then upsampled by a joint
+// bilateral filter guided by the full-resolution normal and position buffers
+// before multiplied by the full-resolution surface colors.
+// Visible lights are read from the light storage buffer at binding point 1
+// through the index buffer at binding point 4.
+class px::shader::UpsampledLighting : public Shader
+{
+public:
+    static const char *COMPUTE_SHADER;
+
+    static const int GROUP_SIZE;
+    static const int DEFAULT_DOWNSAMPLE;
+    static const int MAX_DOWNSAMPLE;
+
+public:
+    UpsampledLighting();
+    ~UpsampledLighting() override;
+
+    void init();
+    // shade the G-buffer in pass_shader with the first n_lights visible lights
+    // and put the result on the screen
+    void render(int n_lights, DeferredLightingPass &pass_shader);
+
+    // set framebuffer size, call after init before use
+    void setBufferSize(int width, int height);
+    // set size ratio of the full-resolution buffers to the lighting buffers,
+    // clamped into [1, MAX_DOWNSAMPLE]
+    void downsample(int factor);
+
+    inline int downsample() const noexcept { return downsample_; }
+
+protected:
+    unsigned int fbo;
+    unsigned int output_buffer;
+    unsigned int lighting_buffers[2];
+private:
+    int buffer_width_;
+    int buffer_height_;
+    int downsample_;
+};
+
+#endif // PX_CG_SHADERS_UPSAMPLED_LIGHTING_HPP
@@ -0,0 +1,248 @@
+#include "visibility_buffer.hpp"
+
+#include <algorithm>
+
+using namespace px;
+
+const char *shader::VisibilityPass::VERTEX_SHADER =
+#include "shaders/glsl/visibility_pass.vs"
+;
+const char *shader::VisibilityPass::FRAGMENT_SHADER =
+#include "shaders/glsl/visibility_pass.fs"
+;
+const int shader::VisibilityPass::TRIANGLE_BITS = 16;
+const std::size_t shader::VisibilityPass::BYTES_PER_PIXEL = 8;
+
+const char *shader::VisibilityResolve::COMPUTE_SHADER =
+#include "shaders/glsl/visibility_resolve.cs"
+;
+const int shader::VisibilityResolve::GROUP_SIZE = 16;
+const int shader::VisibilityResolve::MAX_MATERIALS = 2;
+
+shader::VisibilityPass::VisibilityPass()
+    : Shader(), fbo(0), id_buffer(0), depth_buffer(0),
+      buffer_width_(0), buffer_height_(0)
+{}
+
+shader::VisibilityPass::~VisibilityPass()
+{
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteTextures(1, &id_buffer);
+    glDeleteTextures(1, &depth_buffer);
+}
+
+void shader::VisibilityPass::init()
+{
+    glDeleteFramebuffers(1, &fbo); fbo = 0;
+    glDeleteTextures(1, &id_buffer); id_buffer = 0;
+    glDeleteTextures(1, &depth_buffer); depth_buffer = 0;
+
+    std::string fs(FRAGMENT_SHADER);
+    fs.insert(fs.find_first_of("c")+4,
+              "\n#define TRIANGLE_BITS " + std::to_string(TRIANGLE_BITS));
+    Shader::init(VERTEX_SHADER, fs.c_str());
+    Shader::activate(true);
+    set("material.displace", 3);
+    Shader::activate(false);
+
+    glGenFramebuffers(1, &fbo);
+    glGenTextures(1, &id_buffer);
+    glGenTextures(1, &depth_buffer);
+
+    if (buffer_width_ != 0 && buffer_height_ != 0)
+        setBufferSize(buffer_width_, buffer_height_);
+}
+
+void shader::VisibilityPass::activate(bool enable)
+{
+    if (enable)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        // ids of pixels without geometry are never read, as their depth is 1
+        glClear(GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+        glEnable(GL_STENCIL_TEST);
+        glStencilFunc(GL_ALWAYS, 1, 0xFF);
+        glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+    }
+    else
+    {
+        glDisable(GL_STENCIL_TEST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+    Shader::activate(enable);
+}
+
+void shader::VisibilityPass::setBufferSize(int width, int height)
+{
+    buffer_width_ = width;
+    buffer_height_ = height;
+
+    if (fbo == 0)
+        return;
+
+#define __TEXTURE_CONFIG_HELPER(tex, internal_format, format, type)             \
+    glBindTexture(GL_TEXTURE_2D, tex);                                          \
+    glTexImage2D(GL_TEXTURE_2D, 0, internal_format,                             \
+                 width, height, 0, format, type, 0);                            \
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);          \
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    __TEXTURE_CONFIG_HELPER(id_buffer, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT)
+    __TEXTURE_CONFIG_HELPER(depth_buffer, GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8)
+    glBindTexture(GL_TEXTURE_2D, 0);
+#undef __TEXTURE_CONFIG_HELPER
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, id_buffer, 0);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, depth_buffer, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        error("Failed to generate frame buffer for shader::VisibilityPass");
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void shader::VisibilityPass::extractDepthBuffer()
+{
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0, 0, bufferWidth(), bufferHeight(),
+                      0, 0, bufferWidth(), bufferHeight(),
+                      GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+}
+
+
+shader::VisibilityResolve::VisibilityResolve()
+    : Shader(), fbo(0), output_buffer(0), ssbo{0},
+      buffer_width_(0), buffer_height_(0), object_capacity_(0),
+      textures_(4*MAX_MATERIALS, 0)
+{}
+
+shader::VisibilityResolve::~VisibilityResolve()
+{
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteTextures(1, &output_buffer);
+    glDeleteBuffers(3, ssbo);
+}
+
+void shader::VisibilityResolve::init()
+{
+    glDeleteFramebuffers(1, &fbo); fbo = 0;
+    glDeleteTextures(1, &output_buffer); output_buffer = 0;
+    glDeleteBuffers(3, ssbo); ssbo[0] = 0; ssbo[1] = 0; ssbo[2] = 0;
+    object_capacity_ = 0;
+
+    std::string tmp(COMPUTE_SHADER);
+    tmp.insert(tmp.find_first_of("c")+4,
+               "\n#define GROUP_SIZE " + std::to_string(GROUP_SIZE) +
+               "\n#define TRIANGLE_BITS " + std::to_string(VisibilityPass::TRIANGLE_BITS) +
+               "\n#define MAX_MATERIALS " + std::to_string(MAX_MATERIALS));
+    Shader::init(tmp.c_str());
+
+    glGenFramebuffers(1, &fbo);
+    glGenTextures(1, &output_buffer);
+    glGenBuffers(3, ssbo);
+
+    Shader::activate(true);
+    set("id_buffer", 0);
+    set("depth_buffer", 1);
+    // diffuse, normal, specular and displacement maps of each material
+    for (auto i = 0; i < 4*MAX_MATERIALS; ++i)
+        set("material_maps[" + std::to_string(i) + "]", 2 + i);
+    set("show_only", -1);
+    Shader::activate(false);
+
+    if (buffer_width_ != 0 && buffer_height_ != 0)
+        setBufferSize(buffer_width_, buffer_height_);
+}
+
+void shader::VisibilityResolve::meshes(std::vector<Vertex> const &vertices,
+                                       std::vector<unsigned int> const &indices)
+{
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo[0]);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(Vertex)*vertices.size(), vertices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo[1]);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(unsigned int)*indices.size(), indices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void shader::VisibilityResolve::objects(std::vector<Object> const &objects)
+{
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo[2]);
+    if (objects.size() > object_capacity_)
+    {
+        object_capacity_ = objects.size();
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(Object)*object_capacity_, objects.data(), GL_STREAM_DRAW);
+    }
+    else
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(Object)*objects.size(), objects.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void shader::VisibilityResolve::material(int index, const unsigned int textures[4],
+                                         glm::vec3 const &ambient, float shininess,
+                                         float displace_scale, float displace_mid)
+{
+    if (index < 0 || index >= MAX_MATERIALS)
+        error("Invalid material index " + std::to_string(index) + " for shader::VisibilityResolve");
+    std::copy(textures, textures + 4, textures_.begin() + 4*index);
+
+    auto i = "[" + std::to_string(index) + "]";
+    Shader::activate(true);
+    set("material_ambient" + i, ambient);
+    set("material_shininess" + i, shininess);
+    set("material_displace_scale" + i, displace_scale);
+    set("material_displace_mid" + i, displace_mid);
+    Shader::activate(false);
+}
+
+void shader::VisibilityResolve::render(int n_lights, VisibilityPass &pass_shader)
+{
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, pass_shader.id_buffer);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, pass_shader.depth_buffer);
+    for (auto i = 0; i < 4*MAX_MATERIALS; ++i)
+    {
+        glActiveTexture(GL_TEXTURE2 + i);
+        glBindTexture(GL_TEXTURE_2D, textures_[i]);
+    }
+    glBindImageTexture(0, output_buffer, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, ssbo[0]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, ssbo[1]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, ssbo[2]);
+    set("n_lights", n_lights);
+    glDispatchCompute((buffer_width_ + GROUP_SIZE - 1) / GROUP_SIZE,
+                      (buffer_height_ + GROUP_SIZE - 1) / GROUP_SIZE, 1);
+    glMemoryBarrier(GL_FRAMEBUFFER_BARRIER_BIT);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0, 0, buffer_width_, buffer_height_,
+                      0, 0, buffer_width_, buffer_height_,
+                      GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void shader::VisibilityResolve::setBufferSize(int width, int height)
+{
+    buffer_width_ = width;
+    buffer_height_ = height;
+
+    if (fbo == 0)
+        return;
+
+    glBindTexture(GL_TEXTURE_2D, output_buffer);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, output_buffer, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        error("Failed to generate frame buffer for shader::VisibilityResolve");
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
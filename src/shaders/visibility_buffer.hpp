@@ -0,0 +1,120 @@
+#ifndef PX_CG_SHADERS_VISIBILITY_BUFFER_HPP
+#define PX_CG_SHADERS_VISIBILITY_BUFFER_HPP
+
+#include <vector>
+
+#include "shader.hpp"
+
+namespace px { namespace shader
+{
+class VisibilityPass;
+class VisibilityResolve;
+}}
+
+// Geometry pass of visibility buffer rendering, which writes only
+//   id_buffer     object id << TRIANGLE_BITS | triangle index, 32-bit uint
+//   depth_buffer  depth and stencil, stencil is 1 for pixels covered by geometry
+// i.e. 8 bytes per pixel. Objects set the uniform object_id, the index of
+// their entry in the object list of VisibilityResolve, and are drawn with the
+// same material uniforms as for DeferredLightingPass for vertex displacement.
+class px::shader::VisibilityPass : public Shader
+{
+public:
+    static const char *VERTEX_SHADER;
+    static const char *FRAGMENT_SHADER;
+
+    // number of low bits in an id used for the triangle index
+    static const int TRIANGLE_BITS;
+    static const std::size_t BYTES_PER_PIXEL;
+
+public:
+    VisibilityPass();
+    ~VisibilityPass() override;
+
+    void init();
+    void activate(bool enable) override;
+
+    // set framebuffer size, call after init before use
+    void setBufferSize(int width, int height);
+    // copy depth and stencil buffer onto the screen
+    void extractDepthBuffer();
+
+    inline int bufferWidth() const noexcept { return buffer_width_; }
+    inline int bufferHeight() const noexcept { return buffer_height_; }
+
+    friend VisibilityResolve;
+protected:
+    unsigned int fbo;
+    unsigned int id_buffer;
+    unsigned int depth_buffer;
+private:
+    int buffer_width_;
+    int buffer_height_;
+};
+
+// Resolve pass of visibility buffer rendering using a compute shader.
+// For each pixel the triangle in the visibility buffer is fetched from the
+// vertex and index storage buffers at binding points 8 and 9 and transformed
+// by its object at binding point 10, then intersected with the view ray to
+// interpolate its attributes. Texture gradients come from the intersections of
+// the neighbouring pixels' rays with the same triangle. The material is
+// evaluated and lit by the visible lights in the light storage buffer at
+// binding point 1 through the index buffer at binding point 4.
+class px::shader::VisibilityResolve : public Shader
+{
+public:
+    static const char *COMPUTE_SHADER;
+
+    static const int GROUP_SIZE;
+    static const int MAX_MATERIALS;
+
+    // vertex as stored in the vertex storage buffer (std430 layout)
+    struct Vertex
+    {
+        glm::vec3 position; float u;
+        glm::vec3 normal;   float v;
+        glm::vec3 tangent;  float pad;
+    };
+    // object as stored in the object storage buffer (std430 layout),
+    // its triangles are indices [first_index, first_index + 3*n) plus base_vertex
+    struct Object
+    {
+        glm::mat4 model;
+        unsigned int first_index;
+        unsigned int base_vertex;
+        unsigned int material;
+        unsigned int pad;
+    };
+
+public:
+    VisibilityResolve();
+    ~VisibilityResolve() override;
+
+    void init();
+    // upload the vertices and indices of all meshes
+    void meshes(std::vector<Vertex> const &vertices, std::vector<unsigned int> const &indices);
+    // upload the object list, indexed by the object ids in the visibility buffer
+    void objects(std::vector<Object> const &objects);
+    // set the material of the given index, textures are the diffuse, normal,
+    // specular and displacement maps as used by DeferredLightingPass
+    void material(int index, const unsigned int textures[4], glm::vec3 const &ambient,
+                  float shininess, float displace_scale, float displace_mid);
+    // shade the visibility buffer in pass_shader with the first n_lights
+    // visible lights and put the result on the screen
+    void render(int n_lights, VisibilityPass &pass_shader);
+
+    // set framebuffer size, call after init before use
+    void setBufferSize(int width, int height);
+
+protected:
+    unsigned int fbo;
+    unsigned int output_buffer;
+    unsigned int ssbo[3];
+private:
+    int buffer_width_;
+    int buffer_height_;
+    std::size_t object_capacity_;
+    std::vector<unsigned int> textures_;
+};
+
+#endif // PX_CG_SHADERS_VISIBILITY_BUFFER_HPP
@@ -0,0 +1,42 @@
+#include "util/shape_generator.hpp"
+
+#include <iostream>
+#include <iomanip>
+
+// Vertex cache efficiency of the generated sphere meshes before and after
+// generator::optimizeMesh, on the grid sizes drawn by DeferredRenderBenchmark.
+// Fails if optimizing makes any mesh worse or breaks its index list.
+
+using namespace px;
+
+template<typename Index>
+bool check(const char *name, unsigned int n_grid,
+           std::vector<Index> const &raw, std::vector<Index> const &optimized,
+           std::size_t n_vertices)
+{
+    auto before = generator::acmr(raw.data(), raw.size());
+    auto after = generator::acmr(optimized.data(), optimized.size());
+    auto valid = raw.size() == optimized.size() &&
+                 *std::max_element(optimized.begin(), optimized.end()) + 1u == n_vertices;
+    std::cout << std::setw(24) << name << " grid " << std::setw(2) << n_grid
+              << "  ACMR " << std::fixed << std::setprecision(3) << before << " -> " << after
+              << (valid && after <= before ? "" : "  FAILED") << std::endl;
+    return valid && after <= before;
+}
+
+int main()
+{
+    auto pass = true;
+    for (auto n_grid : {48u, 24u, 12u, 6u})
+    {
+        auto raw = generator::sphere(n_grid, 1.f, false);
+        auto optimized = generator::sphere(n_grid, 1.f);
+        pass = check("sphere", n_grid, raw.second, optimized.second, optimized.first.size() / 3) && pass;
+
+        auto raw_full = generator::sphereWithNormUVTangle(n_grid, 1.f, false);
+        auto optimized_full = generator::sphereWithNormUVTangle(n_grid, 1.f);
+        pass = check("sphereWithNormUVTangle", n_grid, std::get<1>(raw_full), std::get<1>(optimized_full),
+                     std::get<0>(optimized_full).size() / 3) && pass;
+    }
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,64 @@
+#include "util/cluster_builder.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <string>
+#include <omp.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+// Headless benchmark of ClusterBuilder::build at increasing OpenMP thread
+// counts, on a synthetic version of the DeferredRenderBenchmark scene:
+// lights scattered over a 25 x 25 field seen by the scene's initial camera.
+//   usage: cluster_bench [n_lights = 10000] [n_iterations = 50]
+
+using namespace px;
+
+int main(int argc, char *argv[])
+{
+    auto n_lights = argc > 1 ? std::stoi(argv[1]) : 10000;
+    auto n_iterations = argc > 2 ? std::stoi(argv[2]) : 50;
+
+    std::mt19937 rng(5608);
+    std::uniform_real_distribution<float> field(-12.5f, 12.5f);
+    std::uniform_real_distribution<float> height(0.f, .5f);
+    std::uniform_real_distribution<float> radius_range(.5f, 2.f);
+    std::vector<glm::vec3> position(n_lights);
+    std::vector<float> radius(n_lights);
+    for (auto i = 0; i < n_lights; ++i)
+    {
+        position[i] = glm::vec3(field(rng), height(rng), field(rng));
+        radius[i] = radius_range(rng);
+    }
+
+    auto view = glm::lookAt(glm::vec3(-25.f, 18.f, 0.f), glm::vec3(0.f), glm::vec3(0.f, 1.f, 0.f));
+    auto projection = glm::perspective(glm::radians(45.f), 16.f / 9.f, .1f, ClusterBuilder::DEFAULT_FAR);
+
+    std::cout << n_lights << " lights, " << n_iterations << " builds per thread count" << std::endl;
+    auto max_threads = omp_get_num_procs();
+    auto single = 0.0;
+    for (auto n_threads = 1; ; n_threads = std::min(n_threads * 2, max_threads))
+    {
+        omp_set_num_threads(n_threads);
+        ClusterBuilder builder;
+        // warm up, which also allocates the per-thread lists
+        builder.build(view, projection, position.data(), radius.data(), n_lights);
+
+        auto start = std::chrono::high_resolution_clock::now();
+        for (auto i = 0; i < n_iterations; ++i)
+            builder.build(view, projection, position.data(), radius.data(), n_lights);
+        auto ms = std::chrono::duration<double, std::milli>(
+                std::chrono::high_resolution_clock::now() - start).count() / n_iterations;
+        if (n_threads == 1)
+            single = ms;
+
+        std::cout << std::setw(3) << n_threads << " threads: "
+                  << std::fixed << std::setprecision(3) << ms << " ms per build, "
+                  << std::setprecision(2) << single / ms << "x, "
+                  << builder.indices().size() << " light indices" << std::endl;
+        if (n_threads == max_threads)
+            break;
+    }
+    return 0;
+}
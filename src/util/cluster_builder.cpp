@@ -0,0 +1,186 @@
+#include "cluster_builder.hpp"
+#include "screen_bounds.hpp"
+
+#include <cmath>
+#include <algorithm>
+#include <omp.h>
+
+using namespace px;
+
+const int ClusterBuilder::DEFAULT_GRID_X = 16;
+const int ClusterBuilder::DEFAULT_GRID_Y = 9;
+const int ClusterBuilder::DEFAULT_GRID_Z = 24;
+const float ClusterBuilder::DEFAULT_NEAR = 1.f;
+const float ClusterBuilder::DEFAULT_FAR = 150.f;
+
+ClusterBuilder::ClusterBuilder()
+    : proj_x_(0.f), proj_y_(0.f)
+{
+    grid(DEFAULT_GRID_X, DEFAULT_GRID_Y, DEFAULT_GRID_Z);
+    depthRange(DEFAULT_NEAR, DEFAULT_FAR);
+}
+
+void ClusterBuilder::grid(int x, int y, int z)
+{
+    grid_x_ = std::max(1, x);
+    grid_y_ = std::max(1, y);
+    grid_z_ = std::max(2, z);
+    proj_x_ = 0.f; proj_y_ = 0.f; // force to update cluster bounds
+}
+
+void ClusterBuilder::depthRange(float near, float far)
+{
+    near_ = near;
+    far_ = std::max(far, near + 1e-3f);
+    log_depth_ratio_ = std::log(far_ / near_);
+    proj_x_ = 0.f; proj_y_ = 0.f;
+}
+
+int ClusterBuilder::slice(float depth) const noexcept
+{
+    if (depth < near_) return 0;
+    if (depth >= far_) return grid_z_ - 1;
+    auto k = 1 + static_cast<int>(std::log(depth / near_) / log_depth_ratio_ * (grid_z_ - 1));
+    return std::min(k, grid_z_ - 1);
+}
+
+void ClusterBuilder::updateClusterBounds(glm::mat4 const &projection)
+{
+    if (proj_x_ == projection[0][0] && proj_y_ == projection[1][1])
+        return;
+
+    proj_x_ = projection[0][0];
+    proj_y_ = projection[1][1];
+    cluster_min_.resize(nClusters());
+    cluster_max_.resize(nClusters());
+
+    // view-space AABB of each cluster
+    for (auto k = 0; k < grid_z_; ++k)
+    {
+        auto zn = k == 0 ? 0.f : near_ * std::exp(log_depth_ratio_ * (k - 1) / (grid_z_ - 1));
+        auto zf = near_ * std::exp(log_depth_ratio_ * k / (grid_z_ - 1));
+        for (auto y = 0; y < grid_y_; ++y)
+        {
+            auto y0 = 2.f * y / grid_y_ - 1.f;
+            auto y1 = 2.f * (y + 1) / grid_y_ - 1.f;
+            for (auto x = 0; x < grid_x_; ++x)
+            {
+                auto x0 = 2.f * x / grid_x_ - 1.f;
+                auto x1 = 2.f * (x + 1) / grid_x_ - 1.f;
+                auto idx = (k * grid_y_ + y) * grid_x_ + x;
+                cluster_min_[idx].x = std::min(x0 * zn, x0 * zf) / proj_x_;
+                cluster_max_[idx].x = std::max(x1 * zn, x1 * zf) / proj_x_;
+                cluster_min_[idx].y = std::min(y0 * zn, y0 * zf) / proj_y_;
+                cluster_max_[idx].y = std::max(y1 * zn, y1 * zf) / proj_y_;
+                cluster_min_[idx].z = -zf;
+                cluster_max_[idx].z = -zn;
+            }
+        }
+    }
+}
+
+static int tileIndex(float ndc, int n_tiles)
+{
+    ndc = std::min(1.f, std::max(-1.f, ndc));
+    return std::min(n_tiles - 1, static_cast<int>((ndc + 1.f) * .5f * n_tiles));
+}
+
+void ClusterBuilder::build(glm::mat4 const &view, glm::mat4 const &projection,
+                           const glm::vec3 *position, const float *radius, int n_lights)
+{
+    build(view, projection, position, radius, nullptr, n_lights);
+}
+
+void ClusterBuilder::build(glm::mat4 const &view, glm::mat4 const &projection,
+                           const glm::vec3 *position, const float *radius,
+                           const unsigned int *light_indices, int n_lights)
+{
+    updateClusterBounds(projection);
+
+    auto n_threads = omp_get_max_threads();
+    auto n_clusters = nClusters();
+    if (static_cast<int>(thread_entries_.size()) < n_threads)
+    {
+        thread_entries_.resize(n_threads);
+        thread_counts_.resize(n_threads);
+    }
+    for (auto t = 0; t < n_threads; ++t)
+    {
+        thread_entries_[t].clear();
+        thread_counts_[t].assign(n_clusters, 0);
+    }
+
+#pragma omp parallel num_threads(n_threads)
+    {
+        auto &entries = thread_entries_[omp_get_thread_num()];
+        auto &counts = thread_counts_[omp_get_thread_num()];
+
+#pragma omp for schedule(static)
+        for (auto j = 0; j < n_lights; ++j)
+        {
+            auto i = light_indices ? light_indices[j] : static_cast<unsigned int>(j);
+            auto c = glm::vec3(view * glm::vec4(position[i], 1.f));
+            auto r = radius[i];
+            auto d = -c.z;
+            if (d + r < 0.f || d - r > far_)
+                continue;
+
+            int x0 = 0, x1 = grid_x_ - 1, y0 = 0, y1 = grid_y_ - 1;
+            if (d - r > 0.f)
+            {
+                float lo, hi;
+                sphereNDCBounds(c.x, d, r, proj_x_, lo, hi);
+                if (lo > 1.f || hi < -1.f) continue;
+                x0 = tileIndex(lo, grid_x_); x1 = tileIndex(hi, grid_x_);
+                sphereNDCBounds(c.y, d, r, proj_y_, lo, hi);
+                if (lo > 1.f || hi < -1.f) continue;
+                y0 = tileIndex(lo, grid_y_); y1 = tileIndex(hi, grid_y_);
+            }
+            auto k0 = slice(std::max(0.f, d - r));
+            auto k1 = slice(d + r);
+
+            auto r2 = r*r;
+            for (auto k = k0; k <= k1; ++k)
+            {
+                for (auto y = y0; y <= y1; ++y)
+                {
+                    for (auto x = x0; x <= x1; ++x)
+                    {
+                        auto idx = (k * grid_y_ + y) * grid_x_ + x;
+                        // sphere-AABB test for a tighter assignment
+                        auto dv = glm::max(cluster_min_[idx] - c, glm::vec3(0.f)) +
+                                  glm::max(c - cluster_max_[idx], glm::vec3(0.f));
+                        if (glm::dot(dv, dv) > r2)
+                            continue;
+                        entries.emplace_back(idx, i);
+                        ++counts[idx];
+                    }
+                }
+            }
+        }
+    }
+
+    // turn per-thread counts into write positions
+    offsets_.resize(2*n_clusters);
+    unsigned int tot = 0;
+    for (auto c = 0; c < n_clusters; ++c)
+    {
+        offsets_[2*c] = tot;
+        for (auto t = 0; t < n_threads; ++t)
+        {
+            auto n = thread_counts_[t][c];
+            thread_counts_[t][c] = tot;
+            tot += n;
+        }
+        offsets_[2*c+1] = tot - offsets_[2*c];
+    }
+    indices_.resize(tot);
+
+#pragma omp parallel for num_threads(n_threads)
+    for (auto t = 0; t < n_threads; ++t)
+    {
+        auto &counts = thread_counts_[t];
+        for (auto const &e : thread_entries_[t])
+            indices_[counts[e.first]++] = e.second;
+    }
+}
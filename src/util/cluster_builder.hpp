@@ -0,0 +1,79 @@
+#ifndef PX_CG_UTIL_CLUSTER_BUILDER_HPP
+#define PX_CG_UTIL_CLUSTER_BUILDER_HPP
+
+#include <vector>
+#include "glm.hpp"
+
+namespace px
+{
+class ClusterBuilder;
+}
+
+// CPU light assignment for clustered shading.
+// The view frustum is split into grid_x x grid_y screen tiles and grid_z depth
+// slices. Slice 0 covers [0, near]; slices 1 to grid_z-1 split [near, far]
+// exponentially. build() fills, for each cluster, the list of lights whose
+// effective sphere touches the cluster. Lights are distributed over OpenMP
+// threads. The builder does not touch OpenGL.
+class px::ClusterBuilder
+{
+public:
+    static const int DEFAULT_GRID_X;
+    static const int DEFAULT_GRID_Y;
+    static const int DEFAULT_GRID_Z;
+    static const float DEFAULT_NEAR;
+    static const float DEFAULT_FAR;
+
+public:
+    ClusterBuilder();
+    ~ClusterBuilder() = default;
+
+    void grid(int x, int y, int z);
+    void depthRange(float near, float far);
+
+    // projection is assumed to be a symmetric perspective projection
+    void build(glm::mat4 const &view, glm::mat4 const &projection,
+               const glm::vec3 *position, const float *radius, int n_lights);
+    // assign only the n_lights lights listed in light_indices,
+    // e.g. those which survived frustum culling
+    void build(glm::mat4 const &view, glm::mat4 const &projection,
+               const glm::vec3 *position, const float *radius,
+               const unsigned int *light_indices, int n_lights);
+
+    // depth slice that a view-space depth belongs to
+    int slice(float depth) const noexcept;
+
+    inline int gridX() const noexcept { return grid_x_; }
+    inline int gridY() const noexcept { return grid_y_; }
+    inline int gridZ() const noexcept { return grid_z_; }
+    inline int nClusters() const noexcept { return grid_x_*grid_y_*grid_z_; }
+    inline float nearDepth() const noexcept { return near_; }
+    inline float farDepth() const noexcept { return far_; }
+    // offset and number of light indices of each cluster, two per cluster
+    inline std::vector<unsigned int> const &offsets() const noexcept { return offsets_; }
+    // light indices of all clusters
+    inline std::vector<unsigned int> const &indices() const noexcept { return indices_; }
+
+protected:
+    void updateClusterBounds(glm::mat4 const &projection);
+
+private:
+    int grid_x_;
+    int grid_y_;
+    int grid_z_;
+    float near_;
+    float far_;
+    float log_depth_ratio_;
+
+    float proj_x_;
+    float proj_y_;
+    std::vector<glm::vec3> cluster_min_;
+    std::vector<glm::vec3> cluster_max_;
+
+    std::vector<unsigned int> offsets_;
+    std::vector<unsigned int> indices_;
+    std::vector<std::vector<std::pair<unsigned int, unsigned int> > > thread_entries_;
+    std::vector<std::vector<unsigned int> > thread_counts_;
+};
+
+#endif // PX_CG_UTIL_CLUSTER_BUILDER_HPP
@@ -0,0 +1,146 @@
+#include "frustum_culler.hpp"
+
+#include <cmath>
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define PX_CG_FRUSTUM_CULLER_SSE
+#include <xmmintrin.h>
+#endif
+#ifdef __AVX__
+#define PX_CG_FRUSTUM_CULLER_AVX
+#include <immintrin.h>
+#endif
+
+using namespace px;
+
+FrustumCuller::FrustumCuller()
+    : plane_a_{0}, plane_b_{0}, plane_c_{0}, plane_d_{0}
+{}
+
+void FrustumCuller::frustum(glm::mat4 const &view, glm::mat4 const &projection)
+{
+    auto m = projection * view;
+    // rows of the view-projection matrix
+    glm::vec4 row[4];
+    for (auto i = 0; i < 4; ++i)
+        row[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+
+    // left, right, bottom, top, near, far
+    glm::vec4 planes[6] = {
+            row[3] + row[0], row[3] - row[0],
+            row[3] + row[1], row[3] - row[1],
+            row[3] + row[2], row[3] - row[2]
+    };
+    for (auto p = 0; p < 6; ++p)
+    {
+        auto len = glm::length(glm::vec3(planes[p]));
+        plane_a_[p] = planes[p].x / len;
+        plane_b_[p] = planes[p].y / len;
+        plane_c_[p] = planes[p].z / len;
+        plane_d_[p] = planes[p].w / len;
+    }
+}
+
+void FrustumCuller::cull(const glm::vec3 *center, const float *radius, int n_spheres)
+{
+    x_.resize(n_spheres);
+    y_.resize(n_spheres);
+    z_.resize(n_spheres);
+    for (auto i = 0; i < n_spheres; ++i)
+    {
+        x_[i] = center[i].x;
+        y_[i] = center[i].y;
+        z_[i] = center[i].z;
+    }
+    cull(x_.data(), y_.data(), z_.data(), radius, n_spheres);
+}
+
+void FrustumCuller::cull(const float *x, const float *y, const float *z, const float *radius,
+                         int n_spheres)
+{
+    visible_.clear();
+    auto i = 0;
+
+#ifdef PX_CG_FRUSTUM_CULLER_AVX
+    __m256 a8[6], b8[6], c8[6], d8[6];
+    for (auto p = 0; p < 6; ++p)
+    {
+        a8[p] = _mm256_set1_ps(plane_a_[p]);
+        b8[p] = _mm256_set1_ps(plane_b_[p]);
+        c8[p] = _mm256_set1_ps(plane_c_[p]);
+        d8[p] = _mm256_set1_ps(plane_d_[p]);
+    }
+    for (; i + 8 <= n_spheres; i += 8)
+    {
+        auto px = _mm256_loadu_ps(x + i);
+        auto py = _mm256_loadu_ps(y + i);
+        auto pz = _mm256_loadu_ps(z + i);
+        auto nr = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(radius + i));
+        // same test as the SSE path below
+        auto inside = _mm256_cmp_ps(px, px, _CMP_EQ_OQ);
+        for (auto p = 0; p < 6; ++p)
+        {
+            auto dist = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a8[p], px), _mm256_mul_ps(b8[p], py)),
+                                      _mm256_add_ps(_mm256_mul_ps(c8[p], pz), d8[p]));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(dist, nr, _CMP_GE_OQ));
+        }
+        auto mask = _mm256_movemask_ps(inside);
+        if (mask == 0) continue;
+        for (auto k = 0; k < 8; ++k)
+        {
+            if (mask & (1 << k))
+                visible_.push_back(i + k);
+        }
+    }
+#endif
+
+#ifdef PX_CG_FRUSTUM_CULLER_SSE
+    __m128 a[6], b[6], c[6], d[6];
+    for (auto p = 0; p < 6; ++p)
+    {
+        a[p] = _mm_set1_ps(plane_a_[p]);
+        b[p] = _mm_set1_ps(plane_b_[p]);
+        c[p] = _mm_set1_ps(plane_c_[p]);
+        d[p] = _mm_set1_ps(plane_d_[p]);
+    }
+    for (; i + 4 <= n_spheres; i += 4)
+    {
+        auto px = _mm_loadu_ps(x + i);
+        auto py = _mm_loadu_ps(y + i);
+        auto pz = _mm_loadu_ps(z + i);
+        auto nr = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(radius + i));
+        // a sphere is outside if it is entirely behind any of the planes
+        auto inside = _mm_cmpeq_ps(px, px); // all bits set
+        for (auto p = 0; p < 6; ++p)
+        {
+            auto dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[p], px), _mm_mul_ps(b[p], py)),
+                                   _mm_add_ps(_mm_mul_ps(c[p], pz), d[p]));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(dist, nr));
+        }
+        auto mask = _mm_movemask_ps(inside);
+        if (mask == 0) continue;
+        for (auto k = 0; k < 4; ++k)
+        {
+            if (mask & (1 << k))
+                visible_.push_back(i + k);
+        }
+    }
+#endif
+
+    for (; i < n_spheres; ++i)
+    {
+        auto inside = true;
+        for (auto p = 0; p < 6 && inside; ++p)
+            inside = plane_a_[p]*x[i] + plane_b_[p]*y[i] + plane_c_[p]*z[i] + plane_d_[p] >= -radius[i];
+        if (inside)
+            visible_.push_back(i);
+    }
+}
+
+void FrustumCuller::cull(SphereBVH const &bvh, int n_spheres)
+{
+    glm::vec4 planes[6];
+    for (auto p = 0; p < 6; ++p)
+        planes[p] = glm::vec4(plane_a_[p], plane_b_[p], plane_c_[p], plane_d_[p]);
+    visible_.clear();
+    bvh.query(planes, 6, n_spheres, visible_);
+}
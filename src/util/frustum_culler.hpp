@@ -0,0 +1,56 @@
+#ifndef PX_CG_UTIL_FRUSTUM_CULLER_HPP
+#define PX_CG_UTIL_FRUSTUM_CULLER_HPP
+
+#include <vector>
+#include "glm.hpp"
+#include "sphere_bvh.hpp"
+
+namespace px
+{
+class FrustumCuller;
+}
+
+// CPU view frustum culling of spheres.
+// The six frustum planes are extracted from the view-projection matrix.
+// Spheres are tested eight at a time with AVX, when compiled for it, or four
+// at a time with SSE over structure-of-arrays data (a scalar path is used on
+// other targets and for the tail).
+// cull() keeps, in order, the indices of spheres that are at least partially
+// inside the frustum. The culler does not touch OpenGL.
+class px::FrustumCuller
+{
+public:
+    FrustumCuller();
+    ~FrustumCuller() = default;
+
+    // extract frustum planes, call before cull()
+    void frustum(glm::mat4 const &view, glm::mat4 const &projection);
+
+    // cull spheres stored as structure of arrays
+    void cull(const float *x, const float *y, const float *z, const float *radius,
+              int n_spheres);
+    // cull spheres stored as array of structures,
+    // they are first copied into an internal structure-of-arrays mirror
+    void cull(const glm::vec3 *center, const float *radius, int n_spheres);
+    // cull the first n_spheres spheres of a hierarchy built over them,
+    // visible() is then ordered by the leaves of the hierarchy
+    void cull(SphereBVH const &bvh, int n_spheres);
+
+    // indices of spheres passing the latest cull()
+    inline std::vector<unsigned int> const &visible() const noexcept { return visible_; }
+
+private:
+    // a, b, c, d of the plane a*x + b*y + c*z + d = 0, normal pointing inwards
+    float plane_a_[6];
+    float plane_b_[6];
+    float plane_c_[6];
+    float plane_d_[6];
+
+    std::vector<float> x_;
+    std::vector<float> y_;
+    std::vector<float> z_;
+    std::vector<float> r_;
+    std::vector<unsigned int> visible_;
+};
+
+#endif // PX_CG_UTIL_FRUSTUM_CULLER_HPP
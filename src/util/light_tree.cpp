@@ -0,0 +1,89 @@
+#include "light_tree.hpp"
+
+#include <algorithm>
+#include <limits>
+
+using namespace px;
+
+void LightTree::update(SphereBVH const &bvh,
+                       const glm::vec3 *position, const float *radius,
+                       const glm::vec3 *ambient, const glm::vec3 *diffuse,
+                       const glm::vec3 *specular, const glm::vec3 *coef,
+                       int n_lights)
+{
+    auto const &bvh_nodes = bvh.nodes();
+    order_ = bvh.order();
+    auto n_nodes = static_cast<int>(bvh_nodes.size());
+    nodes_.resize(n_nodes);
+
+#pragma omp parallel for num_threads(6)
+    for (auto i = 0; i < n_nodes; ++i)
+    {
+        auto &node = nodes_[i];
+        node.left = bvh_nodes[i].left;
+        node.first = bvh_nodes[i].first;
+        node.count = bvh_nodes[i].count;
+        if (node.left != -1)
+            continue;
+
+        node.lo = glm::vec3(std::numeric_limits<float>::max());
+        node.hi = glm::vec3(-std::numeric_limits<float>::max());
+        node.max_radius = 0.f;
+        node.weight = 0.f;
+        node.position = glm::vec3(0.f);
+        node.ambient = glm::vec3(0.f);
+        node.diffuse = glm::vec3(0.f);
+        node.specular = glm::vec3(0.f);
+        node.coef = glm::vec3(0.f);
+        node.n_lights = 0;
+        for (auto k = node.first; k < node.first + node.count; ++k)
+        {
+            auto j = order_[k];
+            if (static_cast<int>(j) >= n_lights)
+                continue;
+            auto w = diffuse[j].x + diffuse[j].y + diffuse[j].z;
+            node.lo = glm::min(node.lo, position[j]);
+            node.hi = glm::max(node.hi, position[j]);
+            node.max_radius = std::max(node.max_radius, radius[j]);
+            node.weight += w;
+            node.position += position[j] * w;
+            node.ambient += ambient[j];
+            node.diffuse += diffuse[j];
+            node.specular += specular[j];
+            node.coef += coef[j] * w;
+            ++node.n_lights;
+        }
+    }
+
+    // children are always stored after their parent
+    for (auto i = n_nodes - 1; i > -1; --i)
+    {
+        auto &node = nodes_[i];
+        if (node.left == -1)
+            continue;
+        auto const &l = nodes_[node.left];
+        auto const &r = nodes_[node.left + 1];
+        node.lo = glm::min(l.lo, r.lo);
+        node.hi = glm::max(l.hi, r.hi);
+        node.max_radius = std::max(l.max_radius, r.max_radius);
+        node.weight = l.weight + r.weight;
+        node.position = l.position + r.position;
+        node.ambient = l.ambient + r.ambient;
+        node.diffuse = l.diffuse + r.diffuse;
+        node.specular = l.specular + r.specular;
+        node.coef = l.coef + r.coef;
+        node.n_lights = l.n_lights + r.n_lights;
+    }
+
+    // turn weighted sums into weighted means
+#pragma omp parallel for num_threads(6)
+    for (auto i = 0; i < n_nodes; ++i)
+    {
+        auto &node = nodes_[i];
+        if (node.weight > 0.f)
+        {
+            node.position = node.position / node.weight;
+            node.coef = node.coef / node.weight;
+        }
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef PX_CG_UTIL_LIGHT_TREE_HPP
+#define PX_CG_UTIL_LIGHT_TREE_HPP
+
+#include <vector>
+#include "glm.hpp"
+#include "sphere_bvh.hpp"
+
+namespace px
+{
+class LightTree;
+}
+
+// Lightcuts-style light hierarchy.
+// It reuses the topology of a SphereBVH built over the light sources and
+// stores, for every node, the bounds of its light positions, the largest
+// effective radius, the summed light colors and a representative position,
+// the centroid weighted by diffuse intensity. A shader walks the tree and
+// shades a node by its representative when the node looks small enough from
+// the shaded point, instead of shading every light below it.
+// Nodes are laid out for a std430 shader storage buffer.
+// The tree does not touch OpenGL.
+class px::LightTree
+{
+public:
+    struct Node
+    {
+        glm::vec3 lo;       float max_radius;
+        glm::vec3 hi;       float weight;
+        glm::vec3 position; float pad0;
+        glm::vec3 ambient;  float pad1;
+        glm::vec3 diffuse;  float pad2;
+        glm::vec3 specular; float pad3;
+        glm::vec3 coef;     float pad4;
+        // left child, -1 for leaves, and the range [first, first + count)
+        // of light indices in order()
+        int left;
+        int first;
+        int count;
+        // number of lights below the node taken into account
+        int n_lights;
+    };
+
+public:
+    LightTree() = default;
+    ~LightTree() = default;
+
+    // aggregate lights whose index is less than n_lights
+    // over the hierarchy of bvh, which must be built over the same lights
+    void update(SphereBVH const &bvh,
+                const glm::vec3 *position, const float *radius,
+                const glm::vec3 *ambient, const glm::vec3 *diffuse,
+                const glm::vec3 *specular, const glm::vec3 *coef,
+                int n_lights);
+
+    inline std::vector<Node> const &nodes() const noexcept { return nodes_; }
+    // light indices sorted by leaves
+    inline std::vector<unsigned int> const &order() const noexcept { return order_; }
+
+private:
+    std::vector<Node> nodes_;
+    std::vector<unsigned int> order_;
+};
+
+#endif // PX_CG_UTIL_LIGHT_TREE_HPP
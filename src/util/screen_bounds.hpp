@@ -0,0 +1,47 @@
+#ifndef PX_CG_UTIL_SCREEN_BOUNDS_HPP
+#define PX_CG_UTIL_SCREEN_BOUNDS_HPP
+
+#include <cmath>
+#include <algorithm>
+#include "glm.hpp"
+
+namespace px
+{
+// conservative NDC range of a sphere along one screen axis
+// a is the view-space coordinate along the axis and d the depth of the center,
+// scale is the corresponding diagonal entry of a symmetric perspective projection
+// the sphere must be in front of the camera, i.e. d > r
+inline void sphereNDCBounds(float a, float d, float r, float scale,
+                            float &lo, float &hi)
+{
+    auto alpha = std::atan2(a, d);
+    auto beta = std::asin(r / std::sqrt(a*a + d*d));
+    lo = std::tan(alpha - beta) * scale;
+    hi = std::tan(alpha + beta) * scale;
+}
+
+// conservative NDC rectangle (x_min, y_min, x_max, y_max) of a sphere,
+// clamped to the screen, the whole screen if the sphere reaches the near plane
+// and an empty rectangle (min > max) if the sphere is behind the camera
+inline glm::vec4 sphereNDCRect(glm::mat4 const &view, glm::mat4 const &projection, float near,
+                               glm::vec3 const &center, float radius)
+{
+    auto c = glm::vec3(view * glm::vec4(center, 1.f));
+    auto d = -c.z;
+    if (d + radius < near)
+        return glm::vec4(1.f, 1.f, -1.f, -1.f);
+    if (d - radius < near)
+        return glm::vec4(-1.f, -1.f, 1.f, 1.f);
+
+    glm::vec4 rect;
+    sphereNDCBounds(c.x, d, radius, projection[0][0], rect.x, rect.z);
+    sphereNDCBounds(c.y, d, radius, projection[1][1], rect.y, rect.w);
+    rect.x = std::max(-1.f, rect.x);
+    rect.y = std::max(-1.f, rect.y);
+    rect.z = std::min(1.f, rect.z);
+    rect.w = std::min(1.f, rect.w);
+    return rect;
+}
+}
+
+#endif // PX_CG_UTIL_SCREEN_BOUNDS_HPP
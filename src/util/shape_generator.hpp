@@ -1,10 +1,38 @@
 #ifndef PX_CG_UTIL_SHAPE_GENERATOR_HPP
 #define PX_CG_UTIL_SHAPE_GENERATOR_HPP
 
+#include "glm.hpp"
+
+#include <vector>
+#include <tuple>
+#include <algorithm>
+#include <cmath>
+
 namespace px { namespace generator
 {
+// average cache miss ratio, i.e. vertex shader invocations per triangle,
+// of the given triangle list on a FIFO post-transform cache
+template<typename Index>
+float acmr(const Index *indices, std::size_t n_indices, unsigned int cache_size = 16);
+// reorder the triangles of the given triangle list for the post-transform
+// cache by Tipsify (Sander et al. 2007), then sort the clusters Tipsify
+// produces such that triangles facing outward from the mesh are drawn first,
+// which reduces overdraw without hurting the cache much, and finally renumber
+// the vertices in the order they are fetched.
+// returns the new index of every vertex, apply it to each vertex attribute
+// by remapVertices
+template<typename Index>
+std::vector<unsigned int> optimizeMesh(std::vector<Index> &indices,
+                                       std::vector<float> const &vertices,
+                                       unsigned int cache_size = 16);
+// move the n_components values of each vertex to their new index
+template<typename T>
+void remapVertices(std::vector<T> &attribute, int n_components,
+                   std::vector<unsigned int> const &remap);
+
+// all generated triangles are counter-clockwise seen from outside
 std::pair<std::vector<float>, std::vector<unsigned short> >
-        sphere(unsigned int n_grid, float radius);
+        sphere(unsigned int n_grid, float radius, bool optimize = true);
 std::tuple<
         // vertex            vertex indices
         std::vector<float>, std::vector<unsigned short>,
@@ -13,16 +41,242 @@ std::tuple<
         // tangent
         std::vector<float>
 >
-sphereWithNormUVTangle(unsigned int n_grid, float radius);
+sphereWithNormUVTangle(unsigned int n_grid, float radius, bool optimize = true);
 }}
 
+template<typename Index>
+float px::generator::acmr(const Index *indices, std::size_t n_indices, unsigned int cache_size)
+{
+    if (n_indices < 3)
+        return 0.f;
+    // a vertex is in the cache if less than cache_size misses happened since
+    // it was loaded the last time
+    std::vector<std::size_t> loaded(*std::max_element(indices, indices + n_indices) + 1, 0);
+    std::size_t misses = 0;
+    for (std::size_t i = 0; i < n_indices; ++i)
+    {
+        auto &t = loaded[indices[i]];
+        if (t == 0 || misses - t >= cache_size)
+            t = ++misses;
+    }
+    return static_cast<float>(misses) / (n_indices / 3);
+}
+
+template<typename Index>
+std::vector<unsigned int> px::generator::optimizeMesh(std::vector<Index> &indices,
+                                                      std::vector<float> const &vertices,
+                                                      unsigned int cache_size)
+{
+    auto n_vertices = static_cast<int>(vertices.size() / 3);
+    auto n_triangles = static_cast<int>(indices.size() / 3);
+
+    // triangles around each vertex
+    std::vector<int> adj_offset(n_vertices + 1, 0);
+    for (auto i : indices)
+        ++adj_offset[i + 1];
+    for (auto v = 0; v < n_vertices; ++v)
+        adj_offset[v + 1] += adj_offset[v];
+    std::vector<int> adj(indices.size());
+    {
+        auto fill = adj_offset;
+        for (std::size_t i = 0, tot = indices.size(); i < tot; ++i)
+            adj[fill[indices[i]]++] = static_cast<int>(i / 3);
+    }
+
+    // Tipsify, fanning around the vertex that stays longest in the cache;
+    // a jump to a dead end or an unrelated vertex flushes the cache and
+    // starts a new cluster
+    std::vector<int> live(n_vertices);
+    for (auto v = 0; v < n_vertices; ++v)
+        live[v] = adj_offset[v + 1] - adj_offset[v];
+    std::vector<int> cache_time(n_vertices, 0);
+    std::vector<char> emitted(n_triangles, 0);
+    std::vector<int> dead_end, candidates, order, cluster_start;
+    order.reserve(n_triangles);
+    auto k = static_cast<int>(cache_size);
+    auto time = k + 1;
+    auto cursor = 0;
+    auto f = n_vertices > 0 ? 0 : -1;
+    while (f != -1)
+    {
+        candidates.clear();
+        for (auto a = adj_offset[f]; a < adj_offset[f + 1]; ++a)
+        {
+            auto t = adj[a];
+            if (emitted[t])
+                continue;
+            emitted[t] = 1;
+            order.push_back(t);
+            for (auto c = 0; c < 3; ++c)
+            {
+                auto v = static_cast<int>(indices[3*t + c]);
+                dead_end.push_back(v);
+                candidates.push_back(v);
+                --live[v];
+                if (time - cache_time[v] > k)
+                    cache_time[v] = time++;
+            }
+        }
+
+        // the candidate still in the cache after fanning around it
+        f = -1;
+        auto best = -1;
+        for (auto v : candidates)
+        {
+            if (live[v] == 0)
+                continue;
+            auto p = 0;
+            if (time - cache_time[v] + 2*live[v] <= k)
+                p = time - cache_time[v];
+            if (p > best)
+            {
+                best = p;
+                f = v;
+            }
+        }
+        if (f != -1)
+            continue;
+
+        while (!dead_end.empty() && f == -1)
+        {
+            if (live[dead_end.back()] > 0)
+                f = dead_end.back();
+            dead_end.pop_back();
+        }
+        while (f == -1 && cursor < n_vertices)
+        {
+            if (live[cursor] > 0)
+                f = cursor;
+            ++cursor;
+        }
+        if (f != -1)
+            cluster_start.push_back(static_cast<int>(order.size()));
+    }
+    cluster_start.insert(cluster_start.begin(), 0);
+    cluster_start.push_back(n_triangles);
+
+    // split clusters further where the cache misses so far are close to those
+    // of the whole cluster, giving the sort finer clusters almost for free
+    std::vector<Index> tmp(indices.size());
+    {
+        std::vector<int> soft_start;
+        for (std::size_t c = 0; c + 1 < cluster_start.size(); ++c)
+        {
+            auto begin = cluster_start[c];
+            auto end = cluster_start[c+1];
+            for (auto i = begin; i < end; ++i)
+                std::copy(indices.begin() + 3*order[i], indices.begin() + 3*order[i] + 3,
+                          tmp.begin() + 3*i);
+            auto threshold = 1.05f * acmr(tmp.data() + 3*begin, 3*(end - begin), cache_size);
+
+            soft_start.push_back(begin);
+            std::vector<int> loaded;
+            auto misses = 0;
+            for (auto i = begin; i < end; ++i)
+            {
+                for (auto j = 3*i; j < 3*i + 3; ++j)
+                {
+                    auto v = static_cast<int>(tmp[j]);
+                    if (std::find(loaded.end() - std::min<std::size_t>(cache_size, loaded.size()),
+                                  loaded.end(), v) == loaded.end())
+                    {
+                        loaded.push_back(v);
+                        ++misses;
+                    }
+                }
+                if (i + 1 < end && misses <= threshold * (i + 1 - soft_start.back()))
+                {
+                    soft_start.push_back(i + 1);
+                    loaded.clear();
+                    misses = 0;
+                }
+            }
+        }
+        soft_start.push_back(n_triangles);
+        cluster_start.swap(soft_start);
+    }
+
+    // sort clusters by how much their area-weighted normal points away from
+    // the mesh center, such clusters likely occlude the others
+    struct Cluster { int begin, end; float key; };
+    std::vector<Cluster> clusters;
+    auto position = [&](Index i) {
+        return glm::vec3(vertices[3*i], vertices[3*i+1], vertices[3*i+2]);
+    };
+    glm::vec3 mesh_center(0.f);
+    float mesh_area = 0.f;
+    for (auto t = 0; t < n_triangles; ++t)
+    {
+        auto p0 = position(indices[3*t]), p1 = position(indices[3*t+1]), p2 = position(indices[3*t+2]);
+        auto area = glm::length(glm::cross(p1 - p0, p2 - p0));
+        mesh_center += area * (p0 + p1 + p2);
+        mesh_area += 3.f * area;
+    }
+    if (mesh_area > 0.f)
+        mesh_center /= mesh_area;
+    for (std::size_t c = 0; c + 1 < cluster_start.size(); ++c)
+    {
+        glm::vec3 center(0.f), normal(0.f);
+        float area = 0.f;
+        for (auto i = cluster_start[c]; i < cluster_start[c+1]; ++i)
+        {
+            auto p0 = position(tmp[3*i]), p1 = position(tmp[3*i+1]), p2 = position(tmp[3*i+2]);
+            auto n = glm::cross(p1 - p0, p2 - p0);
+            auto a = glm::length(n);
+            center += a * (p0 + p1 + p2);
+            area += 3.f * a;
+            normal += n;
+        }
+        auto key = 0.f;
+        if (area > 0.f && glm::length(normal) > 0.f)
+            key = glm::dot(center / area - mesh_center, glm::normalize(normal));
+        clusters.push_back({cluster_start[c], cluster_start[c+1], key});
+    }
+    std::stable_sort(clusters.begin(), clusters.end(),
+                     [](Cluster const &a, Cluster const &b) { return a.key > b.key; });
+    std::vector<Index> sorted(indices.size());
+    auto n = 0;
+    for (auto const &c : clusters)
+        for (auto j = 3*c.begin; j < 3*c.end; ++j)
+            sorted[n++] = tmp[j];
+    // meshes small enough for a ring to fit in the cache may come in a better
+    // order already, keep it then and only renumber the vertices
+    if (acmr(sorted.data(), sorted.size(), cache_size) < acmr(indices.data(), indices.size(), cache_size))
+        indices.swap(sorted);
+
+    // number vertices in the order they are first used, unused ones last
+    std::vector<unsigned int> remap(n_vertices, static_cast<unsigned int>(-1));
+    unsigned int next = 0;
+    for (auto &i : indices)
+    {
+        if (remap[i] == static_cast<unsigned int>(-1))
+            remap[i] = next++;
+        i = static_cast<Index>(remap[i]);
+    }
+    for (auto &r : remap)
+        if (r == static_cast<unsigned int>(-1))
+            r = next++;
+    return remap;
+}
+
+template<typename T>
+void px::generator::remapVertices(std::vector<T> &attribute, int n_components,
+                                  std::vector<unsigned int> const &remap)
+{
+    std::vector<T> tmp(attribute.size());
+    for (std::size_t v = 0, tot = remap.size(); v < tot; ++v)
+        std::copy(attribute.begin() + v*n_components, attribute.begin() + (v+1)*n_components,
+                  tmp.begin() + remap[v]*n_components);
+    attribute.swap(tmp);
+}
+
 std::pair<std::vector<float>, std::vector<unsigned short> >
-px::generator::sphere(unsigned int n_grid, float radius)
+px::generator::sphere(unsigned int n_grid, float radius, bool optimize)
 {
     auto n_theta = static_cast<int>(n_grid+1);
     auto n_phi = static_cast<int>(n_grid + n_grid);
     auto tot_point = n_phi*(n_theta-1)+1;
-    auto n_indices = (n_phi+1)*(n_theta-1) * 6 + 3*n_phi;
+    auto n_indices = n_phi*(n_theta-2) * 6 + 3*n_phi;
 
     std::vector<float> sphere(tot_point * 3);
     std::vector<unsigned short> vertex_order(n_indices);
@@ -56,30 +310,36 @@ px::generator::sphere(unsigned int n_grid, float radius)
         vertex_order[n++] = 2+j;
     }
     vertex_order[n++] = 0;
-    vertex_order[n++] = n_phi-1;
+    vertex_order[n++] = n_phi;
     vertex_order[n++] = 1;
-    for (auto i = 1; i < n_theta; ++i)
+    // all triangles are counter-clockwise seen from outside
+    for (auto i = 1; i < n_theta-1; ++i)
     {
-        for (auto j = 0; j < n_phi; ++j)
+        for (auto j = 0; j < n_phi-1; ++j)
         {
             vertex_order[n++] = idx;
-            vertex_order[n++] = idx+1;
             vertex_order[n++] = idx+1+n_phi;
+            vertex_order[n++] = idx+1;
 
             vertex_order[n++] = idx+1+n_phi;
             vertex_order[n++] = idx;
             vertex_order[n++] = idx+n_phi;
             ++idx;
         }
+        ++idx;
+        // close the band between the last and first vertices of the rings
         vertex_order[n++] = idx-1;
-        vertex_order[n++] = idx-n_phi;
         vertex_order[n++] = idx;
+        vertex_order[n++] = idx-n_phi;
 
         vertex_order[n++] = idx;
         vertex_order[n++] = idx-1;
         vertex_order[n++] = idx-1+n_phi;
     }
 
+    if (optimize)
+        remapVertices(sphere, 3, optimizeMesh(vertex_order, sphere));
+
     return {sphere, vertex_order};
 };
 
@@ -91,12 +351,12 @@ std::tuple<
         // tangent
         std::vector<float>
 >
-px::generator::sphereWithNormUVTangle(unsigned int n_grid, float radius)
+px::generator::sphereWithNormUVTangle(unsigned int n_grid, float radius, bool optimize)
 {
     auto n_theta = static_cast<int>(n_grid+1);
     auto n_phi = static_cast<int>(n_grid + n_grid);
     auto tot_point = n_phi*(n_theta-1)+1;
-    auto n_indices = (n_phi+1)*(n_theta-1) * 6 + 3*n_phi;
+    auto n_indices = n_phi*(n_theta-2) * 6 + 3*n_phi;
 
     std::vector<float> sphere(tot_point * 3);
     std::vector<float> norm(tot_point * 3);
@@ -158,30 +418,42 @@ px::generator::sphereWithNormUVTangle(unsigned int n_grid, float radius)
         vertex_order[n++] = 2+j;
     }
     vertex_order[n++] = 0;
-    vertex_order[n++] = n_phi-1;
+    vertex_order[n++] = n_phi;
     vertex_order[n++] = 1;
-    for (auto i = 1; i < n_theta; ++i)
+    // all triangles are counter-clockwise seen from outside
+    for (auto i = 1; i < n_theta-1; ++i)
     {
-        for (auto j = 0; j < n_phi; ++j)
+        for (auto j = 0; j < n_phi-1; ++j)
         {
             vertex_order[n++] = idx;
-            vertex_order[n++] = idx+1;
             vertex_order[n++] = idx+1+n_phi;
+            vertex_order[n++] = idx+1;
 
             vertex_order[n++] = idx+1+n_phi;
             vertex_order[n++] = idx;
             vertex_order[n++] = idx+n_phi;
             ++idx;
         }
+        ++idx;
+        // close the band between the last and first vertices of the rings
         vertex_order[n++] = idx-1;
-        vertex_order[n++] = idx-n_phi;
         vertex_order[n++] = idx;
+        vertex_order[n++] = idx-n_phi;
 
         vertex_order[n++] = idx;
         vertex_order[n++] = idx-1;
         vertex_order[n++] = idx-1+n_phi;
     }
 
+    if (optimize)
+    {
+        auto remap = optimizeMesh(vertex_order, sphere);
+        remapVertices(sphere, 3, remap);
+        remapVertices(uv, 2, remap);
+        remapVertices(norm, 3, remap);
+        remapVertices(tangent, 3, remap);
+    }
+
     return {sphere, vertex_order, uv, norm, tangent};
 };
 
@@ -0,0 +1,203 @@
+#include "sphere_bvh.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+using namespace px;
+
+const int SphereBVH::LEAF_SIZE = 8;
+
+void SphereBVH::build(const glm::vec3 *center, const float *radius, int n_spheres)
+{
+    nodes_.clear();
+    order_.resize(n_spheres);
+    x_.resize(n_spheres);
+    y_.resize(n_spheres);
+    z_.resize(n_spheres);
+    r_.resize(n_spheres);
+    if (n_spheres < 1)
+        return;
+
+    // split on sphere centers, bounds are computed by refit
+    std::iota(order_.begin(), order_.end(), 0u);
+    for (auto i = 0; i < n_spheres; ++i)
+    {
+        x_[i] = center[i].x;
+        y_[i] = center[i].y;
+        z_[i] = center[i].z;
+    }
+    nodes_.reserve(2 * (n_spheres / LEAF_SIZE + 1));
+    nodes_.push_back({glm::vec3(0.f), glm::vec3(0.f), 0, n_spheres, -1});
+    split(0);
+
+    refit(center, radius);
+}
+
+void SphereBVH::split(int node)
+{
+    auto first = nodes_[node].first;
+    auto count = nodes_[node].count;
+    if (count <= LEAF_SIZE)
+        return;
+
+    auto lo = glm::vec3(x_[order_[first]], y_[order_[first]], z_[order_[first]]);
+    auto hi = lo;
+    for (auto i = first + 1; i < first + count; ++i)
+    {
+        auto p = glm::vec3(x_[order_[i]], y_[order_[i]], z_[order_[i]]);
+        lo = glm::min(lo, p);
+        hi = glm::max(hi, p);
+    }
+    auto ext = hi - lo;
+    const auto &axis = ext.x >= ext.y && ext.x >= ext.z ? x_ : (ext.y >= ext.z ? y_ : z_);
+
+    auto mid = first + count / 2;
+    std::nth_element(order_.begin() + first, order_.begin() + mid, order_.begin() + first + count,
+                     [&axis](unsigned int a, unsigned int b) { return axis[a] < axis[b]; });
+
+    auto left = static_cast<int>(nodes_.size());
+    nodes_[node].left = left;
+    nodes_.push_back({glm::vec3(0.f), glm::vec3(0.f), first, mid - first, -1});
+    nodes_.push_back({glm::vec3(0.f), glm::vec3(0.f), mid, first + count - mid, -1});
+    split(left);
+    split(left + 1);
+}
+
+void SphereBVH::updateLeaf(Node &node) const
+{
+    node.lo = glm::vec3(x_[node.first], y_[node.first], z_[node.first]) - r_[node.first];
+    node.hi = glm::vec3(x_[node.first], y_[node.first], z_[node.first]) + r_[node.first];
+    for (auto i = node.first + 1; i < node.first + node.count; ++i)
+    {
+        auto p = glm::vec3(x_[i], y_[i], z_[i]);
+        node.lo = glm::min(node.lo, p - r_[i]);
+        node.hi = glm::max(node.hi, p + r_[i]);
+    }
+}
+
+void SphereBVH::refit(const glm::vec3 *center, const float *radius)
+{
+    auto n = static_cast<int>(order_.size());
+#pragma omp parallel for num_threads(6)
+    for (auto i = 0; i < n; ++i)
+    {
+        auto const &p = center[order_[i]];
+        x_[i] = p.x;
+        y_[i] = p.y;
+        z_[i] = p.z;
+        r_[i] = radius[order_[i]];
+    }
+
+    // children are always stored after their parent
+    auto n_nodes = static_cast<int>(nodes_.size());
+#pragma omp parallel for num_threads(6)
+    for (auto i = 0; i < n_nodes; ++i)
+    {
+        if (nodes_[i].left == -1)
+            updateLeaf(nodes_[i]);
+    }
+    for (auto i = n_nodes - 1; i > -1; --i)
+    {
+        auto &node = nodes_[i];
+        if (node.left == -1)
+            continue;
+        node.lo = glm::min(nodes_[node.left].lo, nodes_[node.left+1].lo);
+        node.hi = glm::max(nodes_[node.left].hi, nodes_[node.left+1].hi);
+    }
+}
+
+void SphereBVH::append(Node const &node, int n_limit, std::vector<unsigned int> &out) const
+{
+    for (auto i = node.first; i < node.first + node.count; ++i)
+    {
+        if (static_cast<int>(order_[i]) < n_limit)
+            out.push_back(order_[i]);
+    }
+}
+
+void SphereBVH::query(glm::vec3 const &center, float radius, int n_limit,
+                      std::vector<unsigned int> &out) const
+{
+    if (nodes_.empty())
+        return;
+
+    int stack[64];
+    auto top = 0;
+    stack[top++] = 0;
+    while (top > 0)
+    {
+        auto const &node = nodes_[stack[--top]];
+        auto d = glm::max(node.lo - center, glm::vec3(0.f)) +
+                 glm::max(center - node.hi, glm::vec3(0.f));
+        if (glm::dot(d, d) > radius*radius)
+            continue;
+        if (node.left != -1)
+        {
+            stack[top++] = node.left;
+            stack[top++] = node.left + 1;
+            continue;
+        }
+        for (auto i = node.first; i < node.first + node.count; ++i)
+        {
+            if (static_cast<int>(order_[i]) >= n_limit)
+                continue;
+            auto p = glm::vec3(x_[i], y_[i], z_[i]) - center;
+            auto r = r_[i] + radius;
+            if (glm::dot(p, p) <= r*r)
+                out.push_back(order_[i]);
+        }
+    }
+}
+
+void SphereBVH::query(const glm::vec4 *planes, int n_planes, int n_limit,
+                      std::vector<unsigned int> &out) const
+{
+    if (nodes_.empty())
+        return;
+
+    int stack[64];
+    auto top = 0;
+    stack[top++] = 0;
+    while (top > 0)
+    {
+        auto const &node = nodes_[stack[--top]];
+        auto outside = false;
+        auto inside = true;
+        for (auto p = 0; p < n_planes && !outside; ++p)
+        {
+            auto const &pl = planes[p];
+            // corners of the box farthest along and against the plane normal
+            auto far_corner = glm::vec3(pl.x > 0.f ? node.hi.x : node.lo.x,
+                                        pl.y > 0.f ? node.hi.y : node.lo.y,
+                                        pl.z > 0.f ? node.hi.z : node.lo.z);
+            auto near_corner = glm::vec3(pl.x > 0.f ? node.lo.x : node.hi.x,
+                                         pl.y > 0.f ? node.lo.y : node.hi.y,
+                                         pl.z > 0.f ? node.lo.z : node.hi.z);
+            outside = glm::dot(glm::vec3(pl), far_corner) + pl.w < 0.f;
+            inside = inside && glm::dot(glm::vec3(pl), near_corner) + pl.w >= 0.f;
+        }
+        if (outside)
+            continue;
+        if (inside)
+        {
+            append(node, n_limit, out);
+            continue;
+        }
+        if (node.left != -1)
+        {
+            stack[top++] = node.left;
+            stack[top++] = node.left + 1;
+            continue;
+        }
+        for (auto i = node.first; i < node.first + node.count; ++i)
+        {
+            if (static_cast<int>(order_[i]) >= n_limit)
+                continue;
+            auto visible = true;
+            for (auto p = 0; p < n_planes && visible; ++p)
+                visible = planes[p].x*x_[i] + planes[p].y*y_[i] + planes[p].z*z_[i] + planes[p].w >= -r_[i];
+            if (visible)
+                out.push_back(order_[i]);
+        }
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef PX_CG_UTIL_SPHERE_BVH_HPP
+#define PX_CG_UTIL_SPHERE_BVH_HPP
+
+#include <vector>
+#include "glm.hpp"
+
+namespace px
+{
+class SphereBVH;
+}
+
+// Bounding volume hierarchy over a set of moving spheres, e.g. the effective
+// lighting spheres of point lights.
+// build() splits the spheres at the median of the longest axis until a leaf
+// holds at most LEAF_SIZE spheres. refit() keeps the topology and only updates
+// node bounds, which is cheap and stays tight as long as spheres move within
+// a limited area around where they were when built. Every node covers a
+// contiguous range of order(), so a node fully inside a query region reports
+// all of its spheres without descending further.
+// Queries take n_limit and ignore spheres whose index is not less than it.
+// The hierarchy does not touch OpenGL.
+class px::SphereBVH
+{
+public:
+    static const int LEAF_SIZE;
+
+    struct Node
+    {
+        glm::vec3 lo;
+        glm::vec3 hi;
+        // range [first, first + count) in order()
+        int first;
+        int count;
+        // index of the left child, the right one follows it, -1 for leaves
+        int left;
+    };
+
+public:
+    SphereBVH() = default;
+    ~SphereBVH() = default;
+
+    void build(const glm::vec3 *center, const float *radius, int n_spheres);
+    // update bounds for new centers and radii of the spheres used by build()
+    void refit(const glm::vec3 *center, const float *radius);
+
+    // spheres intersecting the given sphere, appended to out
+    void query(glm::vec3 const &center, float radius, int n_limit,
+               std::vector<unsigned int> &out) const;
+    // spheres not entirely behind any of the planes, appended to out
+    // a plane is (a, b, c, d) with a*x + b*y + c*z + d >= 0 on the inner side
+    void query(const glm::vec4 *planes, int n_planes, int n_limit,
+               std::vector<unsigned int> &out) const;
+
+    inline std::size_t size() const noexcept { return order_.size(); }
+    inline std::vector<Node> const &nodes() const noexcept { return nodes_; }
+    // sphere indices sorted by leaves
+    inline std::vector<unsigned int> const &order() const noexcept { return order_; }
+
+protected:
+    void split(int node);
+    void updateLeaf(Node &node) const;
+    void append(Node const &node, int n_limit, std::vector<unsigned int> &out) const;
+
+private:
+    std::vector<Node> nodes_;
+    std::vector<unsigned int> order_;
+    // centers and radii of spheres in the order of order()
+    std::vector<float> x_;
+    std::vector<float> y_;
+    std::vector<float> z_;
+    std::vector<float> r_;
+};
+
+#endif // PX_CG_UTIL_SPHERE_BVH_HPP